@@ -27,6 +27,7 @@
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
 #include <ESP8266HTTPClient.h>
+#include <WiFiClientSecure.h>
 #include <ESP8266mDNS.h>
 #include <WiFiUdp.h>
 #include <EEPROM.h>
@@ -34,7 +35,6 @@
 //#include <WebSocketsServer.h>
 //#include <Hash.h>
 #include <NeoPixelBus.h>
-#include <LibTeleinfo.h>
 #include <FS.h>
 
 extern "C" {
@@ -42,8 +42,23 @@ extern "C" {
 }
 
 #include "webserver.h"
+#include "trace.h"
+#include "teleinfo.h"
+#include "values.h"
+#include "gzip.h"
+#include "cbor.h"
 #include "webclient.h"
+#include "heapstat.h"
 #include "config.h"
+#include "inputs.h"
+#include "pulses.h"
+#include "power.h"
+#include "stats.h"
+#include "shed.h"
+#include "sinks.h"
+#include "rules.h"
+#include "modbus.h"
+#include "logs.h"
 
 // Declare SIMU to work and test a non connected module
 //#define SIMU
@@ -69,14 +84,15 @@ extern "C" {
 
 // I prefix debug macro to be sure to use specific for THIS library
 // debugging, this should not interfere with main sketch or other 
-// libraries
+// libraries. They go to log ring (logs.cpp), drained to serial from
+// main loop
 #ifdef DEBUG
-#define Debug(x)    DEBUG_SERIAL.print(x)
-#define Debugln(x)  DEBUG_SERIAL.println(x)
-#define DebugF(x)   DEBUG_SERIAL.print(F(x))
-#define DebuglnF(x) DEBUG_SERIAL.println(F(x))
-#define Debugf(...) DEBUG_SERIAL.printf(__VA_ARGS__)
-#define Debugflush  DEBUG_SERIAL.flush
+#define Debug(x)    log_print.print(x)
+#define Debugln(x)  log_print.println(x)
+#define DebugF(x)   log_print.print(F(x))
+#define DebuglnF(x) log_print.println(F(x))
+#define Debugf(...) log_print.printf(__VA_ARGS__)
+#define Debugflush  logFlush
 #else
 #define Debug(x)    {}
 #define Debugln(x)  {}
@@ -123,31 +139,66 @@ extern "C" {
 #define LedRGBOFF() {}
 #define LedRGBON(x) {}
 #endif
+// Wifi connection timeout (ms) before falling back to AP mode
+#define WIFI_CONNECT_TIMEOUT  5000
+// Time (ms) given to cached BSSID/channel before doing a full scan
+#define WIFI_FAST_TIMEOUT     1500
+// OTA grace window (ms) after Wifi is up, sinks are held meanwhile
+#define WIFI_OTA_GRACE        3300
+
+// Wifi connection state machine, driven from loop()
+typedef enum
+{
+  WIFI_ST_IDLE,        // Nothing started yet
+  WIFI_ST_CONNECTING,  // WiFi.begin() done, waiting for link
+  WIFI_ST_CONNECTED,   // Station connected to AP
+  WIFI_ST_LOST,        // Station was connected, SDK is reconnecting
+  WIFI_ST_AP           // Connection failed, soft AP started
+} _wifi_state;
+
+// SPIFFS usage cache time to live (s)
+#define SYSINFO_SPIFFS_TTL    60
+
 // sysinfo informations
-typedef struct 
+typedef struct
 {
-  String sys_uptime;
+  // Static facts, computed once at boot
+  const char * sdk_version;
+  uint32_t chip_id;
+  uint8_t  boot_version;
+  uint32_t flash_size;
+  uint32_t sketch_size;
+  uint32_t sketch_free;
+  // SPIFFS usage, cached for SYSINFO_SPIFFS_TTL
+  uint32_t spiffs_total;
+  uint32_t spiffs_used;
+  unsigned long spiffs_time;  // uptime (s) of last SPIFFS.info()
+  bool     spiffs_valid;
+  unsigned long boot_start;   // millis() when entering setup()
+  unsigned long boot_setup;   // millis() when leaving setup()
+  unsigned long boot_wifi;    // millis() when Wifi connected or AP started
+  unsigned long boot_ota;     // millis() when OTA grace window ended
+  unsigned long boot_frame;   // millis() when first teleinfo frame received
+  unsigned long wifi_conn_ms; // duration of last Wifi connection (ms)
+  unsigned int  wifi_fast_ok;   // connections done with cached parameters
+  unsigned int  wifi_fast_fail; // cached parameters failed, full scan done
 } _sysinfo;
 
 // Exported variables/object instancied in main sketch
 // ===================================================
 extern ESP8266WebServer server;
 extern WiFiUDP OTA;
-extern TInfo tinfo;
 extern uint8_t rgb_brightness;
 extern unsigned long seconds;
 extern _sysinfo sysinfo;
-extern Ticker Tick_emoncms;
-extern Ticker Tick_jeedom;
-extern Ticker Tick_httpRequest;
+extern _wifi_state wifi_state;
+extern bool ota_grace;
+extern unsigned int nb_reinit;
 
 
 // Exported function located in main sketch
 // ===================================================
 void ResetConfig(void);
-void Task_emoncms();
-void Task_jeedom();
-void Task_httpRequest();
 
 #endif
 
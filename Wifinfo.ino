@@ -52,9 +52,9 @@
 //#include <WebSocketsServer.h>
 //#include <Hash.h>
 #include <NeoPixelBus.h>
-#include <LibTeleinfo.h>
 #include <FS.h>
 #include <SPI.h>
+#include <lwip/dhcp.h>
 
 // Global project file
 #include "Wifinfo.h"
@@ -86,21 +86,25 @@ Ticker rgb_ticker;
 Ticker blu_ticker;
 Ticker red_ticker;
 Ticker Every_1_Sec;
-Ticker Tick_emoncms;
-Ticker Tick_jeedom;
-Ticker Tick_httpRequest;
 
 volatile boolean task_1_sec = false;
-volatile boolean task_emoncms = false;
-volatile boolean task_jeedom = false;
-volatile boolean task_httpRequest = false;
-volatile boolean task_updsw = false;
-volatile boolean task_updadps = false;
 unsigned long seconds = 0;
 
 // sysinfo data
 _sysinfo sysinfo;
 
+// Wifi state machine
+_wifi_state   wifi_state = WIFI_ST_IDLE;
+unsigned long wifi_start = 0;     // start of current state (ms)
+bool          wifi_led = false;   // current state of status blink
+bool          ota_grace = false;  // true while in OTA grace window
+bool          wifi_fast = false;  // true if trying cached BSSID/channel
+bool          wifi_reuse = false; // true if cached lease is set as static IP
+bool          wifi_renew = false; // true while DHCP is restarted at T1
+bool          wifi_bound = false; // true once a lease was got this boot
+unsigned long wifi_lease = 0;     // when cached lease was got from DHCP (ms)
+unsigned long ota_start = 0;      // start of OTA grace window (ms)
+
 // count Wifi connect attempts, to check stability
 int          nb_reconnect = 0;
 bool	       need_reinit = false;
@@ -117,16 +121,6 @@ String value2 = "000060000";
 char * v2 = (char *) value2.c_str();
 #endif
 
-#ifdef SENSOR
-// Le contact sec devra etre connecte entre GND et D5 (GPIO-14)
-const int   SensorPin = 14; 
-int         reading ;  
-int         SwitchState = -1;       // the current reading from the input pin
-int         lastSwitchState = -1;   // the previous reading from the input pin
-unsigned long lastChangeTime = 0;  // the last time the input pin was toggled
-unsigned long tempo = 200;    // temps necessaire a la stabilisation du switch (0,2 seconde)
-#endif
-
 /*
 char logbuffer[255];
 PString flogger(logbuffer, sizeof(logbuffer));
@@ -177,19 +171,24 @@ Purpose : update sysinfo variables
 Input   : true if first call
           true if needed to print on serial debug
 Output  : - 
-Comments: -
+Comments: static facts are only read on first call, uptime is
+          formatted when someone asks for it (see getSysJSONData)
 ====================================================================== */
 void UpdateSysinfo(boolean first_call, boolean show_debug)
 {
-  char buff[64];
-  int32_t adc;
-  int sec = seconds;
-  int min = sec / 60;
-  int hr = min / 60;
-  long day = hr / 24;
-
-  sprintf_P( buff, PSTR("%ld days %02d h %02d m %02d sec"),day, hr % 24, min % 60, sec % 60);
-  sysinfo.sys_uptime = buff;
+  if (first_call) {
+    sysinfo.sdk_version  = system_get_sdk_version();
+    sysinfo.chip_id      = system_get_chip_id();
+    sysinfo.boot_version = system_get_boot_version();
+    sysinfo.flash_size   = ESP.getFlashChipRealSize();
+    sysinfo.sketch_size  = ESP.getSketchSize();
+    sysinfo.sketch_free  = ESP.getFreeSketchSpace();
+  }
+
+  if (show_debug) {
+    Debugf("SDK %s Chip 0x%06X Boot %d\r\n", sysinfo.sdk_version, sysinfo.chip_id, sysinfo.boot_version);
+    Debugf("Flash %u Sketch %u Free %u\r\n", sysinfo.flash_size, sysinfo.sketch_size, sysinfo.sketch_free);
+  }
 }
 
 /* ======================================================================
@@ -205,42 +204,6 @@ void Task_1_Sec()
   seconds++;
 }
 
-/* ======================================================================
-Function: Task_emoncms
-Purpose : callback of emoncms ticker
-Input   : 
-Output  : -
-Comments: Like an Interrupt, need to be short, we set flag for main loop
-====================================================================== */
-void Task_emoncms()
-{
-  task_emoncms = true;
-}
-
-/* ======================================================================
-Function: Task_jeedom
-Purpose : callback of jeedom ticker
-Input   : 
-Output  : -
-Comments: Like an Interrupt, need to be short, we set flag for main loop
-====================================================================== */
-void Task_jeedom()
-{
-  task_jeedom = true;
-}
-
-/* ======================================================================
-Function: Task_httpRequest
-Purpose : callback of http request ticker
-Input   : 
-Output  : -
-Comments: Like an Interrupt, need to be short, we set flag for main loop
-====================================================================== */
-void Task_httpRequest()
-{
-  task_httpRequest = true;
-}
-
 /* ======================================================================
 Function: LedOff 
 Purpose : callback called after led blink delay
@@ -319,12 +282,13 @@ Comments: should have been initialised in the main sketch with a
 ====================================================================== */
 void ADPSCallback(uint8_t phase)
 {
-  // Monophasé
+  // Overload, shed loads before anything else
+  shedADPS(phase);
+
+  // Monophasé, alert itself is done by rules on ADPS label
   if (phase == 0 ) {
     Debugln(F("ADPS"));
-    task_updadps= true;
   } else {
-    task_updadps= false;
     Debug(F("ADPS Phase "));
     Debugln('0' + phase);
   }
@@ -333,13 +297,18 @@ void ADPSCallback(uint8_t phase)
 /* ======================================================================
 Function: DataCallback 
 Purpose : callback when we detected new or modified data received
-Input   : linked list pointer on the concerned data
-          value current state being TINFO_VALUE_ADDED/TINFO_VALUE_UPDATED
+Input   : label ID of the concerned data
+          value current state being TINFO_FLAGS_ADDED/TINFO_FLAGS_UPDATED
 Output  : - 
-Comments: -
+Comments: value is already decoded in its typed slot
 ====================================================================== */
-void DataCallback(ValueList * me, uint8_t flags)
+void DataCallback(int8_t id, uint8_t flags)
 {
+  // Current first, load shedding has to be fast
+  shedData(id);
+
+  // Energy indexes feed active power estimation
+  powerData(id);
 
   // This is for simulating ADPS during my tests
   // ===========================================
@@ -349,10 +318,10 @@ void DataCallback(ValueList * me, uint8_t flags)
   if (++test >= 20) {
     test=0;
     uint8_t anotherflag = TINFO_FLAGS_NONE;
-    ValueList * anotherme = tinfo.addCustomValue("ADPS", "46", &anotherflag);
+    int8_t anotherid = tinfo.addCustomValue("ADPS", "46", &anotherflag);
 
     // Do our job (mainly debug)
-    DataCallback(anotherme, anotherflag);
+    DataCallback(anotherid, anotherflag);
   }
   Debugf("%02d:",test);
   */
@@ -360,9 +329,9 @@ void DataCallback(ValueList * me, uint8_t flags)
   
 /*
   // Do whatever you want there
-  Debug(me->name);
+  Debug(tabnames[id]);
   Debug('=');
-  Debug(me->value);
+  Debug(valueText(id));
   
   if ( flags & TINFO_FLAGS_NOTHING ) Debug(F(" Nothing"));
   if ( flags & TINFO_FLAGS_ADDED )   Debug(F(" Added"));
@@ -374,17 +343,43 @@ void DataCallback(ValueList * me, uint8_t flags)
 */
 }
 
+/* ======================================================================
+Function: FrameEnd 
+Purpose : tasks done at end of each complete teleinfo frame
+Input   : -
+Output  : - 
+Comments: called by both frame callbacks, values are in value store
+====================================================================== */
+void FrameEnd(void) 
+{
+  // Boot timing, first complete frame
+  if (!sysinfo.boot_frame)
+    sysinfo.boot_frame = millis();
+
+  TRACE_BEGIN(TRACE_FRAME, "frame");
+  valuesFrame();
+  shedFrame();
+  sinksFrame();
+  powerFrame();
+  statsFrame();
+  rulesFrame();
+  modbusFrame();
+  TRACE_END(TRACE_FRAME, "frame");
+}
+
 /* ======================================================================
 Function: NewFrame 
 Purpose : callback when we received a complete teleinfo frame
-Input   : linked list pointer on the concerned data
+Input   : -
 Output  : - 
-Comments: -
+Comments: values are in value store
 ====================================================================== */
-void NewFrame(ValueList * me) 
+void NewFrame(void) 
 {
   char buff[32];
 
+  FrameEnd();
+
   // Light the RGB LED 
   if ( config.config & CFG_RGB_LED) {
     LedRGBON(COLOR_GREEN);
@@ -400,14 +395,16 @@ void NewFrame(ValueList * me)
 /* ======================================================================
 Function: NewFrame 
 Purpose : callback when we received a complete teleinfo frame
-Input   : linked list pointer on the concerned data
+Input   : -
 Output  : - 
 Comments: it's called only if one data in the frame is different than
           the previous frame
 ====================================================================== */
-void UpdatedFrame(ValueList * me)
+void UpdatedFrame(void)
 {
   char buff[32];
+
+  FrameEnd();
   
   // Light the RGB LED (purple)
   if ( config.config & CFG_RGB_LED) {
@@ -470,6 +467,17 @@ void ResetConfig(void)
   sprintf_P(config.host, PSTR("WifInfo-%06X"), ESP.getChipId());
   strcpy_P(config.ota_auth, PSTR(DEFAULT_OTA_AUTH));
   config.ota_port = DEFAULT_OTA_PORT ;
+  config.scan_ttl = CFG_SCAN_DEFAULT_TTL;
+  config.inputs.pin[0] = CFG_INPUT_DEFAULT_PIN;
+  config.inputs.debounce = CFG_INPUT_DEFAULT_DEB;
+  config.power_tau = CFG_POWER_DEFAULT_TAU;
+  strcpy_P(config.stats.labels, PSTR(CFG_STATS_DEFAULT_LABELS));
+  config.stats.window[0] = 60;
+  config.stats.window[1] = 900;
+  config.stats.window[2] = 3600;
+  config.shed.trip = CFG_SHED_DEFAULT_TRIP;
+  config.shed.restore = CFG_SHED_DEFAULT_RESTORE;
+  config.shed.min_off = CFG_SHED_DEFAULT_MINOFF;
 
   // Add other init default config here
 
@@ -477,6 +485,7 @@ void ResetConfig(void)
   strcpy_P(config.emoncms.host, CFG_EMON_DEFAULT_HOST);
   config.emoncms.port = CFG_EMON_DEFAULT_PORT;
   strcpy_P(config.emoncms.url, CFG_EMON_DEFAULT_URL);
+  config.emoncms.bulk_latency = CFG_EMON_DEFAULT_BULKLAT;
 
   // Jeedom
   strcpy_P(config.jeedom.host, CFG_JDOM_DEFAULT_HOST);
@@ -495,12 +504,221 @@ void ResetConfig(void)
   saveConfig();
 }
 
+/* ======================================================================
+Function: WifiBlink
+Purpose : non blocking blink of the RGB LED for Wifi state machine
+Input   : color of the LED
+          on time (ms)
+          blink period (ms)
+Output  : - 
+Comments: LED is only driven on state change, not on each loop
+====================================================================== */
+void WifiBlink(uint16_t color, unsigned long on_ms, unsigned long period)
+{
+  bool on = ((millis() - wifi_start) % period) < on_ms;
+
+  if (on != wifi_led) {
+    wifi_led = on;
+    if (on) {
+      LedRGBON(color);
+    } else {
+      LedRGBOFF();
+    }
+  }
+}
+
+/* ======================================================================
+Function: WifiStartOTA
+Purpose : Start OTA and its grace window once network is up (STA or AP)
+Input   : -
+Output  : - 
+Comments: -
+====================================================================== */
+void WifiStartOTA(void)
+{
+  sysinfo.boot_wifi = millis();
+
+  // Set OTA parameters
+  ArduinoOTA.setPort(config.ota_port);
+  ArduinoOTA.setHostname(config.host);
+  ArduinoOTA.setPassword(config.ota_auth);
+  ArduinoOTA.begin();
+
+  // just in case your sketch sucks, keep update OTA Available
+  // Trust me, when coding and testing it happens, this could save
+  // the need to connect FTDI to reflash
+  // Teleinfo and web server are already running, only sinks are
+  // held until the grace window ends (see loop)
+  ota_grace = true;
+  ota_start = millis();
+  wifi_led = false;
+}
+
+/* ======================================================================
+Function: WifiStartAP
+Purpose : Switch to Access Point mode when station can't connect
+Input   : -
+Output  : - 
+Comments: -
+====================================================================== */
+void WifiStartAP(void)
+{
+  char ap_ssid[32];
+  DebuglnF("Error!");
+  Debugflush();
+
+  // STA+AP Mode without connected to STA, autoconnect will search
+  // other frequencies while trying to connect, this is causing issue
+  // to AP mode, so disconnect will avoid this
+
+  // Disable auto retry search channel
+  WiFi.disconnect(); 
+
+  // SSID = hostname
+  strcpy(ap_ssid, config.host );
+  DebugF("Switching to AP ");
+  Debugln(ap_ssid);
+  Debugflush();
+
+  // protected network
+  if (*config.ap_psk) {
+    DebugF(" with key '");
+    Debug(config.ap_psk);
+    DebuglnF("'");
+    WiFi.softAP(ap_ssid, config.ap_psk);
+  // Open network
+  } else {
+    DebuglnF(" with no password");
+    WiFi.softAP(ap_ssid);
+  }
+  WiFi.mode(WIFI_AP_STA);
+
+  DebugF("IP address   : "); Debugln(WiFi.softAPIP());
+  DebugF("MAC address  : "); Debugln(WiFi.softAPmacAddress());
+}
+
+/* ======================================================================
+Function: WifiLeaseT1
+Purpose : Get renewal time of current DHCP lease
+Input   : -
+Output  : T1 (s), 0 if station address is not a bound DHCP lease
+Comments: -
+====================================================================== */
+uint32_t WifiLeaseT1(void)
+{
+  uint32_t ip = WiFi.localIP();
+
+  for (struct netif * nif = netif_list; nif; nif = nif->next) {
+    struct dhcp * d = netif_dhcp_data(nif);
+
+    if (d && d->state == DHCP_STATE_BOUND && ip4_addr_get_u32(netif_ip4_addr(nif)) == ip)
+      return d->offered_t1_renew;
+  }
+  return 0;
+}
+
+/* ======================================================================
+Function: WifiLeaseFresh
+Purpose : Check if cached lease can still be used as static IP
+Input   : -
+Output  : true if lease was got during this boot and T1 is not reached
+Comments: there is no clock to know how long we were off, so a lease
+          saved before boot is never reused
+====================================================================== */
+bool WifiLeaseFresh(void)
+{
+  _wifiCache * c = &config.wifi_cache;
+
+  return wifi_bound && c->ip && config.wifi_t1 && millis() - wifi_lease < config.wifi_t1 * 60000UL;
+}
+
+/* ======================================================================
+Function: WifiBegin
+Purpose : Start a station connection attempt
+Input   : true to try the cached BSSID/channel/IP lease first
+Output  : - 
+Comments: static IP from config always wins over the cached lease,
+          with neither of them we go DHCP. Lease is only reused
+          before its T1, a full connect always does DHCP
+====================================================================== */
+void WifiBegin(boolean fast)
+{
+  _wifiCache * c = &config.wifi_cache;
+
+  // No cache, no fast path
+  wifi_fast = fast && c->channel;
+  wifi_reuse = false;
+  wifi_renew = false;
+
+  if (config.wifi_ip) {
+    WiFi.config(IPAddress(config.wifi_ip), IPAddress(config.wifi_gw), 
+                IPAddress(config.wifi_msk), IPAddress(config.wifi_gw));
+  } else if (wifi_fast && WifiLeaseFresh()) {
+    // Reuse last lease, avoid DHCP round trip
+    WiFi.config(IPAddress(c->ip), IPAddress(c->gw), IPAddress(c->msk), IPAddress(c->dns));
+    wifi_reuse = true;
+  } else {
+    // Back to DHCP
+    WiFi.config(0U, 0U, 0U);
+  }
+
+  if (wifi_fast) {
+    Debugf(" on channel %d (cached)", c->channel);
+    WiFi.begin(config.ssid, *config.psk ? config.psk : NULL, c->channel, c->bssid);
+  } else {
+    WiFi.begin(config.ssid, *config.psk ? config.psk : NULL);
+  }
+  Debugflush();
+
+  wifi_start = millis();
+}
+
+/* ======================================================================
+Function: WifiSaveCache
+Purpose : Save connection parameters for next fast reconnect
+Input   : -
+Output  : - 
+Comments: config is only written back if something changed, this
+          avoid wearing flash on each connection. Lease is taken
+          from DHCP only, a reused one keeps its T1 and start
+====================================================================== */
+void WifiSaveCache(void)
+{
+  _wifiCache c;
+  uint32_t t1;
+  uint16_t t1_min = config.wifi_t1;
+
+  memcpy(&c, &config.wifi_cache, sizeof(_wifiCache));
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = WiFi.channel();
+
+  if (!wifi_reuse) {
+    t1 = config.wifi_ip ? 0 : WifiLeaseT1();
+    c.ip  = t1 ? (uint32_t) WiFi.localIP() : 0;
+    c.gw  = WiFi.gatewayIP();
+    c.msk = WiFi.subnetMask();
+    c.dns = WiFi.dnsIP();
+    t1_min = t1 / 60 > 0xFFFF ? 0xFFFF : t1 / 60;
+    wifi_lease = millis();
+    wifi_bound = t1 != 0;
+    Debugf("DHCP lease T1 %us\r\n", t1);
+  }
+
+  if (memcmp(&c, &config.wifi_cache, sizeof(_wifiCache)) || t1_min != config.wifi_t1) {
+    DebuglnF("Wifi cache updated");
+    memcpy(&config.wifi_cache, &c, sizeof(_wifiCache));
+    config.wifi_t1 = t1_min;
+    saveConfig();
+  }
+}
+
 /* ======================================================================
 Function: WifiHandleConn
 Purpose : Handle Wifi connection / reconnection and OTA updates
 Input   : setup true if we're called 1st Time from setup
 Output  : state of the wifi status
-Comments: -
+Comments: never blocks, called with setup=true from setup() to start
+          connection then from each loop() to drive the state machine
 ====================================================================== */
 int WifiHandleConn(boolean setup = false) 
 {
@@ -509,7 +727,7 @@ int WifiHandleConn(boolean setup = false)
   if (setup) {
 
     DebuglnF("========== SDK Saved parameters Start"); 
-    WiFi.printDiag(DEBUG_SERIAL);
+    WiFi.printDiag(log_print);
     DebuglnF("========== SDK Saved parameters End"); 
     Debugflush();
 
@@ -537,111 +755,125 @@ int WifiHandleConn(boolean setup = false)
       }
     }
 
+    // Credentials live in config, SDK must not rewrite its flash
+    // station config on each begin() with or without cached BSSID
+    WiFi.persistent(false);
+
     // correct SSID
     if (*config.ssid) {
-      uint8_t timeout ;
-
       DebugF("Connecting to: "); 
       Debug(config.ssid);
-      Debugflush();
-
-      // Do wa have a PSK ?
-      if (*config.psk) {
-        // protected network
-        Debug(F(" with key '"));
-        Debug(config.psk);
-        Debug(F("'..."));
-        Debugflush();
-        WiFi.begin(config.ssid, config.psk);
-      } else {
-        // Open network
-        Debug(F("unsecure AP"));
-        Debugflush();
-        WiFi.begin(config.ssid);
-      }
+      Debug(*config.psk ? F(" with key") : F(" unsecure AP"));
 
-      timeout = 50; // 50 * 200 ms = 5 sec time out
-      // 200 ms loop
-      while ( ((ret = WiFi.status()) != WL_CONNECTED) && timeout )
-      {
-        // Orange LED
-        LedRGBON(COLOR_ORANGE);
-        delay(50);
-        LedRGBOFF();
-        delay(150);
-        --timeout;
-      }
-    }
+      // Try cached parameters first
+      WifiBegin(true);
 
+      // loop() will now follow the connection
+      wifi_state = WIFI_ST_CONNECTING;
+    } else {
+      // Nothing to connect to, go AP right now
+      WifiStartAP();
+      WifiStartOTA();
+      wifi_state = WIFI_ST_AP;
+    }
 
-    // connected ? disable AP, client mode only
-    if (ret == WL_CONNECTED)
-    {
-      nb_reconnect++;         // increase reconnections count
-      DebuglnF("connected!");
-      WiFi.mode(WIFI_STA);
+    return ret;
+  } // if setup
 
-      DebugF("IP address   : "); Debugln(WiFi.localIP());
-      DebugF("MAC address  : "); Debugln(WiFi.macAddress());
-    
-    // not connected ? start AP
-    } else {
-      char ap_ssid[32];
-      DebuglnF("Error!");
-      Debugflush();
-
-      // STA+AP Mode without connected to STA, autoconnect will search
-      // other frequencies while trying to connect, this is causing issue
-      // to AP mode, so disconnect will avoid this
-
-      // Disable auto retry search channel
-      WiFi.disconnect(); 
-
-      // SSID = hostname
-      strcpy(ap_ssid, config.host );
-      DebugF("Switching to AP ");
-      Debugln(ap_ssid);
-      Debugflush();
-
-      // protected network
-      if (*config.ap_psk) {
-        DebugF(" with key '");
-        Debug(config.ap_psk);
-        DebuglnF("'");
-        WiFi.softAP(ap_ssid, config.ap_psk);
-      // Open network
+  switch (wifi_state) {
+    case WIFI_ST_CONNECTING:
+      if (ret == WL_CONNECTED) {
+        // connected ? disable AP, client mode only
+        sysinfo.wifi_conn_ms = millis() - wifi_start;
+        if (wifi_fast) 
+          sysinfo.wifi_fast_ok++;
+        nb_reconnect++;         // increase reconnections count
+        Debugf("connected in %lums%s!\r\n", sysinfo.wifi_conn_ms, wifi_fast?" (fast)":"");
+        WiFi.mode(WIFI_STA);
+
+        DebugF("IP address   : "); Debugln(WiFi.localIP());
+        DebugF("MAC address  : "); Debugln(WiFi.macAddress());
+
+        WifiSaveCache();
+
+        // First connection since boot ?
+        if (!sysinfo.boot_wifi)
+          WifiStartOTA();
+        wifi_state = WIFI_ST_CONNECTED;
+      } else if (wifi_fast && millis() - wifi_start >= WIFI_FAST_TIMEOUT) {
+        // Cached AP not there anymore, do a full scan
+        DebuglnF("fast connect failed, scanning");
+        sysinfo.wifi_fast_fail++;
+        WiFi.disconnect();
+        WifiBegin(false);
+      } else if (millis() - wifi_start >= WIFI_CONNECT_TIMEOUT) {
+        if (!sysinfo.boot_wifi) {
+          // not connected at boot ? start AP
+          WifiStartAP();
+          wifi_state = WIFI_ST_AP;
+          WifiStartOTA();
+        } else {
+          // Was connected before, let SDK auto reconnect do the job
+          DebuglnF("reconnect failed, waiting SDK");
+          wifi_state = WIFI_ST_LOST;
+        }
       } else {
-        DebuglnF(" with no password");
-        WiFi.softAP(ap_ssid);
+        // Orange LED, 50ms every 200ms
+        WifiBlink(COLOR_ORANGE, 50, 200);
+      }
+    break;
+
+    case WIFI_ST_CONNECTED:
+      if (ret != WL_CONNECTED) {
+        // Try to get back on same AP/channel first
+        DebugF("Wifi connection lost, reconnecting");
+        WiFi.disconnect();
+        WifiBegin(true);
+        wifi_state = WIFI_ST_CONNECTING;
+      } else if (wifi_reuse && !WifiLeaseFresh()) {
+        // Reused lease reached T1, renew it with DHCP, address is
+        // kept until server answers
+        DebuglnF("Cached lease at T1, back to DHCP");
+        WiFi.config(0U, 0U, 0U);
+        wifi_reuse = false;
+        wifi_renew = true;
+      } else if (wifi_renew && WifiLeaseT1()) {
+        wifi_renew = false;
+        WifiSaveCache();
       }
-      WiFi.mode(WIFI_AP_STA);
+    break;
+
+    case WIFI_ST_LOST:
+      if (ret == WL_CONNECTED) {
+        sysinfo.wifi_conn_ms = millis() - wifi_start;
+        nb_reconnect++;
+        DebugF("Wifi reconnected, IP address : "); Debugln(WiFi.localIP());
+        WifiSaveCache();
+        wifi_state = WIFI_ST_CONNECTED;
+      }
+    break;
 
-      DebugF("IP address   : "); Debugln(WiFi.softAPIP());
-      DebugF("MAC address  : "); Debugln(WiFi.softAPmacAddress());
-    }
+    default:
+    break;
+  }
 
-    // Set OTA parameters
-    ArduinoOTA.setPort(config.ota_port);
-    ArduinoOTA.setHostname(config.host);
-    ArduinoOTA.setPassword(config.ota_auth);
-    ArduinoOTA.begin();
-
-    // just in case your sketch sucks, keep update OTA Available
-    // Trust me, when coding and testing it happens, this could save
-    // the need to connect FTDI to reflash
-    // Usefull just after 1st connexion when called from setup() before
-    // launching potentially buggy main()
-    for (uint8_t i=0; i<= 10; i++) {
-      LedRGBON(COLOR_MAGENTA);
-      delay(100);
+  // OTA grace window, magenta LED 100ms every 300ms
+  if (ota_grace) {
+    if (millis() - ota_start >= WIFI_OTA_GRACE) {
+      ota_grace = false;
+      wifi_led = false;
       LedRGBOFF();
-      delay(200);
-      ArduinoOTA.handle();
+      sysinfo.boot_ota = millis();
+      Debugf("Boot done setup=%lums wifi=%lums ota=%lums\r\n", 
+              sysinfo.boot_setup - sysinfo.boot_start, 
+              sysinfo.boot_wifi - sysinfo.boot_start,
+              sysinfo.boot_ota - sysinfo.boot_start);
+    } else {
+      WifiBlink(COLOR_MAGENTA, 100, 300);
     }
+  }
 
-  } // if setup
-
-  return WiFi.status();
+  return ret;
 }
 
 /* ======================================================================
@@ -658,6 +890,7 @@ void setup()
 
   // Set CPU speed to 160MHz
   system_update_cpu_freq(160);
+  sysinfo.boot_start = millis();
 
   //WiFi.disconnect(false);
 
@@ -698,7 +931,7 @@ void setup()
   if (!SPIFFS.begin())
   {
     // Serious problem
-    DebuglnF("SPIFFS Mount failed");
+    Logf(LOG_ERR, "SPIFFS Mount failed\r\n");
   } else {
    
     DebuglnF("SPIFFS Mount succesfull");
@@ -725,16 +958,37 @@ void setup()
     // Indicate the error in global flags
     config.config |= CFG_BAD_CRC;
 
-    DebuglnF("Reset to default");
+    Logf(LOG_WARN, "Bad config CRC, reset to default\r\n");
   }
+  logInit();
 
   // We'll drive our onboard LED
   // old TXD1, not used anymore, has been swapped
   pinMode(RED_LED_PIN, OUTPUT); 
   LedRedOFF();
 
-  // start Wifi connect or soft AP
-  WifiHandleConn(true);
+  // Teleinfo first, so no frame is lost while Wifi comes up
+  // Teleinfo is connected to RXD2 (GPIO13) to 
+  // avoid conflict when flashing, this is why
+  // we swap RXD1/TXD1 to RXD2/TXD2 
+  // Note that TXD2 is not used teleinfo is receive only
+  #ifdef DEBUG_SERIAL1
+    Serial.begin(1200, SERIAL_7E1);
+  //  Serial.swap();
+  #endif
+
+  // Init teleinfo
+  need_reinit=false;
+  tinfoLabelsInit();
+  valuesInit();
+  tinfo.init();
+
+  // Attach the callback we need
+  // set all as an example
+  tinfo.attachADPS(ADPSCallback);
+  tinfo.attachData(DataCallback);
+  tinfo.attachNewFrame(NewFrame);
+  tinfo.attachUpdatedFrame(UpdatedFrame);
 
   // OTA callbacks
   ArduinoOTA.onStart([]() { 
@@ -772,15 +1026,28 @@ void setup()
   // Update sysinfo variable and print them
   UpdateSysinfo(true, true);
 
-  server.on("/", handleRoot);
-  server.on("/config_form.json", handleFormConfig);
-  server.on("/json", sendJSON);
-  server.on("/tinfo.json", tinfoJSONTable);
-  server.on("/emoncms.json", emoncmsJSONTable);
-  server.on("/system.json", sysJSONTable);
-  server.on("/config.json", confJSONTable);
-  server.on("/spiffs.json", spiffsJSONTable);
-  server.on("/wifiscan.json", wifiScanJSON);
+  // Routes with heap usage accounting (see /heap.json)
+  heapOn("/", handleRoot);
+  heapOn("/config_form.json", handleFormConfig);
+  heapOn("/json", sendJSON);
+  heapOn("/tinfo.json", tinfoJSONTable);
+  heapOn("/emoncms.json", emoncmsJSONTable);
+  heapOn("/system.json", sysJSONTable);
+  heapOn("/config.json", confJSONTable);
+  heapOn("/spiffs.json", spiffsJSONTable);
+  heapOn("/wifiscan.json", wifiScanJSON);
+  heapOn("/heap.json", heapJSONTable);
+  heapOn("/metrics", sendMetrics);
+  heapOn("/stats.json", statsJSONTable);
+  heapOn("/rules.json", rulesJSONTable);
+  heapOn("/shed.json", shedJSONTable);
+  heapOn("/sinks.json", sinksJSONTable);
+  heapOn("/tls.json", tlsJSONTable);
+  heapOn("/gzip.json", gzipJSONTable);
+  heapOn("/labels.json", labelsJSONTable);
+  heapOn("/modbus.json", modbusJSONTable);
+  heapOn("/trace.json", traceJSONTable);
+  heapOn("/log", logSend);
   server.on("/factory_reset", handleFactoryReset);
   server.on("/reset", handleReset);
 
@@ -814,7 +1081,7 @@ void setup()
 
         //start with max available size
         if(!Update.begin(maxSketchSpace)) 
-          Update.printError(Serial1);
+          Update.printError(log_print);
 
       } else if(upload.status == UPLOAD_FILE_WRITE) {
         if (ota_blink) {
@@ -825,14 +1092,14 @@ void setup()
         ota_blink = !ota_blink;
         Debug(".");
         if(Update.write(upload.buf, upload.currentSize) != upload.currentSize) 
-          Update.printError(Serial1);
+          Update.printError(log_print);
 
       } else if(upload.status == UPLOAD_FILE_END) {
         //true to set the size to the current progress
         if(Update.end(true)) 
           Debugf("Update Success: %u\nRebooting...\n", upload.totalSize);
         else 
-          Update.printError(Serial1);
+          Update.printError(log_print);
 
         LedRGBOFF();
 
@@ -846,39 +1113,31 @@ void setup()
   );
 
   // All other not known 
-  server.onNotFound(handleNotFound);
+  server.onNotFound([]() {
+    heapBegin("notfound");
+    handleNotFound();
+    heapEnd();
+  });
   
   // serves all SPIFFS Web file with 24hr max-age control
   // to avoid multiple requests to ESP
   server.serveStatic("/font", SPIFFS, "/font","max-age=86400"); 
   server.serveStatic("/js",   SPIFFS, "/js"  ,"max-age=86400"); 
   server.serveStatic("/css",  SPIFFS, "/css" ,"max-age=86400"); 
+
+  // Request headers needed by handlers (compression, binary format)
+  static const char * headers[] = { "Accept-Encoding", "Accept" };
+  server.collectHeaders(headers, sizeof(headers) / sizeof(headers[0]));
   server.begin();
+  modbusInit();
 
   // Display configuration
   showConfig();
 
   Debugln(F("HTTP server started"));
 
-  // Teleinfo is connected to RXD2 (GPIO13) to 
-  // avoid conflict when flashing, this is why
-  // we swap RXD1/TXD1 to RXD2/TXD2 
-  // Note that TXD2 is not used teleinfo is receive only
-  #ifdef DEBUG_SERIAL1
-    Serial.begin(1200, SERIAL_7E1);
-  //  Serial.swap();
-  #endif
-
-  // Init teleinfo
-  need_reinit=false;
-  tinfo.init();
-
-  // Attach the callback we need
-  // set all as an example
-  tinfo.attachADPS(ADPSCallback);
-  tinfo.attachData(DataCallback);
-  tinfo.attachNewFrame(NewFrame);
-  tinfo.attachUpdatedFrame(UpdatedFrame);
+  // start Wifi connect or soft AP, loop() will follow the connection
+  WifiHandleConn(true);
 
   //webSocket.begin();
   //webSocket.onEvent(webSocketEvent);
@@ -889,22 +1148,13 @@ void setup()
   // Update sysinfo every second
   Every_1_Sec.attach(1, Task_1_Sec);
   
-  // Emoncms Update if needed
-  if (config.emoncms.freq) 
-    Tick_emoncms.attach(config.emoncms.freq, Task_emoncms);
-
-  // Jeedom Update if needed
-  if (config.jeedom.freq) 
-    Tick_jeedom.attach(config.jeedom.freq, Task_jeedom);
-
-  // HTTP Request Update if needed
-  if (config.httpReq.freq) 
-    Tick_httpRequest.attach(config.httpReq.freq, Task_httpRequest);
+  // Emoncms, Jeedom, HTTP request and other uploads
+  sinksInit();
 
 //To simulate Teleinfo on not connected module
 #ifdef SIMU
     String name1 = "ADCO";
-    String value1 = "01234546789012";
+    String value1 = "012345467890";
     
     char * s1 = (char *)name1.c_str();
     char * v1 = (char *)value1.c_str();
@@ -912,16 +1162,23 @@ void setup()
     tinfo.addCustomValue(s1, v1, &flags); //ADCO arbitrary value
     tinfo.addCustomValue(s2, v2, &flags); //counter value
     flags = TINFO_FLAGS_NONE;
-    tinfo.valuesDump();
 #endif
 
 #ifdef SENSOR
-  pinMode(SensorPin, INPUT_PULLUP);
-  DebuglnF("Switch sensor initialized");
-  reading = digitalRead(SensorPin);
-  Debugf("Initial State: %d\n", reading);
+  // Les contacts secs sont connectes entre GND et les GPIO configures
+  // (D5 / GPIO-14 par defaut)
+  inputsInit();
+  DebuglnF("Switch sensors initialized");
 #endif
-
+  // S0 pulse counters, after switches so GPIO conflicts are seen
+  pulsesInit();
+  statsInit();
+  shedInit();
+  // Rules last, GPIO actions can't take pins of inputs, counters or relays
+  rulesInit();
+  rulesCheck();
+
+  sysinfo.boot_setup = millis();
 }
 
 /* ======================================================================
@@ -936,15 +1193,29 @@ void loop()
   char c;
 
   // Do all related network stuff
+  TRACE_BEGIN(TRACE_LOOP, "network");
+  WifiHandleConn();
+  traceWifi();
+  wifiScanHandle();
+#ifdef SENSOR
+  inputsHandle();
+#endif
   server.handleClient();
+  modbusHandle();
   ArduinoOTA.handle();
+  logHandle();
+  TRACE_END(TRACE_LOOP, "network");
 
   //webSocket.loop();
 
   // Only once task per loop, let system do its own task
   if (task_1_sec) { 
-    UpdateSysinfo(false, false); 
     task_1_sec = false; 
+    TRACE_BEGIN(TRACE_LOOP, "tick");
+    heapHandle();
+    pulsesHandle();
+    sinksTick();
+    TRACE_END(TRACE_LOOP, "tick");
     
 //To simulate Teleinfo on not connected module
 #ifdef SIMU
@@ -954,72 +1225,56 @@ void loop()
       // each 10 second, try to change HCHC value
       //Increase v2 value
       sprintf(v2, "%09d", (loop_cpt) );
-      // and update ListValues
+      // and update value store
       flags = TINFO_FLAGS_UPDATED;
       tinfo.addCustomValue(s2, v2, &flags);   
     }
 #endif
 
-  } else if (task_emoncms) { 
-    emoncmsPost(); 
-    task_emoncms=false; 
-  } else if (task_jeedom) { 
-    jeedomPost();  
-    task_jeedom=false;
-  } else if (task_httpRequest) { 
-    httpRequest();
-    UPD_I();  
-    task_httpRequest=false;
-  } else if (task_updsw) { 
-    UPD_switch();  
-    task_updsw=false;
-  } else if (task_updadps) { 
-    UPD_ADPS();  
-    task_updadps=false;
+  } else if (wifi_state != WIFI_ST_CONNECTED || ota_grace) {
+    // No sink while Wifi is not up or during OTA grace window
+    // tasks stay pending until then
+  } else if (sinksDue()) { 
+    // heap accounting is done per sink type
+    sinksHandle();
+#ifdef SENSOR
+  } else if (inputs_notify) { 
+    heapBegin("updSwitch");
+    UPD_switch(inputsNextNotify());  
+    heapEnd();
+#endif
+  } else if (rules_notify) { 
+    heapBegin("rules");
+    rulesHandle();  
+    heapEnd();
   }
   
   
-#ifdef SENSOR
- // read the state of the switch into a local variable:
-  reading = digitalRead(SensorPin);
-
-  // check to see if you just pressed the button
-  // (i.e. the input went from LOW to HIGH), and you've waited long enough
-  // since the last press to ignore any noise:
-
-  // If the switch changed, due to noise or pressing:
-  if (reading != lastSwitchState) {
-    // reset the debouncing timer
-    lastChangeTime = millis();
-    lastSwitchState = reading;
-  }
-
-  if ((millis() - lastChangeTime) > tempo) {
-    // whatever the reading is at, it's been there for longer than the tempo
-    // delay, so take it as the actual current state:
-
-    // if the switch state has changed:
-    if (reading != SwitchState) {
-      Debugf("Switch changed from  %d to %d\n", SwitchState, reading);
-      SwitchState = reading;
-      //Notify HTTP server that switch has changed, on next loop
-      task_updsw=true;
-    }
-  }
-#endif
 
   if (need_reinit) {
-    //Some polluted entries have been detected in Teleinfo ListValues
+    //Some polluted entries have been detected in Teleinfo values
 		need_reinit=false;
     nb_reinit++;    //account of reinit operations, for system infos
-		tinfo.init();		//Clear ListValues, buffer, and wait for next STX
+		valuesClear();
+		tinfo.init();		//Clear buffer, and wait for next STX
   } else {
-	  // Handle teleinfo serial
-	  if ( Serial.available() ) {
+	  // Handle teleinfo serial, all waiting bytes so a loop pass that
+	  // was long (sink request) doesn't delay parsing more
+	  int avail = Serial.available();
+	  bool burst = avail > 0;
+	  if (burst)
+	    TRACE_BEGIN(TRACE_SERIAL, "serial");
+	  while ( avail > 0 && !need_reinit ) {
 	    // Read Serial and process to tinfo
 	    c = Serial.read();
+	    // Group end arrived at least one char time per byte behind it
+	    if (c == SHED_GROUP_END)
+	      shed_rx_us = micros() - (avail - 1) * SHED_CHAR_US;
 	    tinfo.process(c);
+	    avail--;
   }
+	  if (burst)
+	    TRACE_END(TRACE_SERIAL, "serial");
 
   //delay(10);
 }
@@ -0,0 +1,229 @@
+// **********************************************************************************
+// ESP8266 Teleinfo CBOR encoder
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "cbor.h"
+
+/* ======================================================================
+Function: cborAsked
+Purpose : check if client wants CBOR
+Input   : -
+Output  : true for ?fmt=cbor or Accept: application/cbor
+Comments: -
+====================================================================== */
+bool cborAsked(void)
+{
+  return server.arg("fmt") == "cbor" || server.header("Accept").indexOf(CBOR_CONTENT_TYPE) >= 0;
+}
+
+/* ======================================================================
+Function: cborHead
+Purpose : write item head, major type and argument
+Input   : major type
+          argument (value, length or count)
+Output  : -
+Comments: shortest form is used as CBOR asks
+====================================================================== */
+void cborHead(uint8_t major, uint64_t value)
+{
+  uint8_t buf[9];
+  uint8_t n;
+
+  if (value < 24) {
+    buf[0] = major | value;
+    n = 0;
+  } else if (value <= 0xFF) {
+    buf[0] = major | 24;
+    n = 1;
+  } else if (value <= 0xFFFF) {
+    buf[0] = major | 25;
+    n = 2;
+  } else if (value <= 0xFFFFFFFFULL) {
+    buf[0] = major | 26;
+    n = 4;
+  } else {
+    buf[0] = major | 27;
+    n = 8;
+  }
+
+  // big endian
+  for (uint8_t i = 0; i < n; i++)
+    buf[n - i] = value >> (8 * i);
+  respWrite((const char *) buf, n + 1);
+}
+
+/* ======================================================================
+Function: cborStart / cborEnd
+Purpose : open an array or map of unknown size, and close it
+Input   : major type (array or map)
+Output  : -
+Comments: responses are streamed, so item count isn't known first
+====================================================================== */
+void cborStart(uint8_t major)
+{
+  uint8_t b = major | CBOR_INDEF;
+  respWrite((const char *) &b, 1);
+}
+
+void cborEnd(void)
+{
+  uint8_t b = CBOR_BREAK;
+  respWrite((const char *) &b, 1);
+}
+
+/* ======================================================================
+Function: cborText
+Purpose : write a text string
+Input   : string
+Output  : -
+Comments: -
+====================================================================== */
+void cborText(const char * str)
+{
+  size_t len = strlen(str);
+
+  cborHead(CBOR_TEXT, len);
+  respWrite(str, len);
+}
+
+/* ======================================================================
+Function: cborValue
+Purpose : write a value as native number when it is one
+Input   : value
+Output  : -
+Comments: same rules as JSON, 00150 => 150, 12.5 is a float, other
+          values are text
+====================================================================== */
+void cborValue(const char * value)
+{
+  const char * p = value + (*value == '-');
+  uint64_t n = 0;
+  uint8_t digits = 0;
+  bool dot = false;
+
+  for (const char * q = p; *q; q++) {
+    if (*q >= '0' && *q <= '9')
+      digits++;
+    else if (*q == '.' && !dot && q[1])
+      dot = true;
+    else {
+      digits = 0;
+      break;
+    }
+  }
+
+  // not a number, or too many digits for 64 bits
+  if (!digits || digits > 19) {
+    cborText(value);
+    return;
+  }
+
+  if (dot) {
+    double d = atof(value);
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    uint8_t buf[9] = { CBOR_FLOAT };
+    for (uint8_t i = 0; i < 8; i++)
+      buf[8 - i] = bits >> (8 * i);
+    respWrite((const char *) buf, sizeof(buf));
+    return;
+  }
+
+  while (*p)
+    n = n * 10 + (*p++ - '0');
+
+  if (*value == '-' && n)
+    cborHead(CBOR_NINT, n - 1);
+  else
+    cborHead(CBOR_UINT, n);
+}
+
+/* ======================================================================
+Function: cborJSON
+Purpose : CBOR variant of /json
+Input   : ?labels= projection list, NULL for all values
+Output  : -
+Comments: map of label => value, same content as JSON one
+====================================================================== */
+void cborJSON(const char * labels)
+{
+  char name[16], value[16];
+
+  respBegin(200, CBOR_CONTENT_TYPE);
+  cborStart(CBOR_MAP);
+  cborText("_UPTIME");
+  cborHead(CBOR_UINT, seconds);
+
+  // Projection, only asked labels in asked order
+  if (labels) {
+    uint8_t kind;
+    int8_t id;
+
+    while ((kind = labelsNext(labels, name, value, id)) != LABEL_END) {
+      if (kind == LABEL_VIRTUAL) {
+        cborText(name);
+        cborValue(value);
+      } else {
+        cborHead(CBOR_UINT, id);
+        valueCBOR(id);
+      }
+    }
+  }
+
+  for (int8_t id = valueNext(-1); !labels && id >= 0; id = valueNext(id)) {
+    cborHead(CBOR_UINT, id);
+    valueCBOR(id);
+  }
+
+  // Virtual labels (pulse counters, power)
+  for (uint8_t n = 0; !labels && virtualLabel(n, name, value); n++) {
+    cborText(name);
+    cborValue(value);
+  }
+
+  cborEnd();
+  respEnd();
+}
+
+/* ======================================================================
+Function: cborTinfo
+Purpose : CBOR variant of /tinfo.json
+Input   : -
+Output  : -
+Comments: array of [label ID, value, checksum, flags], value stays text
+          as in JSON, checksum is its char code
+====================================================================== */
+void cborTinfo(void)
+{
+  respBegin(200, CBOR_CONTENT_TYPE);
+  cborStart(CBOR_ARRAY);
+
+  for (int8_t id = valueNext(-1); id >= 0; id = valueNext(id)) {
+    cborHead(CBOR_ARRAY, 4);
+    cborHead(CBOR_UINT, id);
+    cborText(valueText(id));
+    cborHead(CBOR_UINT, value_slots[id].checksum);
+    cborHead(CBOR_UINT, value_slots[id].flags);
+  }
+
+  cborEnd();
+  respEnd();
+}
@@ -0,0 +1,59 @@
+// **********************************************************************************
+// ESP8266 Teleinfo CBOR encoder Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef CBOR_H
+#define CBOR_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Binary variant of data endpoints (RFC 8949), asked with ?fmt=cbor or
+// Accept: application/cbor. Teleinfo labels are sent as their numeric
+// ID (index in list given by /labels.json), other labels as text
+// cbor_check.py decodes them from a running board and checks they match
+// the JSON ones: python3 cbor_check.py <wifinfo ip>
+#define CBOR_CONTENT_TYPE "application/cbor"
+
+// Major types
+#define CBOR_UINT   0x00
+#define CBOR_NINT   0x20
+#define CBOR_TEXT   0x60
+#define CBOR_ARRAY  0x80
+#define CBOR_MAP    0xA0
+#define CBOR_SIMPLE 0xE0
+#define CBOR_NULL   22      // simple value
+#define CBOR_FLOAT  0xFB    // float64
+#define CBOR_INDEF  0x1F    // indefinite length, ends with CBOR_BREAK
+#define CBOR_BREAK  0xFF
+
+// declared exported function from cbor.cpp
+// ===================================================
+bool cborAsked(void);
+void cborHead(uint8_t major, uint64_t value);
+void cborStart(uint8_t major);
+void cborEnd(void);
+void cborText(const char * str);
+void cborValue(const char * value);
+void cborJSON(const char * labels);
+void cborTinfo(void);
+
+#endif
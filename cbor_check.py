@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+# **********************************************************************************
+# ESP8266 Teleinfo CBOR round-trip check
+# **********************************************************************************
+# Creative Commons Attrib Share-Alike License
+# You are free to use/extend this library but please abide with the CC-BY-SA license:
+# Attribution-NonCommercial-ShareAlike 4.0 International License
+# http://creativecommons.org/licenses/by-nc-sa/4.0/
+#
+# Written by Charles-Henri Hallard (http://hallard.me)
+#
+# All text above must be included in any redistribution.
+#
+# **********************************************************************************
+#
+# Decodes the CBOR variant of each data endpoint of a running Wifinfo and
+# checks it holds the same thing as the JSON one:
+#
+#   /json                 map label => value, teleinfo labels as numeric ID
+#   /json?labels=...      same, projection keeps asked order
+#   /tinfo.json           [label ID, value, checksum, flags] per label
+#
+# Label IDs are read from /labels.json. A frame may arrive between two
+# requests, so JSON is fetched before and after CBOR and the check is
+# retried until both JSON are the same.
+#
+# Usage : python3 cbor_check.py <wifinfo ip or name>
+# Needs only python 3 standard library, exit code is 0 if all match
+
+import json
+import struct
+import sys
+import urllib.request
+
+RETRIES = 5
+UPTIME_SLACK = 5    # s, _UPTIME may tick between requests
+
+
+def fetch(host, path):
+    with urllib.request.urlopen('http://%s%s' % (host, path), timeout=10) as r:
+        return r.read()
+
+
+def fetch_json(host, path):
+    return json.loads(fetch(host, path).decode('utf-8'), object_pairs_hook=list)
+
+
+class Decoder:
+    """Minimal CBOR decoder, only what cbor.cpp writes"""
+
+    BREAK = object()
+
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise ValueError('truncated at %d' % self.pos)
+        b = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return b
+
+    def item(self):
+        ib = self.take(1)[0]
+        major, info = ib >> 5, ib & 0x1F
+
+        if ib == 0xFF:
+            return self.BREAK
+        if major == 7:
+            if info == 20:
+                return False
+            if info == 21:
+                return True
+            if info == 22:
+                return None
+            if info == 27:
+                return struct.unpack('>d', self.take(8))[0]
+            raise ValueError('simple/float %#x not written by cbor.cpp' % ib)
+
+        if info == 31:
+            if major == 4:
+                return self.until_break(lambda: self.item())
+            if major == 5:
+                return self.until_break(lambda: (self.key_of(self.item()), self.item()))
+            raise ValueError('indefinite major %d not written by cbor.cpp' % major)
+
+        arg = self.argument(info)
+        if major == 0:
+            return arg
+        if major == 1:
+            return -1 - arg
+        if major == 3:
+            return self.take(arg).decode('utf-8')
+        if major == 4:
+            return [self.item() for _ in range(arg)]
+        if major == 5:
+            return [(self.key_of(self.item()), self.item()) for _ in range(arg)]
+        raise ValueError('major %d not written by cbor.cpp' % major)
+
+    def argument(self, info):
+        if info < 24:
+            return info
+        size = {24: 1, 25: 2, 26: 4, 27: 8}.get(info)
+        if not size:
+            raise ValueError('bad argument %d' % info)
+        value = int.from_bytes(self.take(size), 'big')
+        # CBOR asks for shortest form, cborHead() must give it
+        if value < (24 if size == 1 else 1 << (4 * size)):
+            raise ValueError('argument %d not in shortest form' % value)
+        return value
+
+    def until_break(self, one):
+        items = []
+        while self.data[self.pos] != 0xFF:
+            items.append(one())
+        self.pos += 1
+        return items
+
+    def key_of(self, key):
+        if key is self.BREAK:
+            raise ValueError('unexpected break')
+        return key
+
+    def decode(self):
+        value = self.item()
+        if self.pos != len(self.data):
+            raise ValueError('%d bytes after end' % (len(self.data) - self.pos))
+        return value
+
+
+def cbor(host, path):
+    sep = '&' if '?' in path else '?'
+    return Decoder(fetch(host, path + sep + 'fmt=cbor')).decode()
+
+
+def same_json(a, b):
+    strip = lambda d: [(k, v) for k, v in d if k != '_UPTIME']
+    return strip(a) == strip(b)
+
+
+def check_json(host, path, names):
+    """/json: same keys in same order, same values and types"""
+    for _ in range(RETRIES):
+        before = fetch_json(host, path)
+        got = cbor(host, path)
+        after = fetch_json(host, path)
+        if same_json(before, after):
+            break
+    else:
+        return 'values kept changing, try again'
+
+    keys = [names[k] if isinstance(k, int) else k for k, _ in got]
+    if keys != [k for k, _ in before]:
+        return 'keys differ\n  json %s\n  cbor %s' % ([k for k, _ in before], keys)
+
+    for (key, want), (_, value) in zip(before, got):
+        if key == '_UPTIME':
+            if not isinstance(value, int) or abs(value - want) > UPTIME_SLACK:
+                return '_UPTIME %r, json %r' % (value, want)
+        elif type(value) is not type(want) or value != want:
+            return '%s is %r in cbor, %r in json' % (key, value, want)
+    return None
+
+
+def check_tinfo(host, names):
+    """/tinfo.json: same labels, text values, checksum and flags"""
+    for _ in range(RETRIES):
+        before = fetch_json(host, '/tinfo.json')
+        got = cbor(host, '/tinfo.json')
+        after = fetch_json(host, '/tinfo.json')
+        if before == after:
+            break
+    else:
+        return 'values kept changing, try again'
+
+    want = [(dict(r)['na'], dict(r)['va'], ord(dict(r)['ck']), dict(r)['fl']) for r in before]
+    have = [(names[r[0]], r[1], r[2], r[3]) for r in got]
+    if have != want:
+        return 'differ\n  json %s\n  cbor %s' % (want, have)
+    return None
+
+
+def main():
+    if len(sys.argv) != 2:
+        print('usage: cbor_check.py <wifinfo ip or name>')
+        return 2
+    host = sys.argv[1]
+
+    names = {v: k for k, v in fetch_json(host, '/labels.json')}
+    first = [k for k, _ in fetch_json(host, '/json') if k != '_UPTIME']
+    projection = '/json?labels=' + ','.join(first[:3][::-1] + ['NOPE'])
+
+    checks = [
+        ('/json', lambda: check_json(host, '/json', names)),
+        (projection, lambda: check_json(host, projection, names)),
+        ('/tinfo.json', lambda: check_tinfo(host, names)),
+    ]
+
+    failed = 0
+    for path, check in checks:
+        error = check()
+        print('%-40s %s' % (path, 'FAIL ' + error if error else 'ok'))
+        failed += error is not None
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
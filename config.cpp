@@ -181,11 +181,45 @@ void showConfig()
   DebugF("ap_psk   :"); Debugln(config.ap_psk); 
   DebugF("OTA auth :"); Debugln(config.ota_auth); 
   DebugF("OTA port :"); Debugln(config.ota_port); 
-  DebugF("Dbg/file :"); Debugln(config.dbgfile); 
+  DebugF("Dbg/file :"); Debugln(config.dbgfile);
+  DebugF("Log      :"); Debug(config.log_level ? config.log_level : LOG_DEFAULT_LEVEL);
+  if (config.syslog_ip) {
+    DebugF(" syslog "); Debug(IPAddress(config.syslog_ip));
+  }
+  Debugln();
+  DebugF("IP       :");
+  if (config.wifi_ip) {
+    Debug(IPAddress(config.wifi_ip));
+    DebugF(" gw "); Debug(IPAddress(config.wifi_gw));
+    DebugF(" mask "); Debugln(IPAddress(config.wifi_msk));
+  } else {
+    DebuglnF("DHCP");
+  }
+  DebugF("Scan TTL :"); Debugln(config.scan_ttl);
+  DebugF("Power tau:"); Debugln(config.power_tau);
+  Debugf("Stats    :%s windows %u,%u,%u s%s\r\n", config.stats.labels, config.stats.window[0],
+         config.stats.window[1], config.stats.window[2], config.stats.payload ? " in uploads" : "");
+  DebugF("Shedding :");
+  for (uint8_t i = 0; i < CFG_SHED_MAX; i++) {
+    if (config.shed.pin[i])
+      Debugf(" GPIO%d", config.shed.pin[i]);
+  }
+  Debugf(" trip %d%% restore %d%% min off %d s\r\n", config.shed.trip, config.shed.restore, config.shed.min_off);
+  DebugF("Cache    :");
+  if (config.wifi_cache.channel) {
+    Debugf("ch %d bssid %02X:%02X:%02X:%02X:%02X:%02X ip ", config.wifi_cache.channel,
+            config.wifi_cache.bssid[0], config.wifi_cache.bssid[1], config.wifi_cache.bssid[2],
+            config.wifi_cache.bssid[3], config.wifi_cache.bssid[4], config.wifi_cache.bssid[5]);
+    Debug(IPAddress(config.wifi_cache.ip));
+    Debugf(" T1 %u min\r\n", config.wifi_t1);
+  } else {
+    DebuglnF("none");
+  }
   DebugF("Config   :"); 
   if (config.config & CFG_RGB_LED) DebugF(" RGB"); 
   if (config.config & CFG_DEBUG)   DebugF(" DEBUG"); 
   if (config.config & CFG_LCD)     DebugF(" LCD"); 
+  if (config.config & CFG_MODBUS)  DebugF(" MODBUS"); 
  
 
   DebuglnF("\r\n===== Emoncms"); 
@@ -210,6 +244,18 @@ void showConfig()
   DebugF("path     :"); Debugln(config.httpReq.path); 
   DebugF("freq     :"); Debugln(config.httpReq.freq); 
   DebugF("sw idx   :"); Debugln(config.httpReq.swidx);
+  DebugF("inputs   :");
+  for (uint8_t i = 0; i < CFG_INPUT_MAX; i++) {
+    if (config.inputs.pin[i])
+      Debugf(" GPIO%d/idx %d", config.inputs.pin[i], config.inputs.idx[i]);
+  }
+  Debugf(" debounce %d ms\r\n", config.inputs.debounce);
+  DebugF("pulses   :");
+  for (uint8_t i = 0; i < CFG_PULSE_MAX; i++) {
+    if (config.pulses.pin[i])
+      Debugf(" GPIO%d", config.pulses.pin[i]);
+  }
+  Debugln();
   DebugF("I idx   :"); Debugln(config.httpReq.iidx);    //Intensité
   DebugF("sw idx   :"); Debugln(config.httpReq.adpsidx);//ADPS 
 }
@@ -35,6 +35,8 @@
 #define CFG_EMON_DEFAULT_PORT 80
 #define CFG_EMON_DEFAULT_HOST "emoncms.org"
 #define CFG_EMON_DEFAULT_URL  "/input/post.json"
+#define CFG_EMON_BULK_MAX     60    // samples per bulk request
+#define CFG_EMON_DEFAULT_BULKLAT 300 // max bulk latency (s)
 
 #define CFG_JDOM_HOST_SIZE    32
 #define CFG_JDOM_APIKEY_SIZE  48
@@ -60,6 +62,7 @@
 #define CFG_LCD				  0x0001	// Enable display
 #define CFG_DEBUG			  0x0002	// Enable serial debug
 #define CFG_RGB_LED     0x0004  // Enable RGB LED
+#define CFG_MODBUS      0x0008  // Enable Modbus TCP server
 #define CFG_BAD_CRC     0x8000  // Bad CRC when reading configuration
 
 // Web Interface Configuration Form field names
@@ -77,6 +80,9 @@
 #define CFG_FORM_EMON_KEY   FPSTR("emon_apikey")
 #define CFG_FORM_EMON_NODE  FPSTR("emon_node")
 #define CFG_FORM_EMON_FREQ  FPSTR("emon_freq")
+#define CFG_FORM_EMON_BULK  FPSTR("emon_bulk")
+#define CFG_FORM_EMON_BULKLAT FPSTR("emon_bulklat")
+#define CFG_FORM_EMON_TLS   FPSTR("emon_tls")
 
 #define CFG_FORM_JDOM_HOST  FPSTR("jdom_host")
 #define CFG_FORM_JDOM_PORT  FPSTR("jdom_port")
@@ -84,6 +90,7 @@
 #define CFG_FORM_JDOM_KEY   FPSTR("jdom_apikey")
 #define CFG_FORM_JDOM_ADCO  FPSTR("jdom_adco")
 #define CFG_FORM_JDOM_FREQ  FPSTR("jdom_freq")
+#define CFG_FORM_JDOM_TLS   FPSTR("jdom_tls")
 
 #define CFG_FORM_HTTPREQ_HOST  FPSTR("httpreq_host")
 #define CFG_FORM_HTTPREQ_PORT  FPSTR("httpreq_port")
@@ -92,13 +99,118 @@
 #define CFG_FORM_HTTPREQ_SWIDX FPSTR("httpreq_swidx")
 #define CFG_FORM_HTTPREQ_IIDX FPSTR("httpreq_iidx")
 #define CFG_FORM_HTTPREQ_ADPSIDX FPSTR("httpreq_adps")
-#define CFG_FORM_IP  FPSTR("wifi_ip");
-#define CFG_FORM_GW  FPSTR("wifi_gw");
-#define CFG_FORM_MSK FPSTR("wifi_msk");
+#define CFG_FORM_HTTPREQ_TLS   FPSTR("httpreq_tls")
+#define CFG_FORM_IP  FPSTR("wifi_ip")
+#define CFG_FORM_GW  FPSTR("wifi_gw")
+#define CFG_FORM_MSK FPSTR("wifi_msk")
+#define CFG_FORM_SCAN_TTL FPSTR("scan_ttl")
+#define CFG_FORM_IN_PINS  FPSTR("in_pins")
+#define CFG_FORM_IN_IDX   FPSTR("in_idx")
+#define CFG_FORM_IN_DEB   FPSTR("in_deb")
+#define CFG_FORM_PULSE_PINS FPSTR("pulse_pins")
+#define CFG_FORM_POWER_TAU  FPSTR("power_tau")
+#define CFG_FORM_STATS_LABELS  FPSTR("stats_labels")
+#define CFG_FORM_STATS_WINDOWS FPSTR("stats_windows")
+#define CFG_FORM_STATS_PAYLOAD FPSTR("stats_payload")
+#define CFG_FORM_SHED_PINS    FPSTR("shed_pins")
+#define CFG_FORM_SHED_TRIP    FPSTR("shed_trip")
+#define CFG_FORM_SHED_RESTORE FPSTR("shed_restore")
+#define CFG_FORM_SHED_MINOFF  FPSTR("shed_minoff")
+#define CFG_FORM_RULES        FPSTR("rules")
+#define CFG_FORM_SINKS        FPSTR("sinks")
+#define CFG_FORM_TLS_FP       FPSTR("tls_fp")
+#define CFG_FORM_LOG_LEVEL    FPSTR("log_level")
+#define CFG_FORM_SYSLOG       FPSTR("syslog")
+#define CFG_FORM_MODBUS       FPSTR("modbus")
+
+#define CFG_TLS_FP_SIZE       20    // SHA1 of server certificate
+
+// TLS of a sink
+#define TLS_OFF               0     // plain HTTP
+#define TLS_VERIFY            1     // server checked with fingerprint or CA
+#define TLS_INSECURE          2     // server not checked, user's choice
+
+// Wifi scan results cache
+#define CFG_SCAN_DEFAULT_TTL  60  // seconds
+#define CFG_SCAN_MAX          20  // max networks kept
+
+// Dry contact inputs
+#define CFG_INPUT_MAX         4   // max inputs
+#define CFG_INPUT_DEFAULT_PIN 14  // GPIO used when none configured
+#define CFG_INPUT_DEFAULT_DEB 200 // default debounce time (ms)
+
+// S0 pulse counters
+#define CFG_PULSE_MAX         2   // max counters
+
+// Active power estimation smoothing
+#define CFG_POWER_DEFAULT_TAU 10  // seconds
+
+// Rolling window statistics
+#define CFG_STATS_LABELS      3   // max labels followed
+#define CFG_STATS_WINDOWS     3   // max windows per label
+#define CFG_STATS_LABELS_SIZE 23
+#define CFG_STATS_DEFAULT_LABELS  "PAPP,IINST"
+
+// Load shedding relays
+#define CFG_SHED_MAX            3   // max relays
+#define CFG_SHED_DEFAULT_TRIP   90  // shed above this % of ISOUSC
+#define CFG_SHED_DEFAULT_RESTORE 75 // restore below this % of ISOUSC
+#define CFG_SHED_DEFAULT_MINOFF 60  // min time a load stays off (s)
 
 #pragma pack(push)  // push current alignment to stack
 #pragma pack(1)     // set alignment to 1 byte boundary
 
+// Last good Wifi connection, used for fast reconnect
+// 23 Bytes
+typedef struct
+{
+  uint8_t  bssid[6];                    // AP MAC address
+  uint8_t  channel;                     // AP channel (0 if no cache)
+  uint32_t ip;                          // Last IP lease
+  uint32_t gw;                          // Last gateway
+  uint32_t msk;                         // Last netmask
+  uint32_t dns;                         // Last DNS server
+} _wifiCache;
+
+// Dry contact inputs
+// 16 Bytes
+typedef struct
+{
+  uint8_t  pin[CFG_INPUT_MAX];          // GPIO (0 = not used)
+  uint16_t idx[CFG_INPUT_MAX];          // Switch index (into Domoticz)
+  uint16_t debounce;                    // Debounce time (ms)
+  uint8_t  filler[2];
+} _inputs;
+
+// S0 pulse counters
+// 8 Bytes
+typedef struct
+{
+  uint8_t  pin[CFG_PULSE_MAX];          // GPIO (0 = not used)
+  uint8_t  filler[6];
+} _pulses;
+
+// Rolling window statistics
+// 32 Bytes
+typedef struct
+{
+  char     labels[CFG_STATS_LABELS_SIZE+1]; // comma separated labels
+  uint16_t window[CFG_STATS_WINDOWS];   // windows length (s)
+  uint8_t  payload;                     // add statistics to uploads
+  uint8_t  filler[1];
+} _stats;
+
+// Load shedding relays, first one is shed first
+// 8 Bytes
+typedef struct
+{
+  uint8_t  pin[CFG_SHED_MAX];           // GPIO (0 = not used)
+  uint8_t  trip;                        // shed level (% of ISOUSC)
+  uint8_t  restore;                     // restore level (% of ISOUSC)
+  uint16_t min_off;                     // min off time (s)
+  uint8_t  filler[1];
+} _shed;
+
 // Config for emoncms
 // 128 Bytes
 typedef struct 
@@ -109,7 +221,10 @@ typedef struct
   uint16_t port;    								    // Protocol port (HTTP/HTTPS)
   uint8_t  node;     									  // optional node
   uint32_t freq;                        // refresh rate
-  uint8_t  filler[22];  							  // in case adding data in config avoiding loosing current conf by bad crc*/
+  uint8_t  bulk;                        // samples per bulk upload (0 = one post per sample)
+  uint16_t bulk_latency;                // max age of buffered sample (s)
+  uint8_t  tls;                         // TLS_OFF, TLS_VERIFY or TLS_INSECURE
+  uint8_t  filler[18];  							  // in case adding data in config avoiding loosing current conf by bad crc*/
 } _emoncms;
 
 // Config for jeedom
@@ -122,7 +237,8 @@ typedef struct
   char  adco[CFG_JDOM_ADCO_SIZE+1];     // Identifiant compteur
   uint16_t port;                         // Protocol port (HTTP/HTTPS)
   uint32_t freq;                        // refresh rate
-  uint8_t filler[90];                   // in case adding data in config avoiding loosing current conf by bad crc*/
+  uint8_t  tls;                         // TLS_OFF, TLS_VERIFY or TLS_INSECURE
+  uint8_t filler[89];                   // in case adding data in config avoiding loosing current conf by bad crc*/
 } _jeedom;
 
 // Config for http request
@@ -136,7 +252,8 @@ typedef struct
   uint16_t swidx;                       // Switch index (into Domoticz)
   uint16_t iidx;                        // Intensité
   uint16_t adpsidx;                     // ADPS
-  uint8_t filler[22];                   // in case adding data in config avoiding loosing current conf by bad crc*/
+  uint8_t  tls;                         // TLS_OFF, TLS_VERIFY or TLS_INSECURE
+  uint8_t filler[21];                   // in case adding data in config avoiding loosing current conf by bad crc*/
 } _httpRequest;
 
 // Config saved into eeprom
@@ -151,7 +268,20 @@ typedef struct
   uint32_t config;           		   // Bit field register 
   uint16_t ota_port;         		   // OTA port 
   boolean  dbgfile;                 // true if debug on SPIFFS required
-  uint8_t  filler[130];      		   // in case adding data in config avoiding loosing current conf by bad crc
+  uint32_t wifi_ip;                // Static IP address (0 for DHCP)
+  uint32_t wifi_gw;                // Static IP gateway
+  uint32_t wifi_msk;               // Static IP netmask
+  _wifiCache wifi_cache;           // Last good Wifi connection
+  uint16_t scan_ttl;               // Wifi scan cache time to live (s)
+  _inputs  inputs;                 // Dry contact inputs
+  _pulses  pulses;                 // S0 pulse counters
+  uint16_t power_tau;              // Active power time constant (s)
+  _stats   stats;                  // Rolling window statistics
+  _shed    shed;                   // Load shedding relays
+  uint8_t  tls_fp[CFG_TLS_FP_SIZE]; // TLS server fingerprint (0 = not pinned)
+  uint8_t  log_level;              // highest level logged (0 = default)
+  uint32_t syslog_ip;              // UDP syslog server (0 = none)
+  uint16_t wifi_t1;                // T1 of cached lease (min, 0 = unknown)
   _emoncms emoncms;                // Emoncms configuration
   _jeedom  jeedom;                 // jeedom configuration
   _httpRequest httpReq;            // HTTP request
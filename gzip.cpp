@@ -0,0 +1,392 @@
+// **********************************************************************************
+// ESP8266 Teleinfo gzip encoder
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "gzip.h"
+
+// Deflate length and distance codes, base values and extra bits
+static const uint16_t gzip_len_base[29] PROGMEM = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t gzip_len_extra[29] PROGMEM = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t gzip_dist_base[30] PROGMEM = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t gzip_dist_extra[30] PROGMEM = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// CRC32 by nibble, 64 bytes of table instead of 1KB
+static const uint32_t gzip_crc_tab[16] PROGMEM = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C };
+
+// Compressed responses
+uint16_t gzip_count = 0;
+uint32_t gzip_in = 0;
+uint32_t gzip_out = 0;
+uint32_t gzip_us = 0;
+
+// Benchmark results
+uint32_t gzip_bench_out;
+
+/* ======================================================================
+Function: gzipByte
+Purpose : add a byte to compressed output
+Input   : encoder
+          byte
+Output  : -
+Comments: output is given to flush function when full
+====================================================================== */
+static void gzipByte(_gzip * z, uint8_t b)
+{
+  z->out[z->olen++] = b;
+  z->total++;
+  if (z->olen >= GZIP_OUT_SIZE) {
+    z->flush(z->out, z->olen);
+    z->olen = 0;
+  }
+}
+
+/* ======================================================================
+Function: gzipBits
+Purpose : add bits to compressed output, LSB first
+Input   : encoder
+          value
+          number of bits
+Output  : -
+Comments: -
+====================================================================== */
+static void gzipBits(_gzip * z, uint32_t value, uint8_t n)
+{
+  z->bits |= value << z->nbits;
+  z->nbits += n;
+  while (z->nbits >= 8) {
+    gzipByte(z, z->bits);
+    z->bits >>= 8;
+    z->nbits -= 8;
+  }
+}
+
+/* ======================================================================
+Function: gzipSymbol
+Purpose : write a literal/length symbol with fixed Huffman code
+Input   : encoder
+          symbol (0..285)
+Output  : -
+Comments: Huffman codes are stored MSB first, so bits are reversed
+====================================================================== */
+static void gzipSymbol(_gzip * z, uint16_t sym)
+{
+  uint16_t code;
+  uint8_t  n;
+  uint16_t rev = 0;
+
+  if (sym < 144)      { code = 0x30 + sym;        n = 8; }
+  else if (sym < 256) { code = 0x190 + sym - 144; n = 9; }
+  else if (sym < 280) { code = sym - 256;         n = 7; }
+  else                { code = 0xC0 + sym - 280;  n = 8; }
+
+  for (uint8_t i = 0; i < n; i++)
+    rev |= ((code >> i) & 1) << (n - 1 - i);
+  gzipBits(z, rev, n);
+}
+
+/* ======================================================================
+Function: gzipMatch
+Purpose : write a length/distance pair
+Input   : encoder
+          match length (3..258)
+          match distance (1..GZIP_WINDOW)
+Output  : -
+Comments: distance codes are 5 bits fixed, reversed too
+====================================================================== */
+static void gzipMatch(_gzip * z, uint16_t len, uint16_t dist)
+{
+  uint8_t i = 28;
+  uint8_t rev = 0;
+
+  while (len < pgm_read_word(&gzip_len_base[i]))
+    i--;
+  gzipSymbol(z, 257 + i);
+  gzipBits(z, len - pgm_read_word(&gzip_len_base[i]), pgm_read_byte(&gzip_len_extra[i]));
+
+  i = 29;
+  while (dist < pgm_read_word(&gzip_dist_base[i]))
+    i--;
+  for (uint8_t b = 0; b < 5; b++)
+    rev |= ((i >> b) & 1) << (4 - b);
+  gzipBits(z, rev, 5);
+  gzipBits(z, dist - pgm_read_word(&gzip_dist_base[i]), pgm_read_byte(&gzip_dist_extra[i]));
+}
+
+/* ======================================================================
+Function: gzipHash
+Purpose : hash of 3 bytes
+Input   : pointer on bytes
+Output  : hash
+Comments: -
+====================================================================== */
+static inline uint16_t gzipHash(const uint8_t * p)
+{
+  return ((p[0] << 5) ^ (p[1] << 2) ^ p[2] ^ (p[0] >> 3)) & (GZIP_HASH_SIZE - 1);
+}
+
+/* ======================================================================
+Function: gzipDeflate
+Purpose : encode pending input
+Input   : encoder
+          true at end of stream
+Output  : -
+Comments: while stream goes on, GZIP_MAX_MATCH bytes are kept pending
+          so a match is never cut by end of input received so far
+====================================================================== */
+static void gzipDeflate(_gzip * z, bool finish)
+{
+  while (z->pos < z->len && (finish || z->len - z->pos >= GZIP_MAX_MATCH)) {
+    uint16_t avail = z->len - z->pos;
+    uint16_t best = 0;
+    uint16_t dist = 0;
+
+    if (avail >= GZIP_MIN_MATCH) {
+      uint16_t h = gzipHash(z->buf + z->pos);
+      uint16_t cand = z->head[h];
+
+      z->head[h] = z->pos + 1;
+      if (cand && z->pos - (cand - 1) <= GZIP_WINDOW) {
+        const uint8_t * a = z->buf + cand - 1;
+        const uint8_t * b = z->buf + z->pos;
+        uint16_t max = avail < GZIP_MAX_MATCH ? avail : GZIP_MAX_MATCH;
+
+        while (best < max && a[best] == b[best])
+          best++;
+        dist = z->pos - (cand - 1);
+      }
+    }
+
+    if (best >= GZIP_MIN_MATCH) {
+      gzipMatch(z, best, dist);
+      // Index matched bytes so next matches can start inside
+      for (uint16_t i = 1; i < best && z->pos + i + GZIP_MIN_MATCH <= z->len; i++)
+        z->head[gzipHash(z->buf + z->pos + i)] = z->pos + i + 1;
+      z->pos += best;
+    } else {
+      gzipSymbol(z, z->buf[z->pos++]);
+    }
+  }
+}
+
+/* ======================================================================
+Function: gzipBegin
+Purpose : start a gzip stream
+Input   : encoder
+          function receiving compressed data
+Output  : false if no room left in arena
+Comments: gzip header and deflate block header are written
+====================================================================== */
+bool gzipBegin(_gzip * z, void (*flush)(const uint8_t * data, size_t len))
+{
+  static const uint8_t header[10] PROGMEM = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+
+  memset(z, 0, sizeof(_gzip));
+  z->buf  = (uint8_t *)  arenaAlloc(GZIP_BUF_SIZE);
+  z->head = (uint16_t *) arenaAlloc(GZIP_HASH_SIZE * sizeof(uint16_t));
+  z->out  = (uint8_t *)  arenaAlloc(GZIP_OUT_SIZE);
+  if (!z->buf || !z->head || !z->out)
+    return false;
+
+  memset(z->head, 0, GZIP_HASH_SIZE * sizeof(uint16_t));
+  z->flush = flush;
+  z->crc = 0xFFFFFFFF;
+
+  for (uint8_t i = 0; i < sizeof(header); i++)
+    gzipByte(z, pgm_read_byte(&header[i]));
+
+  // Not last block, fixed Huffman codes
+  gzipBits(z, 0 | (1 << 1), 3);
+  return true;
+}
+
+/* ======================================================================
+Function: gzipWrite
+Purpose : compress data
+Input   : encoder
+          data (RAM)
+          data size
+Output  : -
+Comments: when buffer is full, oldest half is dropped from history
+====================================================================== */
+void gzipWrite(_gzip * z, const char * data, size_t len)
+{
+  unsigned long start = micros();
+
+  while (len) {
+    if (z->len >= GZIP_BUF_SIZE) {
+      gzipDeflate(z, false);
+
+      memmove(z->buf, z->buf + GZIP_WINDOW, z->len - GZIP_WINDOW);
+      z->len -= GZIP_WINDOW;
+      z->pos -= GZIP_WINDOW;
+      for (uint16_t i = 0; i < GZIP_HASH_SIZE; i++)
+        z->head[i] = z->head[i] > GZIP_WINDOW ? z->head[i] - GZIP_WINDOW : 0;
+    }
+
+    size_t n = GZIP_BUF_SIZE - z->len;
+    if (n > len)
+      n = len;
+
+    for (size_t i = 0; i < n; i++) {
+      uint8_t b = data[i];
+      z->crc ^= b;
+      z->crc = (z->crc >> 4) ^ pgm_read_dword(&gzip_crc_tab[z->crc & 15]);
+      z->crc = (z->crc >> 4) ^ pgm_read_dword(&gzip_crc_tab[z->crc & 15]);
+      z->buf[z->len++] = b;
+    }
+    z->size += n;
+    data += n;
+    len -= n;
+  }
+  gzipDeflate(z, false);
+  gzip_us += micros() - start;
+}
+
+/* ======================================================================
+Function: gzipEnd
+Purpose : terminate gzip stream
+Input   : encoder
+Output  : -
+Comments: pending input is encoded, then an empty last block, CRC and
+          size are written and remaining output is flushed
+====================================================================== */
+void gzipEnd(_gzip * z)
+{
+  unsigned long start = micros();
+
+  gzipDeflate(z, true);
+  gzipSymbol(z, 256);
+
+  // Empty last block, then byte align
+  gzipBits(z, 1 | (1 << 1), 3);
+  gzipSymbol(z, 256);
+  if (z->nbits)
+    gzipBits(z, 0, 8 - z->nbits);
+
+  uint32_t crc = ~z->crc;
+  for (uint8_t i = 0; i < 4; i++)
+    gzipByte(z, crc >> (8 * i));
+  for (uint8_t i = 0; i < 4; i++)
+    gzipByte(z, z->size >> (8 * i));
+
+  if (z->olen)
+    z->flush(z->out, z->olen);
+  z->olen = 0;
+
+  gzip_us += micros() - start;
+  gzip_count++;
+  gzip_in += z->size;
+  gzip_out += z->total;
+}
+
+/* ======================================================================
+Function: gzipBenchOut
+Purpose : benchmark output, only counted
+Input   : data
+          size
+Output  : -
+Comments: -
+====================================================================== */
+static void gzipBenchOut(const uint8_t * data, size_t len)
+{
+  gzip_bench_out += len;
+}
+
+/* ======================================================================
+Function: gzipJSONTable
+Purpose : dump compression results in JSON, optionally run benchmark
+Input   : -
+Output  : -
+Comments: /gzip.json?bench=N compresses current teleinfo values as sent
+          by /tinfo.json N times and gives compressed size (% of input)
+          and time per KB, so cost can be weighed against link speed
+====================================================================== */
+void gzipJSONTable(void)
+{
+  uint16_t loops = server.arg("bench").toInt();
+  uint32_t bench_in = 0, bench_out = 0, bench_us = 0;
+
+  if (loops) {
+    uint16_t idx = 0;
+    bool first = true;
+    _gzip z;
+
+    arenaReset();
+    char * in = (char *) arenaAlloc(GZIP_BENCH_SIZE);
+
+    if (in) {
+      bufPrintf(in, GZIP_BENCH_SIZE, idx, PSTR("[\r\n"));
+      for (int8_t id = valueNext(-1); id >= 0; id = valueNext(id)) {
+        bufPrintf(in, GZIP_BENCH_SIZE, idx, PSTR("%s{\"na\":\"%s\", \"va\":\"%s\", \"ck\":\"%c\", \"fl\":%d}"),
+                  first ? "" : ",\r\n", tabnames[id], valueText(id), value_slots[id].checksum, value_slots[id].flags);
+        first = false;
+      }
+      bufPrintf(in, GZIP_BENCH_SIZE, idx, PSTR("\r\n]"));
+
+      // Keep response counters out of benchmark
+      uint16_t mark = response_idx;
+      uint16_t count = gzip_count;
+      uint32_t gin = gzip_in, gout = gzip_out, gus = gzip_us;
+
+      for (uint16_t i = 0; i < loops; i++) {
+        unsigned long start = micros();
+
+        gzip_bench_out = 0;
+        if (!gzipBegin(&z, gzipBenchOut))
+          break;
+        gzipWrite(&z, in, idx);
+        gzipEnd(&z);
+        bench_us += micros() - start;
+        bench_in += idx;
+        bench_out += gzip_bench_out;
+
+        // Encoder buffers are taken again next loop
+        response_idx = mark;
+        yield();
+      }
+
+      gzip_count = count;
+      gzip_in = gin; gzip_out = gout; gzip_us = gus;
+    }
+    arenaReset();
+  }
+
+  respBegin(200, "text/json");
+  respPrintf(PSTR("{\r\n\"window\":%u,\"min_size\":%u,\"count\":%u,\"in\":%u,\"out\":%u,\"pct\":%u,\"us_per_kb\":%u,\r\n"),
+             GZIP_WINDOW, GZIP_MIN_SIZE, gzip_count, gzip_in, gzip_out,
+             gzip_in ? (uint32_t) (100ULL * gzip_out / gzip_in) : 0,
+             gzip_in ? (uint32_t) (1024ULL * gzip_us / gzip_in) : 0);
+  respPrintf(PSTR("\"bench\":{\"loops\":%u,\"in\":%u,\"out\":%u,\"pct\":%u,\"us_per_kb\":%u}\r\n}\r\n"),
+             loops, bench_in, bench_out,
+             bench_in ? (uint32_t) (100ULL * bench_out / bench_in) : 0,
+             bench_in ? (uint32_t) (1024ULL * bench_us / bench_in) : 0);
+  respEnd();
+}
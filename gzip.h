@@ -0,0 +1,67 @@
+// **********************************************************************************
+// ESP8266 Teleinfo gzip encoder Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef GZIP_H
+#define GZIP_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Streaming deflate (fixed Huffman codes, LZ77 with one hash entry per
+// bucket), small window so everything fits in response arena
+#define GZIP_WINDOW     512                 // max match distance
+#define GZIP_BUF_SIZE   (2 * GZIP_WINDOW)   // history + pending input
+#define GZIP_HASH_BITS  8
+#define GZIP_HASH_SIZE  (1 << GZIP_HASH_BITS)
+#define GZIP_OUT_SIZE   512                 // compressed data sent by this size
+#define GZIP_MIN_MATCH  3
+#define GZIP_MAX_MATCH  258
+// Responses smaller than this are not worth compressing
+#define GZIP_MIN_SIZE   512
+// Max size of benchmark input (tinfo JSON)
+#define GZIP_BENCH_SIZE 1536
+
+// Encoder state, buffers are taken from response arena
+typedef struct
+{
+  uint8_t *  buf;        // history + pending input
+  uint16_t * head;       // last position + 1 of each hash, 0 if none
+  uint8_t *  out;        // compressed output
+  uint16_t   len;        // bytes in buf
+  uint16_t   pos;        // next byte to encode
+  uint16_t   olen;       // bytes in out
+  uint32_t   bits;       // bits waiting for a full byte
+  uint8_t    nbits;
+  uint32_t   crc;
+  uint32_t   size;       // input bytes
+  uint32_t   total;      // output bytes
+  void     (*flush)(const uint8_t * data, size_t len);
+} _gzip;
+
+// declared exported function from gzip.cpp
+// ===================================================
+bool gzipBegin(_gzip * z, void (*flush)(const uint8_t * data, size_t len));
+void gzipWrite(_gzip * z, const char * data, size_t len);
+void gzipEnd(_gzip * z);
+void gzipJSONTable(void);
+
+#endif
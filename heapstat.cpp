@@ -0,0 +1,241 @@
+// **********************************************************************************
+// ESP8266 Teleinfo heap usage statistics
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "heapstat.h"
+
+// Per route/task statistics
+_heapStat     heap_stats[HEAP_STAT_MAX];
+uint8_t       heap_count = 0;
+
+// Scope being measured
+_heapStat *   heap_cur = NULL;
+uint32_t      heap_cur_start;     // free heap when entering scope
+uint32_t      heap_cur_min;       // lowest free heap seen in scope
+const char *  heap_cur_name = NULL;   // traced scope
+
+// Free heap history
+_heapSample   heap_hist[HEAP_HIST_SIZE];
+uint8_t       heap_hist_idx = 0;  // next sample to write
+uint8_t       heap_hist_cnt = 0;  // valid samples
+uint8_t       heap_decline_run = 0;
+uint16_t      heap_decline_from = 0;
+
+bool          heap_soak = false;
+bool          heap_decline = false;
+unsigned long heap_soak_start = 0;
+uint32_t      heap_soak_free = 0;
+
+/* ======================================================================
+Function: heapFind
+Purpose : get statistics entry of a route or task
+Input   : name (must stay valid, only pointer is kept)
+Output  : pointer on entry, NULL if table is full
+Comments: -
+====================================================================== */
+_heapStat * heapFind(const char * name)
+{
+  for (uint8_t i = 0; i < heap_count; i++) {
+    if (heap_stats[i].name == name || !strcmp(heap_stats[i].name, name))
+      return &heap_stats[i];
+  }
+
+  if (heap_count >= HEAP_STAT_MAX)
+    return NULL;
+
+  memset(&heap_stats[heap_count], 0, sizeof(_heapStat));
+  heap_stats[heap_count].name = name;
+  return &heap_stats[heap_count++];
+}
+
+/* ======================================================================
+Function: heapBegin
+Purpose : start measuring heap usage of a route or task
+Input   : name
+Output  : -
+Comments: scopes are not nested, requests and tasks are run one at
+          a time from loop()
+====================================================================== */
+void heapBegin(const char * name)
+{
+  heap_cur = heapFind(name);
+  heap_cur_start = heap_cur_min = ESP.getFreeHeap();
+  heap_cur_name = name;
+  TRACE_BEGIN(*name == '/' ? TRACE_HTTP : TRACE_TASK, name);
+}
+
+/* ======================================================================
+Function: heapSample
+Purpose : record current heap usage of running scope
+Input   : -
+Output  : -
+Comments: called where buffers are in use (chunk flush, http reply)
+          so peak is sampled, not exact
+====================================================================== */
+void heapSample(void)
+{
+  if (heap_cur) {
+    uint32_t free = ESP.getFreeHeap();
+    if (free < heap_cur_min)
+      heap_cur_min = free;
+  }
+}
+
+/* ======================================================================
+Function: heapEnd
+Purpose : end measuring heap usage of current scope
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void heapEnd(void)
+{
+  if (heap_cur_name) {
+    TRACE_END(*heap_cur_name == '/' ? TRACE_HTTP : TRACE_TASK, heap_cur_name);
+    heap_cur_name = NULL;
+  }
+
+  if (!heap_cur)
+    return;
+
+  heapSample();
+
+  uint32_t free = ESP.getFreeHeap();
+  uint16_t used = heap_cur_start - heap_cur_min;
+
+  heap_cur->calls++;
+  heap_cur->last = used;
+  if (used > heap_cur->peak)
+    heap_cur->peak = used;
+
+  if (free < heap_cur_start) {
+    heap_cur->grow++;
+    heap_cur->retained += heap_cur_start - free;
+  } else {
+    heap_cur->retained -= free - heap_cur_start;
+  }
+
+  heap_cur = NULL;
+}
+
+/* ======================================================================
+Function: heapOn
+Purpose : declare a WEB route with heap accounting
+Input   : URI
+          route handler
+Output  : -
+Comments: same as server.on(uri, handler)
+====================================================================== */
+void heapOn(const char * uri, ESP8266WebServer::THandlerFunction handler)
+{
+  server.on(uri, [uri, handler]() {
+    heapBegin(uri);
+    handler();
+    heapEnd();
+  });
+}
+
+/* ======================================================================
+Function: heapHandle
+Purpose : sample heap history, check for decline, run soak mode
+Input   : -
+Output  : -
+Comments: called every second from main loop
+====================================================================== */
+void heapHandle(void)
+{
+  // Soak mode, trigger all configured sinks again and again
+  if (heap_soak && (seconds % HEAP_SOAK_PERIOD) == 0) {
+    sinksTrigger();
+  }
+
+  if (seconds % HEAP_HIST_PERIOD)
+    return;
+
+  _heapSample * s = &heap_hist[heap_hist_idx];
+  s->free  = ESP.getFreeHeap();
+  s->block = ESP.getMaxFreeBlockSize();
+  s->frag  = ESP.getHeapFragmentation();
+
+  // Follow consecutive decreasing samples
+  if (heap_hist_cnt) {
+    _heapSample * prev = &heap_hist[(heap_hist_idx + HEAP_HIST_SIZE - 1) % HEAP_HIST_SIZE];
+
+    if (s->free < prev->free) {
+      if (!heap_decline_run++)
+        heap_decline_from = prev->free;
+    } else {
+      heap_decline_run = 0;
+    }
+  }
+
+  if (heap_decline_run >= HEAP_DECLINE_SAMPLES && heap_decline_from - s->free >= HEAP_DECLINE_BYTES) {
+    if (!heap_decline)
+      Debugf("Heap decline, %u => %u bytes in %d samples\r\n", heap_decline_from, s->free, heap_decline_run);
+    heap_decline = true;
+  }
+
+  heap_hist_idx = (heap_hist_idx + 1) % HEAP_HIST_SIZE;
+  if (heap_hist_cnt < HEAP_HIST_SIZE)
+    heap_hist_cnt++;
+}
+
+/* ======================================================================
+Function: heapJSONTable
+Purpose : dump heap statistics in JSON format
+Input   : -
+Output  : -
+Comments: ?soak=1 starts soak mode, ?soak=0 stops it
+====================================================================== */
+void heapJSONTable(void)
+{
+  if (server.hasArg("soak")) {
+    heap_soak = server.arg("soak").toInt() == 1;
+    if (heap_soak) {
+      heap_soak_start = seconds;
+      heap_soak_free = ESP.getFreeHeap();
+      heap_decline = false;
+      heap_decline_run = 0;
+    }
+    Debugf("Soak mode %s\r\n", heap_soak ? "ON" : "OFF");
+  }
+
+  respBegin(200, "text/json");
+  respPrintf(PSTR("{\r\n\"free\":%u,\"block\":%u,\"frag\":%u,\"decline\":%d,"),
+             ESP.getFreeHeap(), ESP.getMaxFreeBlockSize(), ESP.getHeapFragmentation(), heap_decline);
+  respPrintf(PSTR("\"soak\":%d,\"soak_time\":%lu,\"soak_free\":%u,\r\n\"handlers\":[\r\n"),
+             heap_soak, heap_soak ? seconds - heap_soak_start : 0, heap_soak_free);
+
+  for (uint8_t i = 0; i < heap_count; i++) {
+    _heapStat * h = &heap_stats[i];
+    respPrintf(PSTR("%s{\"na\":\"%s\",\"calls\":%u,\"grow\":%u,\"retained\":%d,\"peak\":%u,\"last\":%u}"),
+               i ? ",\r\n" : "", h->name, h->calls, h->grow, h->retained, h->peak, h->last);
+  }
+
+  // History, oldest first
+  respPrint_P(PSTR("\r\n],\r\n\"history\":[\r\n"));
+  for (uint8_t i = 0; i < heap_hist_cnt; i++) {
+    _heapSample * s = &heap_hist[(heap_hist_idx + HEAP_HIST_SIZE - heap_hist_cnt + i) % HEAP_HIST_SIZE];
+    respPrintf(PSTR("%s[%u,%u,%u]"), i ? "," : "", s->free, s->block, s->frag);
+  }
+  respPrint_P(PSTR("\r\n]\r\n}\r\n"));
+  respEnd();
+}
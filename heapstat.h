@@ -0,0 +1,74 @@
+// **********************************************************************************
+// ESP8266 Teleinfo heap usage statistics Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef HEAPSTAT_H
+#define HEAPSTAT_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Max number of routes/tasks followed
+#define HEAP_STAT_MAX        32
+// Heap history, one sample every HEAP_HIST_PERIOD seconds
+#define HEAP_HIST_SIZE       60
+#define HEAP_HIST_PERIOD     60
+// Heap decline is flagged when free heap went down on that many
+// consecutive history samples and by at least HEAP_DECLINE_BYTES
+#define HEAP_DECLINE_SAMPLES 10
+#define HEAP_DECLINE_BYTES   1024
+// Soak mode, sinks are triggered every HEAP_SOAK_PERIOD seconds
+#define HEAP_SOAK_PERIOD     5
+
+// Heap usage of one route or task
+typedef struct
+{
+  const char * name;     // route URI or task name
+  uint32_t calls;        // number of calls
+  uint32_t grow;         // calls which returned with less free heap
+  int32_t  retained;     // cumulated heap not given back (bytes)
+  uint16_t peak;         // max heap in use during a call (bytes)
+  uint16_t last;         // heap in use during last call (bytes)
+} _heapStat;
+
+// One heap history sample
+typedef struct
+{
+  uint16_t free;         // free heap (bytes)
+  uint16_t block;        // largest free block (bytes)
+  uint8_t  frag;         // fragmentation (%)
+} _heapSample;
+
+// Exported variables
+// ===================================================
+extern bool heap_soak;
+extern bool heap_decline;
+
+// declared exported function from heapstat.cpp
+// ===================================================
+void heapBegin(const char * name);
+void heapSample(void);
+void heapEnd(void);
+void heapOn(const char * uri, ESP8266WebServer::THandlerFunction handler);
+void heapHandle(void);
+void heapJSONTable(void);
+
+#endif
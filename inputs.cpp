@@ -0,0 +1,190 @@
+// **********************************************************************************
+// ESP8266 Teleinfo dry contact inputs
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "inputs.h"
+
+_input      inputs[CFG_INPUT_MAX];
+uint8_t     inputs_count = 0;
+uint8_t     inputs_notify = 0;   // bit set when input must be sent to Domoticz
+uint16_t    inputs_lost = 0;     // events lost, queue was full
+uint32_t    inputs_latency = 0;  // max edge to main loop delay (us)
+uint32_t    inputs_debounce_us;
+
+// Edge events queue, single producer (GPIO ISR) single consumer (loop)
+// so no lock needed, each side only writes its own index
+_inputEvent       inputs_queue[INPUT_QUEUE_SIZE];
+volatile uint8_t  inputs_head = 0;   // written by ISR
+volatile uint8_t  inputs_tail = 0;   // written by loop
+
+/* ======================================================================
+Function: inputEdge
+Purpose : handle an edge on an input
+Input   : input number
+Output  : -
+Comments: runs in interrupt context, debounce is done here: first edge
+          is taken at once, next ones are ignored during debounce time
+====================================================================== */
+void ICACHE_RAM_ATTR inputEdge(uint8_t i)
+{
+  _input * in = &inputs[i];
+  uint32_t now = micros();
+  uint8_t level = digitalRead(in->pin);
+
+  if (level == in->state || now - in->last_us < inputs_debounce_us)
+    return;
+
+  in->state = level;
+  in->last_us = now;
+
+  uint8_t next = (inputs_head + 1) & (INPUT_QUEUE_SIZE - 1);
+  if (next == inputs_tail) {
+    inputs_lost++;
+    return;
+  }
+
+  inputs_queue[inputs_head].us = now;
+  inputs_queue[inputs_head].input = i;
+  inputs_queue[inputs_head].level = level;
+  inputs_head = next;
+}
+
+void ICACHE_RAM_ATTR inputISR0(void) { inputEdge(0); }
+void ICACHE_RAM_ATTR inputISR1(void) { inputEdge(1); }
+void ICACHE_RAM_ATTR inputISR2(void) { inputEdge(2); }
+void ICACHE_RAM_ATTR inputISR3(void) { inputEdge(3); }
+
+void (* const inputs_isr[CFG_INPUT_MAX])(void) = { inputISR0, inputISR1, inputISR2, inputISR3 };
+
+/* ======================================================================
+Function: inputsInit
+Purpose : setup configured inputs and their interrupts
+Input   : -
+Output  : -
+Comments: can be called again after configuration change, old config
+          with no input declared uses GPIO14 and Switch IDX
+====================================================================== */
+void inputsInit(void)
+{
+  bool none = true;
+
+  // Stop all previous interrupts
+  for (uint8_t i = 0; i < inputs_count; i++)
+    detachInterrupt(inputs[i].pin);
+  inputs_count = 0;
+  inputs_notify = 0;
+  inputs_head = inputs_tail = 0;
+
+  inputs_debounce_us = 1000UL * (config.inputs.debounce ? config.inputs.debounce : CFG_INPUT_DEFAULT_DEB);
+
+  for (uint8_t i = 0; i < CFG_INPUT_MAX; i++) {
+    if (config.inputs.pin[i])
+      none = false;
+  }
+
+  for (uint8_t i = 0; i < CFG_INPUT_MAX; i++) {
+    uint8_t pin = config.inputs.pin[i];
+    uint16_t idx = config.inputs.idx[i];
+
+    // Previous single switch
+    if (none && i == 0) {
+      pin = CFG_INPUT_DEFAULT_PIN;
+      idx = config.httpReq.swidx;
+    }
+
+    if (!INPUT_PIN_OK(pin))
+      continue;
+
+    _input * in = &inputs[inputs_count];
+    memset(in, 0, sizeof(_input));
+    in->pin = pin;
+    in->idx = idx;
+    pinMode(pin, INPUT_PULLUP);
+    in->state = in->level = digitalRead(pin);
+    in->last_us = micros() - inputs_debounce_us;
+
+    // State is sent to Domoticz at boot
+    inputs_notify |= (1 << inputs_count);
+
+    attachInterrupt(digitalPinToInterrupt(pin), inputs_isr[inputs_count], CHANGE);
+    Debugf("Input %d on GPIO%d idx %d state %d\r\n", inputs_count + 1, pin, idx, in->state);
+    inputs_count++;
+  }
+}
+
+/* ======================================================================
+Function: inputsHandle
+Purpose : process inputs edges captured by interrupt
+Input   : -
+Output  : -
+Comments: called from main loop
+====================================================================== */
+void inputsHandle(void)
+{
+  uint32_t now = micros();
+
+  // Edge missed (contact bounced back after debounce window) ?
+  for (uint8_t i = 0; i < inputs_count; i++) {
+    _input * in = &inputs[i];
+    if (now - in->last_us >= inputs_debounce_us && digitalRead(in->pin) != in->state) {
+      noInterrupts();
+      inputEdge(i);
+      interrupts();
+    }
+  }
+
+  while (inputs_tail != inputs_head) {
+    _inputEvent * ev = &inputs_queue[inputs_tail];
+    _input * in = &inputs[ev->input];
+    uint32_t latency = micros() - ev->us;
+
+    if (latency > inputs_latency)
+      inputs_latency = latency;
+
+    if (ev->level != in->level) {
+      Debugf("Input %d changed from %d to %d (%u us)\r\n", ev->input + 1, in->level, ev->level, latency);
+      in->level = ev->level;
+      in->changes++;
+      in->change_s = seconds;
+      //Notify HTTP server that input has changed, on next loop
+      inputs_notify |= (1 << ev->input);
+    }
+    inputs_tail = (inputs_tail + 1) & (INPUT_QUEUE_SIZE - 1);
+  }
+}
+
+/* ======================================================================
+Function: inputsNextNotify
+Purpose : get next input to send to Domoticz
+Input   : -
+Output  : input number, -1 if none
+Comments: input is removed from pending list
+====================================================================== */
+int inputsNextNotify(void)
+{
+  for (uint8_t i = 0; i < inputs_count; i++) {
+    if (inputs_notify & (1 << i)) {
+      inputs_notify &= ~(1 << i);
+      return i;
+    }
+  }
+  return -1;
+}
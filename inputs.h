@@ -0,0 +1,70 @@
+// **********************************************************************************
+// ESP8266 Teleinfo dry contact inputs Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef INPUTS_H
+#define INPUTS_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Edge events queue size, must be a power of 2
+#define INPUT_QUEUE_SIZE 32
+
+// GPIO usable as input with interrupt on Wifinfo
+// (1/3 are serial, 2 is debug, 6 to 11 are flash, 16 has no interrupt)
+#define INPUT_PIN_OK(p) ((p)==4 || (p)==5 || ((p)>=12 && (p)<=15))
+
+// One dry contact input
+typedef struct
+{
+  uint8_t  pin;                 // GPIO
+  uint16_t idx;                 // Switch index (into Domoticz)
+  volatile uint8_t  state;      // debounced level, updated in ISR
+  volatile uint32_t last_us;    // micros() of last accepted change
+  uint8_t  level;               // level seen by main loop
+  uint32_t changes;             // number of changes
+  unsigned long change_s;       // uptime (s) of last change
+} _input;
+
+// Edge event, pushed by ISR and read by main loop
+typedef struct
+{
+  uint32_t us;                  // micros() of edge
+  uint8_t  input;               // input number
+  uint8_t  level;               // new level
+} _inputEvent;
+
+// Exported variables
+// ===================================================
+extern _input   inputs[];
+extern uint8_t  inputs_count;
+extern uint8_t  inputs_notify;
+extern uint16_t inputs_lost;
+extern uint32_t inputs_latency;
+
+// declared exported function from inputs.cpp
+// ===================================================
+void inputsInit(void);
+void inputsHandle(void);
+int  inputsNextNotify(void);
+
+#endif
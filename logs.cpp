@@ -0,0 +1,253 @@
+// **********************************************************************************
+// ESP8266 Teleinfo log ring
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "logs.h"
+
+LogPrint log_print;
+char     log_ring[LOG_SIZE];
+uint32_t log_head = 0;          // bytes written since boot
+uint32_t log_serial = 0;        // bytes drained to serial
+uint32_t log_syslog = 0;        // bytes sent to syslog
+uint32_t log_lost = 0;          // bytes overwritten before drained
+uint32_t log_dropped = 0;       // lines filtered by level
+uint8_t  log_level = LOG_DEFAULT_LEVEL;
+bool     log_bol = true;        // next byte starts a line
+bool     log_skip = false;      // line being written is filtered
+WiFiUDP  log_udp;
+
+const char log_letters[] = "  EW IDD";   // by level
+
+/* ======================================================================
+Function: LogPrint::write
+Purpose : append a byte to ring
+Input   : byte
+Output  : 1
+Comments: never waits, oldest bytes are overwritten
+====================================================================== */
+size_t LogPrint::write(uint8_t c)
+{
+  if (log_bol) {
+    log_bol = false;
+    log_skip = level > log_level;
+    if (log_skip)
+      log_dropped++;
+    else
+      log_ring[log_head++ % LOG_SIZE] = level;
+  }
+
+  if (!log_skip)
+    log_ring[log_head++ % LOG_SIZE] = c;
+  if (c == '\n')
+    log_bol = true;
+  return 1;
+}
+
+/* ======================================================================
+Function: LogPrint::write
+Purpose : append bytes to ring
+Input   : buffer
+          size
+Output  : size
+Comments: -
+====================================================================== */
+size_t LogPrint::write(const uint8_t * buf, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    write(buf[i]);
+  return len;
+}
+
+/* ======================================================================
+Function: logInit
+Purpose : take log settings from configuration
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void logInit(void)
+{
+  log_level = config.log_level ? config.log_level : LOG_DEFAULT_LEVEL;
+  log_syslog = log_head;
+}
+
+/* ======================================================================
+Function: logCatchUp
+Purpose : move a reader passed by writer to oldest byte of ring
+Input   : reader position
+Output  : -
+Comments: lost bytes are counted
+====================================================================== */
+void logCatchUp(uint32_t & pos)
+{
+  if (log_head - pos > LOG_SIZE) {
+    log_lost += log_head - LOG_SIZE - pos;
+    pos = log_head - LOG_SIZE;
+  }
+}
+
+/* ======================================================================
+Function: logSerial
+Purpose : drain ring to debug serial
+Input   : true to wait for serial, false to write only what fits in
+          UART FIFO
+Output  : -
+Comments: level bytes are not sent
+====================================================================== */
+void logSerial(bool wait)
+{
+  int room = wait ? LOG_SIZE : DEBUG_SERIAL.availableForWrite();
+
+  logCatchUp(log_serial);
+  while (log_serial != log_head && room > 0) {
+    char c = log_ring[log_serial++ % LOG_SIZE];
+    if (c > LOG_DEBUG) {
+      DEBUG_SERIAL.write(c);
+      room--;
+    }
+  }
+}
+
+/* ======================================================================
+Function: logSyslog
+Purpose : send complete lines of ring to syslog server
+Input   : -
+Output  : -
+Comments: RFC 3164 without timestamp, <PRI>host: message. A few
+          lines per pass, rest waits for next loop
+====================================================================== */
+void logSyslog(void)
+{
+  if (!config.syslog_ip || wifi_state != WIFI_ST_CONNECTED) {
+    log_syslog = log_head;
+    return;
+  }
+
+  logCatchUp(log_syslog);
+  for (uint8_t n = 0; n < LOG_SYSLOG_LINES && log_syslog != log_head; n++) {
+    uint32_t pos = log_syslog;
+    char line[LOG_LINE_MAX];
+    uint8_t len = 0;
+    uint8_t level = LOG_DEBUG;
+
+    // Complete line only
+    while (pos != log_head && log_ring[pos % LOG_SIZE] != '\n')
+      pos++;
+    if (pos == log_head)
+      return;
+
+    for ( ; log_syslog != pos; log_syslog++) {
+      char c = log_ring[log_syslog % LOG_SIZE];
+      if (c <= LOG_DEBUG)
+        level = c;
+      else if (c != '\r' && len < LOG_LINE_MAX - 1)
+        line[len++] = c;
+    }
+    log_syslog++;
+    line[len] = '\0';
+
+    if (len) {
+      log_udp.beginPacket(IPAddress(config.syslog_ip), LOG_SYSLOG_PORT);
+      log_udp.printf_P(PSTR("<%u>%s: %s"), LOG_FACILITY * 8 + level, config.host, line);
+      log_udp.endPacket();
+    }
+  }
+}
+
+/* ======================================================================
+Function: logHandle
+Purpose : drain ring in background
+Input   : -
+Output  : -
+Comments: called on each loop pass, serial gets what fits in its FIFO
+====================================================================== */
+void logHandle(void)
+{
+  logSerial(false);
+  logSyslog();
+}
+
+/* ======================================================================
+Function: logFlush
+Purpose : drain ring to serial and wait for it
+Input   : -
+Output  : -
+Comments: Debugflush, before restart or long blocking steps
+====================================================================== */
+void logFlush(void)
+{
+  logSerial(true);
+  DEBUG_SERIAL.flush();
+}
+
+/* ======================================================================
+Function: logSend
+Purpose : stream tail of log ring
+Input   : -
+Output  : -
+Comments: ?n=bytes of tail (default whole ring), ?level=N changes
+          level until next restart. Lines are prefixed with level
+          letter, first partial line is skipped
+====================================================================== */
+void logSend(void)
+{
+  uint32_t head = log_head;
+  uint32_t n = server.hasArg("n") ? server.arg("n").toInt() : LOG_SIZE;
+  char buf[64];
+  uint8_t len = 0;
+
+  if (server.hasArg("level")) {
+    int level = server.arg("level").toInt();
+    if (level >= LOG_ERR && level <= LOG_DEBUG)
+      log_level = level;
+  }
+
+  if (n > LOG_SIZE)
+    n = LOG_SIZE;
+  if (n > head)
+    n = head;
+  uint32_t pos = head - n;
+
+  // Start on a line
+  if (pos)
+    while (pos != head && log_ring[pos++ % LOG_SIZE] != '\n');
+
+  respBegin(200, "text/plain");
+  respPrintf(PSTR("# level %u, %u written, %u lost, %u filtered\r\n"),
+             log_level, log_head, log_lost, log_dropped);
+
+  // Stop if writer passes us while response is sent
+  for ( ; pos != head && log_head - pos <= LOG_SIZE; pos++) {
+    char c = log_ring[pos % LOG_SIZE];
+
+    if (c <= LOG_DEBUG) {
+      buf[len++] = log_letters[(uint8_t) c];
+      c = ' ';
+    }
+    buf[len++] = c;
+    if (len >= sizeof(buf) - 2) {
+      respWrite(buf, len);
+      len = 0;
+    }
+  }
+  respWrite(buf, len);
+  respEnd();
+}
@@ -0,0 +1,72 @@
+// **********************************************************************************
+// ESP8266 Teleinfo log ring Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LOGS_H
+#define LOGS_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Debug macros write into a RAM ring, drained from loop() to debug
+// serial without waiting for it, and to a UDP syslog server if one is
+// configured. Tail of ring is at /log
+#define LOG_SIZE          2048  // ring (bytes)
+#define LOG_LINE_MAX      192   // syslog line, longer ones are cut
+#define LOG_SYSLOG_PORT   514
+#define LOG_SYSLOG_LINES  4     // datagrams sent per loop pass
+#define LOG_FACILITY      16    // local0
+
+// Levels, as syslog severities. Each line starts with its level byte
+// in ring, they are all below ' ' and not \t \n \r
+#define LOG_ERR           3
+#define LOG_WARN          4
+#define LOG_INFO          6
+#define LOG_DEBUG         7
+#define LOG_DEFAULT_LEVEL LOG_DEBUG
+
+// Writer side of ring, only main loop (and SDK callbacks it yields
+// to) writes, so head is moved without lock and readers just check
+// they were not passed
+class LogPrint : public Print
+{
+public:
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t * buf, size_t len) override;
+  uint8_t level = LOG_DEBUG;  // level of line being written
+};
+
+// Leveled message, Debug macros are LOG_DEBUG
+#define Logf(lvl, ...) do { log_print.level = (lvl); log_print.printf(__VA_ARGS__); log_print.level = LOG_DEBUG; } while (0)
+
+// Exported variables
+// ===================================================
+extern LogPrint log_print;
+extern uint8_t  log_level;
+
+// declared exported function from logs.cpp
+// ===================================================
+void logInit(void);
+void logHandle(void);
+void logFlush(void);
+void logSend(void);
+
+#endif
@@ -0,0 +1,331 @@
+// **********************************************************************************
+// ESP8266 Teleinfo Modbus TCP server
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "modbus.h"
+
+WiFiServer    modbus_server(MODBUS_PORT);
+_modbusClient modbus_clients[MODBUS_CLIENTS];
+bool          modbus_on = false;
+
+// Registers, updated at end of each frame
+uint16_t modbus_regs[MODBUS_REGS];
+
+// Derived values, fixed order
+const char * const modbus_derived[] = {
+  "_PACT", "_PULSE1", "_PRATE1", "_PULSE2", "_PRATE2"
+};
+#define MODBUS_DERIVED (sizeof(modbus_derived)/sizeof(modbus_derived[0]))
+
+uint32_t modbus_requests = 0;
+uint16_t modbus_errors = 0;
+uint16_t modbus_rejected = 0;
+uint16_t modbus_last_us = 0;
+uint16_t modbus_max_us = 0;
+
+/* ======================================================================
+Function: modbusSet
+Purpose : set a 32 bits register pair
+Input   : first register
+          value
+Output  : -
+Comments: high word first
+====================================================================== */
+static void modbusSet(uint16_t reg, uint32_t value)
+{
+  modbus_regs[reg]     = value >> 16;
+  modbus_regs[reg + 1] = value;
+}
+
+/* ======================================================================
+Function: modbusNumber
+Purpose : convert a value to 32 bits register value
+Input   : value
+Output  : number, MODBUS_NA if not a number or too big
+Comments: decimal part of derived values is dropped
+====================================================================== */
+static uint32_t modbusNumber(const char * value)
+{
+  uint64_t n = 0;
+  const char * p = value;
+
+  while (*p >= '0' && *p <= '9') {
+    n = n * 10 + (*p++ - '0');
+    if (n >= MODBUS_NA)
+      return MODBUS_NA;
+  }
+
+  if (p == value || (*p && *p != '.'))
+    return MODBUS_NA;
+  return n;
+}
+
+/* ======================================================================
+Function: modbusInit
+Purpose : start or stop Modbus TCP server as configured
+Input   : -
+Output  : -
+Comments: server is only opened with CFG_MODBUS, called at setup and
+          when configuration is saved
+====================================================================== */
+void modbusInit(void)
+{
+  bool on = config.config & CFG_MODBUS;
+
+  if (on == modbus_on)
+    return;
+  modbus_on = on;
+
+  if (!on) {
+    for (uint8_t i = 0; i < MODBUS_CLIENTS; i++)
+      modbus_clients[i].client.stop();
+    modbus_server.stop();
+    return;
+  }
+
+  for (uint16_t i = 0; i < MODBUS_REGS; i++)
+    modbus_regs[i] = 0xFFFF;
+
+  modbus_server.begin();
+  modbus_server.setNoDelay(true);
+}
+
+/* ======================================================================
+Function: modbusFrame
+Purpose : take snapshot of frame values into registers
+Input   : -
+Output  : -
+Comments: called at end of each teleinfo frame, so requests are only
+          a copy of registers
+====================================================================== */
+void modbusFrame(void)
+{
+  char value[16];
+  uint32_t num;
+
+  if (!modbus_on)
+    return;
+
+  for (uint16_t i = 0; i < MODBUS_REG_SYSTEM; i++)
+    modbus_regs[i] = 0xFFFF;
+
+  for (int8_t id = valueNext(-1); id >= 0; id = valueNext(id)) {
+    if (MODBUS_REG_TINFO + 2 * id < MODBUS_REG_DERIVED)
+      modbusSet(MODBUS_REG_TINFO + 2 * id, valueNumber(id, num, true) && num < MODBUS_NA ? num : MODBUS_NA);
+  }
+
+  for (uint8_t i = 0; i < MODBUS_DERIVED; i++) {
+    const char * name = modbus_derived[i];
+
+    if (virtualValue(name, strlen(name), value))
+      modbusSet(MODBUS_REG_DERIVED + 2 * i, modbusNumber(value));
+  }
+}
+
+/* ======================================================================
+Function: modbusSystem
+Purpose : update system counters registers
+Input   : -
+Output  : -
+Comments: uptime (s), free heap, frames, teleinfo reinit, requests and
+          Wifi RSSI (signed)
+====================================================================== */
+static void modbusSystem(void)
+{
+  modbusSet(MODBUS_REG_SYSTEM,      seconds);
+  modbusSet(MODBUS_REG_SYSTEM + 2,  system_get_free_heap_size());
+  modbusSet(MODBUS_REG_SYSTEM + 4,  sink_frame);
+  modbusSet(MODBUS_REG_SYSTEM + 6,  nb_reinit);
+  modbusSet(MODBUS_REG_SYSTEM + 8,  modbus_requests);
+  modbusSet(MODBUS_REG_SYSTEM + 10, (int32_t) WiFi.RSSI());
+}
+
+/* ======================================================================
+Function: modbusRequest
+Purpose : process one request
+Input   : master
+          request length (MBAP + PDU)
+Output  : -
+Comments: answer is built on stack, no allocation
+====================================================================== */
+static void modbusRequest(_modbusClient * m, uint16_t len)
+{
+  uint8_t  tx[9 + 2 * MODBUS_MAX_READ];
+  uint8_t  fc = m->rx[7];
+  uint8_t  ex = 0;
+  uint16_t n = 0;
+  unsigned long start = micros();
+
+  // MBAP transaction and unit are sent back
+  memcpy(tx, m->rx, 7);
+  tx[2] = tx[3] = 0;
+  tx[7] = fc;
+
+  if (m->rx[2] || m->rx[3]) {
+    // not Modbus protocol
+    ex = MODBUS_EX_FUNCTION;
+  } else if (fc != 0x03 && fc != 0x04) {
+    ex = MODBUS_EX_FUNCTION;
+  } else if (len != 12) {
+    ex = MODBUS_EX_VALUE;
+  } else {
+    uint16_t addr = (m->rx[8] << 8) | m->rx[9];
+    uint16_t qty  = (m->rx[10] << 8) | m->rx[11];
+
+    if (!qty || qty > MODBUS_MAX_READ)
+      ex = MODBUS_EX_VALUE;
+    else if ((uint32_t) addr + qty > MODBUS_REGS)
+      ex = MODBUS_EX_ADDRESS;
+    else {
+      if (addr + qty > MODBUS_REG_SYSTEM)
+        modbusSystem();
+
+      tx[8] = 2 * qty;
+      for (uint16_t i = 0; i < qty; i++) {
+        tx[9 + 2 * i]     = modbus_regs[addr + i] >> 8;
+        tx[9 + 2 * i + 1] = modbus_regs[addr + i];
+      }
+      n = 9 + 2 * qty;
+    }
+  }
+
+  if (ex) {
+    tx[7] = fc | 0x80;
+    tx[8] = ex;
+    n = 9;
+    modbus_errors++;
+  }
+
+  // length is unit + PDU
+  tx[4] = (n - 6) >> 8;
+  tx[5] = n - 6;
+  m->client.write(tx, n);
+
+  modbus_requests++;
+  modbus_last_us = micros() - start;
+  if (modbus_last_us > modbus_max_us)
+    modbus_max_us = modbus_last_us;
+}
+
+/* ======================================================================
+Function: modbusHandle
+Purpose : accept masters and serve their requests
+Input   : -
+Output  : -
+Comments: called from main loop, requests may be pipelined
+====================================================================== */
+void modbusHandle(void)
+{
+  if (!modbus_on)
+    return;
+
+  if (modbus_server.hasClient()) {
+    uint8_t i;
+
+    for (i = 0; i < MODBUS_CLIENTS; i++) {
+      if (!modbus_clients[i].client.connected())
+        break;
+    }
+
+    if (i < MODBUS_CLIENTS) {
+      _modbusClient * m = &modbus_clients[i];
+      m->client.stop();
+      m->client = modbus_server.available();
+      m->client.setNoDelay(true);
+      m->len = 0;
+      m->skip = 0;
+      m->last = millis();
+    } else {
+      // all masters slots in use
+      WiFiClient c = modbus_server.available();
+      c.stop();
+      modbus_rejected++;
+    }
+  }
+
+  for (uint8_t i = 0; i < MODBUS_CLIENTS; i++) {
+    _modbusClient * m = &modbus_clients[i];
+
+    if (!m->client.connected())
+      continue;
+
+    if (millis() - m->last > MODBUS_IDLE_MS) {
+      m->client.stop();
+      continue;
+    }
+
+    while (m->client.available()) {
+      if (m->skip) {
+        m->client.read();
+        m->skip--;
+        continue;
+      }
+
+      m->rx[m->len++] = m->client.read();
+      if (m->len < 8)
+        continue;
+
+      // MBAP length counts unit and PDU
+      uint16_t len = 6 + ((m->rx[4] << 8) | m->rx[5]);
+
+      if (len < 8) {
+        m->client.stop();
+        break;
+      }
+      if (len > MODBUS_RX_SIZE) {
+        // not a read request, answered without reading it all
+        modbusRequest(m, len);
+        m->skip = len - m->len;
+        m->len = 0;
+      } else if (m->len >= len) {
+        modbusRequest(m, len);
+        m->len = 0;
+      }
+      m->last = millis();
+    }
+  }
+}
+
+/* ======================================================================
+Function: modbusJSONTable
+Purpose : dump Modbus server state and register map in JSON
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void modbusJSONTable(void)
+{
+  uint8_t masters = 0;
+
+  for (uint8_t i = 0; i < MODBUS_CLIENTS; i++)
+    masters += modbus_clients[i].client.connected() ? 1 : 0;
+
+  respBegin(200, "text/json");
+  respPrintf(PSTR("{\r\n\"enabled\":%s,\"port\":%u,\"masters\":%u,\"max_masters\":%u,\"rejected\":%u,\"requests\":%u,\"errors\":%u,\"last_us\":%u,\"max_us\":%u,\r\n"),
+             modbus_on ? "true" : "false", MODBUS_PORT, masters, MODBUS_CLIENTS, modbus_rejected, modbus_requests, modbus_errors,
+             modbus_last_us, modbus_max_us);
+  respPrintf(PSTR("\"map\":{\"tinfo\":%u,\"derived\":%u,\"system\":%u,\"registers\":%u},\r\n\"derived\":["),
+             MODBUS_REG_TINFO, MODBUS_REG_DERIVED, MODBUS_REG_SYSTEM, MODBUS_REGS);
+  for (uint8_t i = 0; i < MODBUS_DERIVED; i++)
+    respPrintf(PSTR("%s\"%s\""), i ? "," : "", modbus_derived[i]);
+  respPrint_P(PSTR("],\r\n\"system\":[\"uptime\",\"free_heap\",\"frames\",\"reinit\",\"requests\",\"rssi\"]\r\n}\r\n"));
+  respEnd();
+}
@@ -0,0 +1,69 @@
+// **********************************************************************************
+// ESP8266 Teleinfo Modbus TCP server Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef MODBUS_H
+#define MODBUS_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Read only Modbus TCP server, function 03 and 04 give same registers.
+// Each value is 32 bits, high word first, 0xFFFFFFFF when not available
+//   0..    teleinfo label ID * 2 (see /labels.json)
+//   100..  derived values, in order of modbus_derived[]
+//   200..  system counters
+// Non numeric OPTARIF, PTEC and HHPHC get emoncms numeric codes
+#define MODBUS_PORT         502
+#define MODBUS_CLIENTS      4       // concurrent masters
+#define MODBUS_IDLE_MS      60000   // idle master is dropped
+#define MODBUS_RX_SIZE      16      // read requests are 12 bytes
+#define MODBUS_MAX_READ     125     // registers per request
+
+#define MODBUS_REG_TINFO    0
+#define MODBUS_REG_DERIVED  100
+#define MODBUS_REG_SYSTEM   200
+#define MODBUS_REGS         (MODBUS_REG_SYSTEM + 2 * 6)
+#define MODBUS_NA           0xFFFFFFFFUL
+
+// Exceptions
+#define MODBUS_EX_FUNCTION  0x01
+#define MODBUS_EX_ADDRESS   0x02
+#define MODBUS_EX_VALUE     0x03
+
+// One connected master
+typedef struct
+{
+  WiFiClient    client;
+  uint8_t       rx[MODBUS_RX_SIZE];
+  uint8_t       len;          // bytes in rx
+  uint16_t      skip;         // bytes of a too long request to drop
+  unsigned long last;         // millis() of last request
+} _modbusClient;
+
+// declared exported function from modbus.cpp
+// ===================================================
+void modbusInit(void);
+void modbusFrame(void);
+void modbusHandle(void);
+void modbusJSONTable(void);
+
+#endif
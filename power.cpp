@@ -0,0 +1,148 @@
+// **********************************************************************************
+// ESP8266 Teleinfo active power estimation
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "power.h"
+
+// Energy indexes (Wh), only one is counting at a time depending on
+// tarif period, so sum of increments of all is the consumption
+const int8_t power_ids[] = {
+  LABEL_BASE, LABEL_HCHC, LABEL_HCHP, LABEL_EJPHN, LABEL_EJPHPM,
+  LABEL_BBRHCJB, LABEL_BBRHCJB + 1, LABEL_BBRHCJB + 2, LABEL_BBRHCJB + 3, LABEL_BBRHCJB + 4, LABEL_BBRHCJB + 5
+};
+#define POWER_INDEXES (sizeof(power_ids)/sizeof(power_ids[0]))
+
+uint32_t      power_index[POWER_INDEXES];   // last value of each index
+uint16_t      power_seen = 0;               // bit set when index known
+uint32_t      power_pending = 0;            // Wh counted in current frame
+unsigned long power_inc_ms = 0;             // millis() of last increment
+unsigned long power_interval = 0;           // ms between 2 last increments
+unsigned long power_frame_ms = 0;           // millis() of last frame
+float         power_raw = 0;                // last unsmoothed power (W)
+float         power_watt = 0;
+bool          power_valid = false;
+
+/* ======================================================================
+Function: powerData
+Purpose : account energy index new value
+Input   : label ID of value just added or updated
+Output  : -
+Comments: called from teleinfo data callback, only for changed values
+====================================================================== */
+void powerData(int8_t id)
+{
+  uint8_t i;
+
+  for (i = 0; i < POWER_INDEXES; i++) {
+    if (id == power_ids[i])
+      break;
+  }
+  if (i >= POWER_INDEXES)
+    return;
+
+  uint32_t wh = valueInt(id);
+
+  // Index seen again (also after teleinfo reinit), count increment
+  if (power_seen & (1 << i)) {
+    uint32_t delta;
+
+    if (wh >= power_index[i])
+      delta = wh - power_index[i];
+    else
+      delta = wh + POWER_INDEX_WRAP - power_index[i];   // counter wrap
+
+    if (delta <= POWER_MAX_DELTA_WH)
+      power_pending += delta;
+    else
+      Debugf("Power: %s jump %u => %u ignored\r\n", tabnames[id], power_index[i], wh);
+  }
+
+  power_index[i] = wh;
+  power_seen |= (1 << i);
+}
+
+/* ======================================================================
+Function: powerFrame
+Purpose : update power estimation at end of frame
+Input   : -
+Output  : -
+Comments: power is Wh increment over time since previous increment,
+          with 1 Wh resolution the value between increments can't be
+          higher than 1 Wh over elapsed time, so it goes down when
+          consumption stops. Result is smoothed with config.power_tau
+====================================================================== */
+void powerFrame(void)
+{
+  unsigned long now = millis();
+  unsigned long dt = power_frame_ms ? now - power_frame_ms : 0;
+
+  power_frame_ms = now;
+
+  if (power_pending) {
+    // First increment only gives the time reference
+    if (power_inc_ms) {
+      power_interval = now - power_inc_ms;
+      if (power_interval)
+        power_raw = power_pending * 3600000.0 / power_interval;
+      power_valid = true;
+    }
+    power_inc_ms = now;
+    power_pending = 0;
+  } else if (power_valid) {
+    unsigned long elapsed = now - power_inc_ms;
+
+    if (elapsed >= POWER_TIMEOUT) {
+      power_raw = 0;
+    } else if (elapsed > power_interval) {
+      float max = 3600000.0 / elapsed;
+      if (power_raw > max)
+        power_raw = max;
+    }
+  }
+
+  if (!power_valid)
+    return;
+
+  // First order low pass filter, time constant in seconds
+  if (config.power_tau && dt)
+    power_watt += (power_raw - power_watt) * dt / (config.power_tau * 1000.0 + dt);
+  else
+    power_watt = power_raw;
+}
+
+/* ======================================================================
+Function: powerLabel
+Purpose : get active power as virtual teleinfo label
+Input   : label number (0..)
+          name buffer (at least 16 chars)
+          value buffer (at least 16 chars)
+Output  : false when no more label
+Comments: _PACT is active power in W
+====================================================================== */
+bool powerLabel(uint8_t n, char * name, char * value)
+{
+  if (n || !power_valid)
+    return false;
+
+  strcpy_P(name, PSTR("_PACT"));
+  sprintf_P(value, PSTR("%u"), (unsigned int) (power_watt + 0.5));
+  return true;
+}
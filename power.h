@@ -0,0 +1,48 @@
+// **********************************************************************************
+// ESP8266 Teleinfo active power estimation Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef POWER_H
+#define POWER_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Energy indexes have 9 digits (Wh), they wrap to 0 after this
+#define POWER_INDEX_WRAP   1000000000UL
+// Index increment bigger than this between two frames is not
+// consumption (index reset, corrupted frame), baseline is reset
+#define POWER_MAX_DELTA_WH 1000
+// No increment for this time, power is 0 (ms)
+#define POWER_TIMEOUT      3600000UL
+
+// Exported variables
+// ===================================================
+extern float    power_watt;       // smoothed active power (W)
+extern bool     power_valid;      // true once 2 increments seen
+
+// declared exported function from power.cpp
+// ===================================================
+void powerData(int8_t id);
+void powerFrame(void);
+bool powerLabel(uint8_t n, char * name, char * value);
+
+#endif
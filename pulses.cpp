@@ -0,0 +1,282 @@
+// **********************************************************************************
+// ESP8266 Teleinfo S0 pulse counters
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "pulses.h"
+
+// Totals saved into RTC memory and SPIFFS
+typedef struct
+{
+  uint32_t magic;
+  uint32_t total[CFG_PULSE_MAX];
+} _pulseSave;
+
+_pulse    pulses[CFG_PULSE_MAX];
+uint8_t   pulses_count = 0;
+uint32_t  pulses_saved[CFG_PULSE_MAX];  // totals last written to SPIFFS
+unsigned long pulses_save_s = 0;
+
+/* ======================================================================
+Function: pulseEdge
+Purpose : count one pulse
+Input   : counter number
+Output  : -
+Comments: runs in interrupt context, keep it short
+====================================================================== */
+void ICACHE_RAM_ATTR pulseEdge(uint8_t i)
+{
+  _pulse * p = &pulses[i];
+  uint32_t now = micros();
+  uint32_t period = now - p->last_us;
+
+  if (p->count && period < PULSE_MIN_US) {
+    p->glitch++;
+    return;
+  }
+
+  p->period_us = p->count ? period : 0;
+  p->last_us = now;
+  p->count++;
+}
+
+void ICACHE_RAM_ATTR pulseISR0(void) { pulseEdge(0); }
+void ICACHE_RAM_ATTR pulseISR1(void) { pulseEdge(1); }
+
+void (* const pulses_isr[CFG_PULSE_MAX])(void) = { pulseISR0, pulseISR1 };
+
+/* ======================================================================
+Function: pulsesLoad
+Purpose : restore totals saved before reboot
+Input   : -
+Output  : -
+Comments: RTC memory (soft reset, OTA) is more recent than SPIFFS
+          (power loss), keep the biggest of both
+====================================================================== */
+void pulsesLoad(void)
+{
+  _pulseSave rtc, file;
+
+  memset(&file, 0, sizeof(file));
+  File f = SPIFFS.open(PULSE_FILE, "r");
+  if (f) {
+    if (f.read((uint8_t *) &file, sizeof(file)) != sizeof(file) || file.magic != PULSE_MAGIC)
+      memset(&file, 0, sizeof(file));
+    f.close();
+  }
+
+  if (!system_rtc_mem_read(PULSE_RTC_BLOCK, &rtc, sizeof(rtc)) || rtc.magic != PULSE_MAGIC)
+    memset(&rtc, 0, sizeof(rtc));
+
+  for (uint8_t i = 0; i < CFG_PULSE_MAX; i++) {
+    pulses_saved[i] = file.total[i];
+    pulses[i].base = rtc.total[i] > file.total[i] ? rtc.total[i] : file.total[i];
+  }
+}
+
+/* ======================================================================
+Function: pulsesInit
+Purpose : setup configured pulse counters
+Input   : -
+Output  : -
+Comments: GPIO already used by a dry contact input are skipped
+====================================================================== */
+void pulsesInit(void)
+{
+  uint32_t base[CFG_PULSE_MAX];
+  static bool loaded = false;
+
+  if (!loaded) {
+    pulsesLoad();
+    loaded = true;
+  }
+
+  // Keep totals when called again after configuration change
+  for (uint8_t i = 0; i < CFG_PULSE_MAX; i++)
+    base[i] = pulseTotal(i);
+
+  for (uint8_t i = 0; i < pulses_count; i++) {
+    bool used = false;
+    for (uint8_t j = 0; j < inputs_count; j++)
+      used |= inputs[j].pin == pulses[i].pin;
+    // pin may just have been taken by a switch
+    if (pulses[i].pin && !used)
+      detachInterrupt(pulses[i].pin);
+  }
+  pulses_count = 0;
+
+  for (uint8_t i = 0; i < CFG_PULSE_MAX; i++) {
+    uint8_t pin = config.pulses.pin[i];
+    _pulse * p = &pulses[i];
+
+    memset(p, 0, sizeof(_pulse));
+    p->base = base[i];
+
+    if (!INPUT_PIN_OK(pin))
+      continue;
+
+    bool used = false;
+    for (uint8_t j = 0; j < inputs_count; j++)
+      used |= inputs[j].pin == pin;
+    if (used) {
+      Debugf("Pulse %d GPIO%d already used by a switch\r\n", i + 1, pin);
+      continue;
+    }
+
+    p->pin = pin;
+    pinMode(pin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(pin), pulses_isr[i], FALLING);
+    Debugf("Pulse %d on GPIO%d total %u\r\n", i + 1, pin, p->base);
+    pulses_count = i + 1;
+  }
+}
+
+/* ======================================================================
+Function: pulseTotal
+Purpose : get total number of pulses of a counter
+Input   : counter number
+Output  : total, including pulses counted before reboot
+Comments: -
+====================================================================== */
+uint32_t pulseTotal(uint8_t i)
+{
+  return pulses[i].base + pulses[i].count;
+}
+
+/* ======================================================================
+Function: pulseRate
+Purpose : get instantaneous rate of a counter
+Input   : counter number
+Output  : pulses per hour
+Comments: computed from the last inter-pulse interval, or from the time
+          since last pulse when it's longer so rate goes down when flow
+          stops
+====================================================================== */
+uint32_t pulseRate(uint8_t i)
+{
+  _pulse * p = &pulses[i];
+  uint32_t period, since;
+
+  noInterrupts();
+  period = p->period_us;
+  since = micros() - p->last_us;
+  interrupts();
+
+  // micros() wraps every 71 minutes, use uptime for long silences
+  if (!period || seconds - p->last_s >= PULSE_RATE_TIMEOUT)
+    return 0;
+
+  if (since > period)
+    period = since;
+
+  return (uint32_t) (3600000000ULL / period);
+}
+
+/* ======================================================================
+Function: pulsesSave
+Purpose : save totals into RTC memory, and SPIFFS if needed
+Input   : true to write SPIFFS
+Output  : -
+Comments: -
+====================================================================== */
+void pulsesSave(bool to_file)
+{
+  _pulseSave save;
+  bool changed = false;
+
+  save.magic = PULSE_MAGIC;
+  for (uint8_t i = 0; i < CFG_PULSE_MAX; i++) {
+    save.total[i] = pulseTotal(i);
+    changed |= save.total[i] != pulses_saved[i];
+  }
+
+  system_rtc_mem_write(PULSE_RTC_BLOCK, &save, sizeof(save));
+
+  if (to_file && changed) {
+    File f = SPIFFS.open(PULSE_FILE, "w");
+    if (f) {
+      f.write((const uint8_t *) &save, sizeof(save));
+      f.close();
+      memcpy(pulses_saved, save.total, sizeof(pulses_saved));
+    }
+  }
+}
+
+/* ======================================================================
+Function: pulsesHandle
+Purpose : follow pulse counters, save totals
+Input   : -
+Output  : -
+Comments: called every second from main loop
+====================================================================== */
+void pulsesHandle(void)
+{
+  static uint32_t last_count[CFG_PULSE_MAX];
+
+  if (!pulses_count)
+    return;
+
+  for (uint8_t i = 0; i < pulses_count; i++) {
+    if (pulses[i].count != last_count[i]) {
+      last_count[i] = pulses[i].count;
+      pulses[i].last_s = seconds;
+    }
+  }
+
+  pulsesSave(seconds - pulses_save_s >= PULSE_SAVE_PERIOD);
+  if (seconds - pulses_save_s >= PULSE_SAVE_PERIOD)
+    pulses_save_s = seconds;
+}
+
+/* ======================================================================
+Function: pulseLabel
+Purpose : get pulse counters as virtual teleinfo labels
+Input   : label number (0..)
+          name buffer (at least 16 chars)
+          value buffer (at least 16 chars)
+Output  : false when no more label
+Comments: _PULSEx is the total, _PRATEx the rate in pulses per hour
+====================================================================== */
+bool pulseLabel(uint8_t n, char * name, char * value)
+{
+  uint8_t k = n / 2;
+  uint8_t i;
+
+  // k-th configured counter
+  for (i = 0; i < pulses_count; i++) {
+    if (!pulses[i].pin)
+      continue;
+    if (!k)
+      break;
+    k--;
+  }
+
+  if (i >= pulses_count)
+    return false;
+
+  if (n & 1) {
+    sprintf_P(name, PSTR("_PRATE%d"), i + 1);
+    sprintf_P(value, PSTR("%u"), pulseRate(i));
+  } else {
+    sprintf_P(name, PSTR("_PULSE%d"), i + 1);
+    sprintf_P(value, PSTR("%u"), pulseTotal(i));
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+// **********************************************************************************
+// ESP8266 Teleinfo S0 pulse counters Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef PULSES_H
+#define PULSES_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Edges closer than this are glitches (us), allows up to 2 KHz
+#define PULSE_MIN_US       500
+// No pulse for this time, rate is 0 (s)
+#define PULSE_RATE_TIMEOUT 3600
+// Totals saved to SPIFFS every PULSE_SAVE_PERIOD seconds if changed
+#define PULSE_SAVE_PERIOD  600
+#define PULSE_FILE         "/pulses.dat"
+// RTC user memory block keeping totals across soft resets
+// (block 64 and following are used by bootloader)
+#define PULSE_RTC_BLOCK    100
+#define PULSE_MAGIC        0x53305030
+
+// One S0 pulse counter
+typedef struct
+{
+  uint8_t  pin;                 // GPIO
+  volatile uint32_t count;      // pulses since boot
+  volatile uint32_t last_us;    // micros() of last pulse
+  volatile uint32_t period_us;  // interval between two last pulses
+  volatile uint32_t glitch;     // edges ignored
+  unsigned long last_s;         // uptime (s) of last pulse seen by loop
+  uint32_t base;                // total at boot (restored)
+} _pulse;
+
+// Exported variables
+// ===================================================
+extern _pulse  pulses[];
+extern uint8_t pulses_count;
+
+// declared exported function from pulses.cpp
+// ===================================================
+void     pulsesInit(void);
+void     pulsesHandle(void);
+uint32_t pulseTotal(uint8_t i);
+uint32_t pulseRate(uint8_t i);
+bool     pulseLabel(uint8_t n, char * name, char * value);
+
+#endif
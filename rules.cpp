@@ -0,0 +1,674 @@
+// **********************************************************************************
+// ESP8266 Teleinfo rule engine
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "rules.h"
+
+_rule    rules[RULES_MAX];
+uint8_t  rules_count = 0;
+uint32_t rules_notify = 0;       // bit set when rule http action pending
+char     rules_pool[RULES_POOL_SIZE];
+uint16_t rules_pool_idx = 0;
+
+// Compilation errors, first one is kept
+uint8_t  rules_errors = 0;
+uint8_t  rules_error_line = 0;
+PGM_P    rules_error = NULL;
+
+// Evaluation cost per frame (us)
+uint32_t rules_frames = 0;
+uint32_t rules_us_last = 0;
+uint32_t rules_us_max = 0;
+uint32_t rules_us_sum = 0;
+
+// Result of rulesCheck() at boot
+bool     rules_checked = false;
+
+const char * const rules_ops[] = { ">", "<", ">=", "<=", "==", "!=", "changed" };
+const char * const rules_acts[] = { "log", "http", "gpio" };
+
+/* ======================================================================
+Function: rulesPoolAdd
+Purpose : keep a string in rules pool
+Input   : string
+Output  : offset in pool, 0 if pool is full
+Comments: offset 0 is the empty string
+====================================================================== */
+uint16_t rulesPoolAdd(const char * str)
+{
+  size_t len = strlen(str) + 1;
+
+  if (!rules_pool_idx)
+    rules_pool[rules_pool_idx++] = '\0';
+
+  if (rules_pool_idx + len > RULES_POOL_SIZE)
+    return 0;
+
+  memcpy(rules_pool + rules_pool_idx, str, len);
+  rules_pool_idx += len;
+  return rules_pool_idx - len;
+}
+
+/* ======================================================================
+Function: rulesMilli
+Purpose : parse a decimal number into 1/1000 units
+Input   : string
+          where to put value
+Output  : pointer after number, NULL if not a number
+Comments: 3 decimals max, "0.9" gives 900. Integer part is clamped
+          above RULES_VALUE_MAX so caller can reject it
+====================================================================== */
+const char * rulesMilli(const char * p, int64_t * value)
+{
+  bool neg = (*p == '-');
+  int64_t v = 0;
+  uint16_t div = 1000;
+
+  if (neg)
+    p++;
+  if (!isdigit(*p))
+    return NULL;
+
+  while (isdigit(*p)) {
+    v = v * 10 + (*p++ - '0');
+    if (v > RULES_VALUE_MAX)
+      v = RULES_VALUE_MAX + 1;
+  }
+  v *= 1000;
+
+  if (*p == '.') {
+    p++;
+    while (isdigit(*p)) {
+      div /= 10;
+      v += (*p++ - '0') * div;
+    }
+  }
+  *value = neg ? -v : v;
+  return p;
+}
+
+/* ======================================================================
+Function: rulesLabel
+Purpose : resolve a label of a rule once
+Input   : label name
+          where to put label ID
+          where to put pool offset of a virtual label name
+Output  : NULL if ok, else error message
+Comments: teleinfo labels are kept as ID, only virtual ones (_PACT,
+          _PULSE1, stats...) keep their name as they are built on
+          request
+====================================================================== */
+PGM_P rulesLabel(const char * name, int8_t * id, uint16_t * vname)
+{
+  if (strlen(name) > 15)
+    return PSTR("bad label");
+
+  *id = tinfoLabelId(name);
+  if (*id >= 0)
+    return NULL;
+  if (*name != '_')
+    return PSTR("unknown label");
+
+  *id = RULE_VIRTUAL;
+  *vname = rulesPoolAdd(name);
+  return *vname ? NULL : PSTR("no more memory");
+}
+
+/* ======================================================================
+Function: rulesName
+Purpose : name of a rule label
+Input   : label ID
+          pool offset of virtual label name
+Output  : name, empty for a constant
+Comments: -
+====================================================================== */
+const char * rulesName(int8_t id, uint16_t vname)
+{
+  if (id >= 0)
+    return tabnames[id];
+  return id == RULE_VIRTUAL ? rules_pool + vname : "";
+}
+
+/* ======================================================================
+Function: rulesCompile
+Purpose : compile one line of rules source
+Input   : line (modified)
+Output  : NULL if ok (or empty line), else error message
+Comments: LABEL OP VALUE [for Ns] [hyst H] => ACTION [ARG]
+          LABEL changed => ACTION [ARG]
+          VALUE is a number, a label, or number*label
+====================================================================== */
+PGM_P rulesCompile(char * line)
+{
+  char * save;
+  char * tok;
+  char * act;
+  PGM_P err;
+  _rule r;
+
+  // Comments and blank lines
+  if ((tok = strchr(line, '#')))
+    *tok = '\0';
+  tok = line + strspn(line, " \t\r");
+  if (!*tok)
+    return NULL;
+
+  if (rules_count >= RULES_MAX)
+    return PSTR("too many rules");
+
+  act = strstr(line, "=>");
+  if (!act)
+    return PSTR("missing =>");
+  *act = '\0';
+  act += 2;
+
+  memset(&r, 0, sizeof(r));
+  r.ref = RULE_CONST;
+
+  // Left label
+  tok = strtok_r(line, " \t\r", &save);
+  if (!tok)
+    return PSTR("bad label");
+  if ((err = rulesLabel(tok, &r.label, &r.vlabel)))
+    return err;
+
+  // Operator
+  tok = strtok_r(NULL, " \t\r", &save);
+  if (!tok)
+    return PSTR("missing operator");
+  for (r.op = 0; r.op <= RULE_OP_CHANGED; r.op++) {
+    if (!strcmp(tok, rules_ops[r.op]))
+      break;
+  }
+  if (r.op > RULE_OP_CHANGED)
+    return PSTR("bad operator");
+
+  // Right value
+  if (r.op != RULE_OP_CHANGED) {
+    const char * p;
+
+    tok = strtok_r(NULL, " \t\r", &save);
+    if (!tok)
+      return PSTR("missing value");
+
+    p = rulesMilli(tok, &r.k);
+    if (p && *p == '*')
+      p++;
+    else if (!p) {
+      r.k = 1000;
+      p = tok;
+    }
+    if (*p) {
+      if (r.k > RULES_MUL_MAX * 1000LL || r.k < -RULES_MUL_MAX * 1000LL)
+        return PSTR("multiplier too big");
+      if ((err = rulesLabel(p, &r.ref, &r.vref)))
+        return err;
+    } else if (r.k > RULES_VALUE_MAX * 1000 || r.k < -RULES_VALUE_MAX * 1000) {
+      return PSTR("value too big");
+    }
+  }
+
+  // Options
+  while ((tok = strtok_r(NULL, " \t\r", &save))) {
+    char * arg = strtok_r(NULL, " \t\r", &save);
+
+    if (!arg)
+      return PSTR("missing option value");
+    if (!strcmp_P(tok, PSTR("for")))
+      r.hold = atoi(arg);
+    else if (!strcmp_P(tok, PSTR("hyst")) && rulesMilli(arg, &r.hyst)) {
+      r.hyst = r.hyst < 0 ? -r.hyst : r.hyst;
+      if (r.hyst > RULES_VALUE_MAX * 1000)
+        return PSTR("value too big");
+    } else
+      return PSTR("bad option");
+  }
+
+  // Action
+  tok = strtok_r(act, " \t\r", &save);
+  if (!tok)
+    return PSTR("missing action");
+  for (r.action = 0; r.action <= RULE_ACT_GPIO; r.action++) {
+    if (!strcmp(tok, rules_acts[r.action]))
+      break;
+  }
+  if (r.action > RULE_ACT_GPIO)
+    return PSTR("bad action");
+
+  tok = strtok_r(NULL, " \t\r", &save);
+  if (r.action == RULE_ACT_HTTP) {
+    if (!tok || *tok != '/')
+      return PSTR("bad URL");
+    r.url = rulesPoolAdd(tok);
+    if (!r.url)
+      return PSTR("no more memory");
+  } else if (r.action == RULE_ACT_GPIO) {
+    r.pin = tok ? atoi(tok) : 0;
+    if (!INPUT_PIN_OK(r.pin))
+      return PSTR("bad GPIO");
+    // Don't drive a pin used as input
+    for (uint8_t i = 0; i < inputs_count; i++) {
+      if (inputs[i].pin == r.pin)
+        return PSTR("GPIO used by input");
+    }
+    for (uint8_t i = 0; i < CFG_PULSE_MAX; i++) {
+      if (config.pulses.pin[i] == r.pin)
+        return PSTR("GPIO used by counter");
+    }
+    if (shedPin(r.pin))
+      return PSTR("GPIO used by shedding");
+  }
+
+  rules[rules_count++] = r;
+  return NULL;
+}
+
+/* ======================================================================
+Function: rulesInit
+Purpose : compile rules from SPIFFS
+Input   : -
+Output  : -
+Comments: without rules file, ADPS IDX of configuration gives the
+          previous Domoticz ADPS alert as a rule
+====================================================================== */
+void rulesInit(void)
+{
+  char line[256];
+  uint8_t lineno = 0;
+
+  // Release outputs of previous rules
+  for (uint8_t i = 0; i < rules_count; i++) {
+    if (rules[i].action == RULE_ACT_GPIO)
+      digitalWrite(rules[i].pin, LOW);
+  }
+
+  rules_count = 0;
+  rules_notify = 0;
+  rules_pool_idx = 0;
+  rules_errors = rules_error_line = 0;
+  rules_error = NULL;
+  rules_frames = rules_us_last = rules_us_max = rules_us_sum = 0;
+
+  File f = SPIFFS.open(RULES_FILE, "r");
+  if (f) {
+    while (f.available()) {
+      size_t len = f.readBytesUntil('\n', line, sizeof(line) - 1);
+      line[len] = '\0';
+      lineno++;
+
+      // Failed rule gives back its strings
+      uint16_t pool = rules_pool_idx;
+      PGM_P err = rulesCompile(line);
+      if (err) {
+        rules_pool_idx = pool;
+        if (!rules_errors++) {
+          rules_error_line = lineno;
+          rules_error = err;
+        }
+        Debugf("Rule line %d: ", lineno);
+        Debugln(FPSTR(err));
+      }
+    }
+    f.close();
+  } else if (config.httpReq.adpsidx) {
+    sprintf_P(line, PSTR("ADPS > 0 => http /json.htm?type=command&param=udevice&idx=%u&nvalue=4&svalue=%%ADPS%%"),
+              config.httpReq.adpsidx);
+    rulesCompile(line);
+  }
+
+  for (uint8_t i = 0; i < rules_count; i++) {
+    if (rules[i].action == RULE_ACT_GPIO) {
+      pinMode(rules[i].pin, OUTPUT);
+      digitalWrite(rules[i].pin, LOW);
+    }
+  }
+
+  Debugf("Rules %d compiled, %d errors, %d bytes pool\r\n", rules_count, rules_errors, rules_pool_idx);
+}
+
+/* ======================================================================
+Function: rulesNumber
+Purpose : get current numeric value of a rule label
+Input   : label ID
+          pool offset of virtual label name
+          where to put value
+Output  : false if label not in frame or not a number
+Comments: teleinfo values are read already parsed from value store,
+          only virtual ones are parsed from text
+====================================================================== */
+bool rulesNumber(int8_t id, uint16_t vname, int32_t * value)
+{
+  char buf[16];
+  char * end;
+  uint32_t num;
+
+  if (id >= 0) {
+    if (!valueNumber(id, num, false))
+      return false;
+    *value = num;
+    return true;
+  }
+
+  const char * name = rules_pool + vname;
+  if (!virtualValue(name, strlen(name), buf) || !*buf)
+    return false;
+  *value = strtol(buf, &end, 10);
+  return !*end;
+}
+
+/* ======================================================================
+Function: rulesCompare
+Purpose : compare a value to threshold of a rule
+Input   : rule
+          left value
+          right label value (unused for a constant)
+          where to put release condition (hysteresis)
+Output  : condition
+Comments: both sides in 1/1000, k is 1/1000 so k*ref is too
+====================================================================== */
+bool rulesCompare(_rule * r, int32_t value, int32_t ref, bool * release)
+{
+  int64_t lhs = (int64_t) value * 1000;
+  int64_t rhs = r->ref != RULE_CONST ? r->k * ref : r->k;
+
+  switch (r->op) {
+    case RULE_OP_GT: *release = lhs <= rhs - r->hyst; return lhs >  rhs;
+    case RULE_OP_GE: *release = lhs <  rhs - r->hyst; return lhs >= rhs;
+    case RULE_OP_LT: *release = lhs >= rhs + r->hyst; return lhs <  rhs;
+    case RULE_OP_LE: *release = lhs >  rhs + r->hyst; return lhs <= rhs;
+    case RULE_OP_EQ: *release = lhs != rhs; return lhs == rhs;
+    case RULE_OP_NE: *release = lhs == rhs; return lhs != rhs;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: rulesCond
+Purpose : evaluate condition of a rule
+Input   : rule
+          where to put release condition (hysteresis)
+Output  : condition
+Comments: no side effect except changed hash, a missing or non
+          numeric value is false and releases
+====================================================================== */
+bool rulesCond(_rule * r, bool * release)
+{
+  *release = true;
+
+  if (r->op == RULE_OP_CHANGED) {
+    char buf[16];
+    const char * v;
+
+    if (r->label >= 0)
+      v = valueText(r->label);
+    else {
+      const char * name = rules_pool + r->vlabel;
+      v = virtualValue(name, strlen(name), buf) ? buf : NULL;
+    }
+    if (!v)
+      return false;
+
+    // FNV-1a, 0 means no previous value
+    uint32_t h = 2166136261UL;
+    while (*v)
+      h = (h ^ (uint8_t) *v++) * 16777619UL;
+    h |= 1;
+    bool changed = r->hash && h != r->hash;
+    r->hash = h;
+    return changed;
+  }
+
+  int32_t value;
+  int32_t ref = 0;
+
+  if (!rulesNumber(r->label, r->vlabel, &value))
+    return false;
+  if (r->ref != RULE_CONST && !rulesNumber(r->ref, r->vref, &ref))
+    return false;
+
+  return rulesCompare(r, value, ref, release);
+}
+
+/* ======================================================================
+Function: rulesCheck
+Purpose : check threshold scaling on device
+Input   : -
+Output  : true if ok
+Comments: done once at boot, result is in /rules.json.
+          IINST >= 0.9*ISOUSC with ISOUSC 30 must trip at 27 A, not
+          1 A, and a 9 digits index threshold must stay exact
+====================================================================== */
+bool rulesCheck(void)
+{
+  _rule r;
+  bool release;
+  bool ok;
+
+  memset(&r, 0, sizeof(r));
+  r.op = RULE_OP_GE;
+  r.ref = LABEL_ISOUSC;
+  ok = rulesMilli("0.9", &r.k) && r.k == 900
+       && !rulesCompare(&r, 1, 30, &release)
+       && !rulesCompare(&r, 26, 30, &release)
+       && rulesCompare(&r, 27, 30, &release);
+
+  // BASE > 123456789
+  r.op = RULE_OP_GT;
+  r.ref = RULE_CONST;
+  ok = ok && rulesMilli("123456789", &r.k)
+       && !rulesCompare(&r, 123456789, 0, &release)
+       && rulesCompare(&r, 123456790, 0, &release);
+
+  rules_checked = ok;
+  if (!ok)
+    Logf(LOG_ERR, "Rules check failed\r\n");
+  return ok;
+}
+
+/* ======================================================================
+Function: rulesAction
+Purpose : do action of a rule
+Input   : rule number
+          true when rule becomes active, false when released
+Output  : -
+Comments: http is done later from main loop, we may be in teleinfo
+          callback there
+====================================================================== */
+void rulesAction(uint8_t i, bool on)
+{
+  _rule * r = &rules[i];
+
+  if (on)
+    r->fired++;
+
+  if (r->action == RULE_ACT_GPIO)
+    digitalWrite(r->pin, on ? HIGH : LOW);
+  else if (r->action == RULE_ACT_HTTP && on)
+    rules_notify |= (1UL << i);
+
+  Debugf("Rule %d %s %s\r\n", i + 1, rulesName(r->label, r->vlabel), on ? "ON" : "OFF");
+}
+
+/* ======================================================================
+Function: rulesFrame
+Purpose : evaluate all rules against frame just received
+Input   : -
+Output  : -
+Comments: called at end of each teleinfo frame
+====================================================================== */
+void rulesFrame(void)
+{
+  unsigned long start = micros();
+  unsigned long now = millis();
+
+  for (uint8_t i = 0; i < rules_count; i++) {
+    _rule * r = &rules[i];
+    bool release;
+    bool cond = rulesCond(r, &release);
+
+    // Event, no state
+    if (r->op == RULE_OP_CHANGED) {
+      if (cond)
+        rulesAction(i, true);
+      continue;
+    }
+
+    switch (r->state) {
+      case RULE_IDLE:
+        if (!cond)
+          break;
+        r->state = RULE_HOLD;
+        r->since = now;
+        // no break, hold may be 0
+      case RULE_HOLD:
+        if (!cond)
+          r->state = RULE_IDLE;
+        else if (now - r->since >= r->hold * 1000UL) {
+          r->state = RULE_ACTIVE;
+          rulesAction(i, true);
+        }
+        break;
+      case RULE_ACTIVE:
+        if (release) {
+          r->state = RULE_IDLE;
+          rulesAction(i, false);
+        }
+        break;
+    }
+  }
+
+  rules_us_last = micros() - start;
+  if (rules_us_last > rules_us_max)
+    rules_us_max = rules_us_last;
+  rules_us_sum += rules_us_last;
+  rules_frames++;
+}
+
+/* ======================================================================
+Function: rulesHandle
+Purpose : do one pending http action
+Input   : -
+Output  : -
+Comments: called from main loop, one request per loop
+====================================================================== */
+void rulesHandle(void)
+{
+  uint8_t i;
+
+  for (i = 0; i < rules_count; i++) {
+    if (rules_notify & (1UL << i))
+      break;
+  }
+  if (i >= rules_count) {
+    rules_notify = 0;
+    return;
+  }
+  rules_notify &= ~(1UL << i);
+
+  if (!*config.httpReq.host)
+    return;
+
+  arenaReset();
+  char * url = (char *) arenaAlloc(HTTP_URL_SIZE);
+
+  if (url && urlExpand(rules_pool + rules[i].url, url, HTTP_URL_SIZE))
+    httpPost(config.httpReq.host, config.httpReq.port ? config.httpReq.port : 80, url,
+             config.httpReq.tls, config.tls_fp);
+  else
+    DebuglnF("rulesHandle: URL too long");
+  arenaReset();
+}
+
+/* ======================================================================
+Function: rulesSave
+Purpose : save new rules source and compile it
+Input   : rules source
+Output  : false if too big or not written
+Comments: empty source removes file
+====================================================================== */
+bool rulesSave(const String & text)
+{
+  bool ret = textFileSave(RULES_FILE, text, RULES_TEXT_SIZE);
+
+  rulesInit();
+  return ret;
+}
+
+/* ======================================================================
+Function: rulesJSONTable
+Purpose : dump rules state and evaluation cost in JSON
+Input   : -
+Output  : -
+Comments: /rules.json?bench=N evaluates N times all conditions and
+          gives time taken, actions are not done
+====================================================================== */
+void rulesJSONTable(void)
+{
+  char err[32];
+
+  *err = '\0';
+  if (rules_error)
+    strncpy_P(err, rules_error, sizeof(err) - 1);
+  err[sizeof(err) - 1] = '\0';
+
+  respBegin(200, "text/json");
+  respPrintf(PSTR("{\r\n\"count\":%d,\"errors\":%d,\"error_line\":%d,\"error\":\"%s\",\"check\":%d,\r\n"),
+             rules_count, rules_errors, rules_error_line, err, rules_checked);
+  respPrintf(PSTR("\"frames\":%u,\"us_last\":%u,\"us_max\":%u,\"us_avg\":%u,\r\n"),
+             rules_frames, rules_us_last, rules_us_max, rules_frames ? rules_us_sum / rules_frames : 0);
+
+  if (server.hasArg("bench")) {
+    uint32_t passes = server.arg("bench").toInt();
+    bool release;
+    uint32_t hash;
+
+    if (passes < 1 || passes > 10000)
+      passes = 1000;
+
+    unsigned long start = micros();
+    for (uint32_t p = 0; p < passes; p++) {
+      for (uint8_t i = 0; i < rules_count; i++) {
+        // Keep changed state as it was
+        hash = rules[i].hash;
+        rulesCond(&rules[i], &release);
+        rules[i].hash = hash;
+      }
+      if (!(p & 255))
+        yield();
+    }
+    uint32_t us = micros() - start;
+    uint32_t ns = (uint64_t) us * 1000 / passes;
+
+    respPrintf(PSTR("\"bench\":{\"passes\":%u,\"us\":%u,\"ns_pass\":%u,\"ns_rule\":%u},\r\n"),
+               passes, us, ns, rules_count ? ns / rules_count : 0);
+  }
+
+  respPrint_P(PSTR("\"rules\":[\r\n"));
+  for (uint8_t i = 0; i < rules_count; i++) {
+    _rule * r = &rules[i];
+    respPrintf(PSTR("%s{\"label\":\"%s\",\"op\":\"%s\",\"ref\":\"%s\",\"k\":%lld,\"hold\":%u,\"hyst\":%lld,"
+                    "\"action\":\"%s\",\"state\":%d,\"fired\":%u}"),
+               i ? ",\r\n" : "", rulesName(r->label, r->vlabel), rules_ops[r->op], rulesName(r->ref, r->vref), (long long) r->k,
+               r->hold, (long long) r->hyst, rules_acts[r->action], r->state, r->fired);
+  }
+  respPrint_P(PSTR("\r\n]\r\n}\r\n"));
+  respEnd();
+}
@@ -0,0 +1,101 @@
+// **********************************************************************************
+// ESP8266 Teleinfo rule engine Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef RULES_H
+#define RULES_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Rules source, one rule per line, '#' starts a comment
+//   PAPP > 6000 for 10s hyst 500 => gpio 13
+//   IINST > 0.9*ISOUSC => http /json.htm?type=command&param=udevice&idx=12&svalue=%IINST%
+//   PTEC changed => http /json.htm?type=command&param=udevice&idx=13&svalue=%PTEC%
+#define RULES_FILE      "/rules.txt"
+#define RULES_MAX       16    // compiled rules
+#define RULES_POOL_SIZE 768   // labels and URLs of all rules
+#define RULES_TEXT_SIZE 1536  // max size of rules file
+// Limits of constants, so scaled values fit in 64 bits with a 9
+// digits index on left side
+#define RULES_VALUE_MAX 999999999999LL  // constant threshold
+#define RULES_MUL_MAX   1000            // multiplier of a label
+
+// Operators
+#define RULE_OP_GT      0
+#define RULE_OP_LT      1
+#define RULE_OP_GE      2
+#define RULE_OP_LE      3
+#define RULE_OP_EQ      4
+#define RULE_OP_NE      5
+#define RULE_OP_CHANGED 6
+
+// Actions
+#define RULE_ACT_LOG    0
+#define RULE_ACT_HTTP   1
+#define RULE_ACT_GPIO   2
+
+// Side of a condition that is not a teleinfo label ID
+#define RULE_CONST      -1  // constant, right side only
+#define RULE_VIRTUAL    -2  // virtual label, found by name
+
+// States
+#define RULE_IDLE       0   // condition false
+#define RULE_HOLD       1   // condition true, waiting for hold time
+#define RULE_ACTIVE     2   // action done, waiting for release
+
+// Compiled rule, values are compared in 1/1000 units so 0.9*ISOUSC
+// or decimal thresholds need no float
+typedef struct
+{
+  int8_t    label;          // left label ID or RULE_VIRTUAL
+  int8_t    ref;            // right label ID, RULE_VIRTUAL or RULE_CONST
+  uint16_t  vlabel;         // pool offset of left virtual label name
+  uint16_t  vref;           // pool offset of right virtual label name
+  uint16_t  url;            // pool offset of http action URL
+  uint8_t   op;
+  uint8_t   action;
+  uint8_t   pin;            // gpio action
+  uint8_t   state;
+  uint16_t  hold;           // condition must stay true (s)
+  int64_t   k;              // threshold or multiplier of ref (1/1000)
+  int64_t   hyst;           // hysteresis (1/1000)
+  uint32_t  hash;           // last value hash for changed
+  unsigned long since;      // millis() when condition became true
+  uint16_t  fired;          // times action was done
+} _rule;
+
+// Exported variables
+// ===================================================
+extern _rule    rules[];
+extern uint8_t  rules_count;
+extern uint32_t rules_notify;   // bit set when rule http action pending
+
+// declared exported function from rules.cpp
+// ===================================================
+void rulesInit(void);
+bool rulesCheck(void);
+void rulesFrame(void);
+void rulesHandle(void);
+bool rulesSave(const String & text);
+void rulesJSONTable(void);
+
+#endif
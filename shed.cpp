@@ -0,0 +1,252 @@
+// **********************************************************************************
+// ESP8266 Teleinfo load shedding
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "shed.h"
+
+_shedRelay    shed_relays[CFG_SHED_MAX];
+uint8_t       shed_count = 0;
+unsigned long shed_rx_us = 0;     // estimated arrival of last group end
+
+uint16_t shed_iinst[4];           // IINST (mono) or IINST1..3 (A)
+uint16_t shed_isousc = 0;         // subscribed current (A)
+bool     shed_adps = false;       // ADPS seen in current frame
+bool     shed_step = false;       // a relay changed in current frame
+uint8_t  shed_trip;
+uint8_t  shed_restore;
+uint32_t shed_min_off_ms;
+
+// Serial line to relay edge latency (us)
+uint32_t shed_lat_last = 0;
+uint32_t shed_lat_max = 0;
+uint32_t shed_lat_sum = 0;
+uint16_t shed_lat_n = 0;
+uint16_t shed_lat_late = 0;
+
+/* ======================================================================
+Function: shedInit
+Purpose : setup load shedding relays from configuration
+Input   : -
+Output  : -
+Comments: call after inputsInit() and pulsesInit(), their pins are
+          not driven
+====================================================================== */
+void shedInit(void)
+{
+  // Give back loads of previous configuration
+  for (uint8_t i = 0; i < shed_count; i++)
+    digitalWrite(shed_relays[i].pin, LOW);
+  shed_count = 0;
+  shed_step = false;
+
+  shed_trip = config.shed.trip ? config.shed.trip : CFG_SHED_DEFAULT_TRIP;
+  shed_restore = config.shed.restore ? config.shed.restore : CFG_SHED_DEFAULT_RESTORE;
+  if (shed_restore >= shed_trip)
+    shed_restore = shed_trip - 1;
+  shed_min_off_ms = 1000UL * (config.shed.min_off ? config.shed.min_off : CFG_SHED_DEFAULT_MINOFF);
+
+  for (uint8_t i = 0; i < CFG_SHED_MAX; i++) {
+    uint8_t pin = config.shed.pin[i];
+    bool used = false;
+
+    if (!INPUT_PIN_OK(pin))
+      continue;
+
+    for (uint8_t j = 0; j < inputs_count; j++)
+      used |= (inputs[j].pin == pin);
+    for (uint8_t j = 0; j < CFG_PULSE_MAX; j++)
+      used |= (config.pulses.pin[j] == pin);
+    if (used) {
+      Debugf("Shedding GPIO%d already used\r\n", pin);
+      continue;
+    }
+
+    _shedRelay * r = &shed_relays[shed_count++];
+    memset(r, 0, sizeof(_shedRelay));
+    r->pin = pin;
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+    Debugf("Shedding relay %d on GPIO%d\r\n", shed_count, pin);
+  }
+}
+
+/* ======================================================================
+Function: shedPin
+Purpose : check if a GPIO is a load shedding relay
+Input   : GPIO
+Output  : true if used
+Comments: -
+====================================================================== */
+bool shedPin(uint8_t pin)
+{
+  for (uint8_t i = 0; i < shed_count; i++) {
+    if (shed_relays[i].pin == pin)
+      return true;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: shedSet
+Purpose : shed or restore a load
+Input   : relay number
+          true to shed
+Output  : -
+Comments: latency is taken just after GPIO edge
+====================================================================== */
+void shedSet(uint8_t i, bool off)
+{
+  _shedRelay * r = &shed_relays[i];
+
+  digitalWrite(r->pin, off ? HIGH : LOW);
+  shed_lat_last = micros() - shed_rx_us;
+
+  if (shed_lat_last > shed_lat_max)
+    shed_lat_max = shed_lat_last;
+  if (shed_lat_last > SHED_LATENCY_MAX)
+    shed_lat_late++;
+  shed_lat_sum += shed_lat_last;
+  shed_lat_n++;
+
+  r->off = off;
+  if (off) {
+    r->off_ms = millis();
+    r->count++;
+  }
+  shed_step = true;
+
+  Debugf("Shedding relay %d %s in %u us\r\n", i + 1, off ? "OFF" : "ON", shed_lat_last);
+}
+
+/* ======================================================================
+Function: shedCheck
+Purpose : shed or restore one load depending on current
+Input   : -
+Output  : -
+Comments: one change per frame, so the effect is seen in current value
+          before going further. Loads are shed in priority order and
+          restored in reverse order, after min off time and only when
+          current is below restore level (hysteresis)
+====================================================================== */
+void shedCheck(void)
+{
+  uint16_t iinst = 0;
+
+  if (!shed_count || shed_step)
+    return;
+
+  for (uint8_t i = 0; i < 4; i++) {
+    if (shed_iinst[i] > iinst)
+      iinst = shed_iinst[i];
+  }
+
+  if (shed_adps || (shed_isousc && (uint32_t) iinst * 100 >= (uint32_t) shed_isousc * shed_trip)) {
+    for (uint8_t i = 0; i < shed_count; i++) {
+      if (!shed_relays[i].off) {
+        shedSet(i, true);
+        return;
+      }
+    }
+  } else if (shed_isousc && (uint32_t) iinst * 100 <= (uint32_t) shed_isousc * shed_restore) {
+    for (int8_t i = shed_count - 1; i >= 0; i--) {
+      if (shed_relays[i].off) {
+        if (millis() - shed_relays[i].off_ms >= shed_min_off_ms)
+          shedSet(i, false);
+        return;
+      }
+    }
+  }
+}
+
+/* ======================================================================
+Function: shedData
+Purpose : account current values as soon as they are parsed
+Input   : label ID of value just added or updated
+Output  : -
+Comments: called from teleinfo data callback, only for changed values
+====================================================================== */
+void shedData(int8_t id)
+{
+  if (id == LABEL_IINST || (id >= LABEL_IINST1 && id < LABEL_IINST1 + 3)) {
+    uint8_t phase = id == LABEL_IINST ? 0 : id - LABEL_IINST1 + 1;
+
+    shed_iinst[phase] = valueInt(id);
+    shedCheck();
+  } else if (id == LABEL_ISOUSC) {
+    shed_isousc = valueInt(id);
+  }
+}
+
+/* ======================================================================
+Function: shedADPS
+Purpose : overload reported by meter
+Input   : phase number (0 for monophase)
+Output  : -
+Comments: called from teleinfo ADPS callback, sheds at once
+====================================================================== */
+void shedADPS(uint8_t phase)
+{
+  shed_adps = true;
+  shedCheck();
+}
+
+/* ======================================================================
+Function: shedFrame
+Purpose : end of frame processing
+Input   : -
+Output  : -
+Comments: values which didn't change are checked again there, restore
+          after min off time is done there too
+====================================================================== */
+void shedFrame(void)
+{
+  shedCheck();
+  shed_adps = false;
+  shed_step = false;
+}
+
+/* ======================================================================
+Function: shedJSONTable
+Purpose : dump load shedding state and latency in JSON
+Input   : -
+Output  : -
+Comments: latency is from serial reception of the group end which
+          triggered the change to GPIO edge, it includes time bytes
+          waited in UART buffer while main loop was busy
+====================================================================== */
+void shedJSONTable(void)
+{
+  respBegin(200, "text/json");
+  respPrintf(PSTR("{\r\n\"isousc\":%u,\"iinst\":[%u,%u,%u,%u],\"trip\":%u,\"restore\":%u,\"min_off\":%u,\r\n"),
+             shed_isousc, shed_iinst[0], shed_iinst[1], shed_iinst[2], shed_iinst[3],
+             shed_trip, shed_restore, shed_min_off_ms / 1000);
+  respPrintf(PSTR("\"latency\":{\"last\":%u,\"max\":%u,\"avg\":%u,\"n\":%u,\"late\":%u,\"bound\":%u},\r\n\"relays\":[\r\n"),
+             shed_lat_last, shed_lat_max, shed_lat_n ? shed_lat_sum / shed_lat_n : 0,
+             shed_lat_n, shed_lat_late, SHED_LATENCY_MAX);
+
+  for (uint8_t i = 0; i < shed_count; i++) {
+    _shedRelay * r = &shed_relays[i];
+    respPrintf(PSTR("%s{\"gpio\":%u,\"off\":%d,\"off_time\":%lu,\"count\":%u}"),
+               i ? ",\r\n" : "", r->pin, r->off, r->off ? (millis() - r->off_ms) / 1000 : 0, r->count);
+  }
+  respPrint_P(PSTR("\r\n]\r\n}\r\n"));
+  respEnd();
+}
@@ -0,0 +1,62 @@
+// **********************************************************************************
+// ESP8266 Teleinfo load shedding Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef SHED_H
+#define SHED_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// One char at 1200 bauds 7E1 (10 bits)
+#define SHED_CHAR_US       8333
+// Serial line to relay edge above this is counted as late (us)
+#define SHED_LATENCY_MAX   50000
+
+// Teleinfo group end, group is parsed when it's received
+#define SHED_GROUP_END     0x0D
+
+// One load shedding relay, GPIO high cuts the load so an unpowered
+// relay leaves loads on
+typedef struct
+{
+  uint8_t  pin;
+  bool     off;                 // load is shed
+  unsigned long off_ms;         // millis() when shed
+  uint16_t count;               // times shed
+} _shedRelay;
+
+// Exported variables
+// ===================================================
+extern _shedRelay    shed_relays[];
+extern uint8_t       shed_count;
+extern unsigned long shed_rx_us;   // estimated arrival of last group end
+
+// declared exported function from shed.cpp
+// ===================================================
+void shedInit(void);
+bool shedPin(uint8_t pin);
+void shedData(int8_t id);
+void shedADPS(uint8_t phase);
+void shedFrame(void);
+void shedJSONTable(void);
+
+#endif
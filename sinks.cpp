@@ -0,0 +1,849 @@
+// **********************************************************************************
+// ESP8266 Teleinfo upload sinks
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "sinks.h"
+
+_sink    sinks[SINK_MAX];
+uint8_t  sinks_count = 0;
+char     sinks_pool[SINK_POOL_SIZE];
+uint16_t sinks_pool_idx = 0;
+char     sinks_node[4];          // emoncms node of configuration
+
+// Frame encoded by last encoder used
+char     sink_snap[SINK_SNAP_SIZE];
+uint16_t sink_snap_len = 0;
+bool  (* sink_snap_enc)(char * buf, size_t size, uint16_t & idx) = NULL;
+uint32_t sink_snap_frame = 0;    // frame number of encoded data
+uint32_t sink_frame = 0;         // frames received
+uint16_t sink_snap_hits = 0;
+uint16_t sink_snap_miss = 0;
+
+// Emoncms bulk batch, data=[[t,node,{"PAPP":340},...],...
+char     sink_bulk[SINK_BULK_SIZE];
+uint16_t sink_bulk_len = 0;
+uint8_t  sink_bulk_n = 0;        // samples in batch
+uint8_t  sink_bulk_max;          // samples per upload
+uint16_t sink_bulk_latency;      // max age of first sample (s)
+unsigned long sink_bulk_first;   // uptime of first sample
+unsigned long sink_bulk_retry = 0; // no upload before this uptime
+uint32_t sink_bulk_frame = 0;    // frame of last sample
+uint16_t sink_bulk_dropped = 0;
+
+// Changed-only state of sinks which need it
+_sinkDelta sink_deltas[SINK_DELTA_MAX];
+uint8_t    sink_deltas_count = 0;
+
+/* ======================================================================
+Function: sinkEncodeEmoncms
+Purpose : encode frame as emoncms JSON values
+Input   : buffer
+          buffer size
+          current index in buffer
+Output  : false if buffer was too small
+Comments: {PAPP:340,PTEC:3,...}
+====================================================================== */
+bool sinkEncodeEmoncms(char * buf, size_t size, uint16_t & idx)
+{
+  if (!build_emoncms_json(buf + idx, size - idx))
+    return false;
+  idx += strlen(buf + idx);
+  return true;
+}
+
+/* ======================================================================
+Function: sinkEncodeQuery
+Purpose : encode frame as URL query
+Input   : buffer
+          buffer size
+          current index in buffer
+Output  : false if buffer was too small
+Comments: PAPP=340&PTEC=HP..&...& ADCO is left to transport
+====================================================================== */
+bool sinkEncodeQuery(char * buf, size_t size, uint16_t & idx)
+{
+  char name[16], value[16];
+  bool ok = true;
+
+  buf[idx] = '\0';
+  for (int8_t id = valueNext(-1); ok && id >= 0; id = valueNext(id)) {
+    if (strcmp(tabnames[id], "ADCO"))
+      ok = bufPrintf(buf, size, idx, PSTR("%s=%s&"), tabnames[id], valueText(id));
+  }
+
+  // Virtual labels (pulse counters, power)
+  for (uint8_t n = 0; ok && virtualLabel(n, name, value); n++)
+    ok = bufPrintf(buf, size, idx, PSTR("%s=%s&"), name, value);
+
+  return ok;
+}
+
+/* ======================================================================
+Function: sinkNumber
+Purpose : check a value can be sent as JSON number
+Input   : value
+Output  : start of number, NULL if not a number
+Comments: JSON numbers have no leading zeros, 000123 is 123
+====================================================================== */
+const char * sinkNumber(const char * value)
+{
+  const char * p;
+  bool dot = false;
+
+  while (*value == '0' && isdigit(value[1]))
+    value++;
+
+  p = value + (*value == '-');
+  if (!isdigit(*p))
+    return NULL;
+
+  for (; *p; p++) {
+    if (*p == '.' && !dot && isdigit(p[1]))
+      dot = true;
+    else if (!isdigit(*p))
+      return NULL;
+  }
+  return value;
+}
+
+/* ======================================================================
+Function: sinkEncodeBulk
+Purpose : encode frame as emoncms bulk values
+Input   : buffer
+          buffer size
+          current index in buffer
+Output  : false if buffer was too small
+Comments: {"PAPP":340},{"PTEC":3},... one object per value as emoncms
+          bulk API takes name of first key of each object. Values are
+          mapped as emoncms JSON ones, not numeric ones are left out
+====================================================================== */
+bool sinkEncodeBulk(char * buf, size_t size, uint16_t & idx)
+{
+  char name[16], value[16];
+  const char * num;
+  bool ok = true;
+  bool first = true;
+
+  buf[idx] = '\0';
+  for (int8_t id = valueNext(-1); ok && id >= 0; id = valueNext(id)) {
+    uint32_t n;
+
+    if (valueNumber(id, n, true)) {
+      ok = bufPrintf(buf, size, idx, PSTR("%s{\"%s\":%u}"), first ? "" : ",", tabnames[id], n);
+      first = false;
+    }
+  }
+
+  // Virtual labels (pulse counters, power)
+  for (uint8_t n = 0; ok && virtualLabel(n, name, value); n++) {
+    num = sinkNumber(value);
+    if (num) {
+      ok = bufPrintf(buf, size, idx, PSTR("%s{\"%s\":%s}"), first ? "" : ",", name, num);
+      first = false;
+    }
+  }
+
+  return ok;
+}
+
+/* ======================================================================
+Function: sinkUrlEmoncms
+Purpose : emoncms input URL
+Input   : sink
+          URL buffer, size and current index
+          encoded frame
+Output  : false if URL too long
+Comments: -
+====================================================================== */
+bool sinkUrlEmoncms(_sink * s, char * url, size_t size, uint16_t & idx, const char * payload)
+{
+  bool ok = bufPrintf(url, size, idx, PSTR("%s?"), *s->url ? s->url : "/");
+
+  if (ok && *s->ident && strcmp(s->ident, "0"))
+    ok = bufPrintf(url, size, idx, PSTR("node=%s&"), s->ident);
+
+  return ok && bufPrintf(url, size, idx, PSTR("apikey=%s&json=%s"), s->key, payload);
+}
+
+/* ======================================================================
+Function: sinkUrlJeedom
+Purpose : jeedom teleinfo plugin URL
+Input   : sink
+          URL buffer, size and current index
+          encoded frame
+Output  : false if URL too long
+Comments: ADCO of configuration is used instead of meter one if set
+====================================================================== */
+bool sinkUrlJeedom(_sink * s, char * url, size_t size, uint16_t & idx, const char * payload)
+{
+  const char * adco = *s->ident ? s->ident : tinfoValue("ADCO", 0);
+  bool ok = bufPrintf(url, size, idx, PSTR("%s?"), *s->url ? s->url : "/");
+
+  if (ok && adco)
+    ok = bufPrintf(url, size, idx, PSTR("ADCO=%s&"), adco);
+
+  return ok && bufPrintf(url, size, idx, PSTR("api=%s"), s->key);
+}
+
+/* ======================================================================
+Function: sinkDeltaFind
+Purpose : check if a label value was acknowledged by server
+Input   : changed-only state
+          hash of name=value
+Output  : true if server already has it
+Comments: -
+====================================================================== */
+bool sinkDeltaFind(_sinkDelta * d, uint32_t h)
+{
+  for (uint8_t i = 0; i < d->nacked; i++) {
+    if (d->acked[i] == h)
+      return true;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: sinkBodyJeedom
+Purpose : jeedom request body, labels changed since last acknowledged
+          upload only
+Input   : sink
+          body length to fill
+Output  : body, empty if nothing changed
+Comments: PAPP=340&IINST=2 taken from shared encoded frame, all labels
+          are sent on first upload, then every SINK_DELTA_SYNC seconds
+          and when there are too many labels to track
+====================================================================== */
+const char * sinkBodyJeedom(_sink * s, size_t & len)
+{
+  _sinkDelta * d = s->delta;
+  char * body = (char *) arenaAlloc(sink_snap_len + 1);
+  const char * p = sink_snap;
+  uint16_t idx = 0;
+
+  len = 0;
+  if (!body)
+    return NULL;
+
+  if (d) {
+    d->npending = 0;
+    d->sent = d->skipped = 0;
+    d->full = !d->synced || seconds - d->synced >= SINK_DELTA_SYNC;
+  }
+
+  while (*p) {
+    const char * end = strchr(p, '&');
+    size_t n = end ? end - p : strlen(p);
+    bool send = true;
+
+    if (d) {
+      // FNV-1a of name=value
+      uint32_t h = 2166136261UL;
+      for (size_t i = 0; i < n; i++)
+        h = (h ^ (uint8_t) p[i]) * 16777619UL;
+
+      if (d->npending < SINK_DELTA_LABELS)
+        d->pending[d->npending++] = h;
+      else
+        d->full = true;
+      send = d->full || !sinkDeltaFind(d, h);
+      if (send)
+        d->sent++;
+      else
+        d->skipped++;
+    }
+
+    if (send) {
+      if (idx)
+        body[idx++] = '&';
+      memcpy(body + idx, p, n);
+      idx += n;
+    }
+    p += n + (end ? 1 : 0);
+  }
+
+  // full upload not tracked, can't tell changes afterward
+  if (d && d->full && d->npending >= SINK_DELTA_LABELS)
+    d->full = false;
+
+  body[idx] = '\0';
+  len = idx;
+  return body;
+}
+
+/* ======================================================================
+Function: sinkDoneJeedom
+Purpose : jeedom upload result
+Input   : sink
+          upload result
+Output  : -
+Comments: values sent (or unchanged) are acknowledged only on success,
+          so failed ones are sent again next time
+====================================================================== */
+void sinkDoneJeedom(_sink * s, bool ok)
+{
+  _sinkDelta * d = s->delta;
+
+  if (!d || !ok)
+    return;
+
+  memcpy(d->acked, d->pending, d->npending * sizeof(uint32_t));
+  d->nacked = d->npending;
+  if (d->full)
+    d->synced = seconds;
+}
+
+/* ======================================================================
+Function: sinkUrlHttp
+Purpose : free HTTP request URL
+Input   : sink
+          URL buffer, size and current index
+          encoded frame (not used)
+Output  : false if URL too long
+Comments: any %LABEL% of URL is replaced by current value of LABEL
+====================================================================== */
+bool sinkUrlHttp(_sink * s, char * url, size_t size, uint16_t & idx, const char * payload)
+{
+  if (!urlExpand(*s->url ? s->url : "/", url, size))
+    return false;
+  idx = strlen(url);
+  return bufPrintf(url, size, idx, PSTR("?"));
+}
+
+/* ======================================================================
+Function: sinkUrlBulk
+Purpose : emoncms bulk input URL
+Input   : sink
+          URL buffer, size and current index
+          encoded frame (not used, samples are in body)
+Output  : false if URL too long
+Comments: bulk.json is taken in same directory as post URL. Samples are
+          stamped with uptime and sentat gives uptime at upload, so
+          emoncms dates them from its own clock, no NTP needed
+====================================================================== */
+bool sinkUrlBulk(_sink * s, char * url, size_t size, uint16_t & idx, const char * payload)
+{
+  const char * slash = strrchr(s->url, '/');
+  int dir = slash ? slash - s->url : 0;
+
+  return bufPrintf(url, size, idx, PSTR("%.*s/bulk.json?apikey=%s&sentat=%lu"),
+                   dir, s->url, s->key, seconds);
+}
+
+/* ======================================================================
+Function: sinkRecordBulk
+Purpose : add encoded frame to emoncms bulk batch
+Input   : sink
+          encoded frame
+Output  : true if batch has to be sent now
+Comments: batch is sent when it has enough samples, when first sample
+          is too old or when next sample may not fit. Same frame is
+          recorded once even if upload period is shorter than frame
+====================================================================== */
+bool sinkRecordBulk(_sink * s, const char * payload)
+{
+  if (*payload && sink_bulk_frame != sink_frame) {
+    uint16_t idx = sink_bulk_len;
+
+    if (!sink_bulk_n) {
+      idx = 0;
+      sink_bulk_first = seconds;
+    }
+
+    // keep one byte for closing bracket
+    if (bufPrintf(sink_bulk, SINK_BULK_SIZE - 1, idx, PSTR("%s[%lu,%s,%s]"),
+                  sink_bulk_n ? "," : "data=[", seconds, *s->ident ? s->ident : "0", payload)) {
+      sink_bulk_len = idx;
+      sink_bulk_n++;
+      sink_bulk_frame = sink_frame;
+    } else {
+      sink_bulk_dropped++;
+    }
+  }
+
+  if (!sink_bulk_n || (long) (seconds - sink_bulk_retry) < 0)
+    return false;
+
+  return sink_bulk_n >= sink_bulk_max
+      || seconds - sink_bulk_first >= sink_bulk_latency
+      || SINK_BULK_SIZE - 1 - sink_bulk_len < sink_bulk_len / sink_bulk_n + 32;
+}
+
+/* ======================================================================
+Function: sinkBodyBulk
+Purpose : emoncms bulk request body
+Input   : sink
+          body length to fill
+Output  : body
+Comments: -
+====================================================================== */
+const char * sinkBodyBulk(_sink * s, size_t & len)
+{
+  sink_bulk[sink_bulk_len] = ']';
+  sink_bulk[sink_bulk_len + 1] = '\0';
+  len = sink_bulk_len + 1;
+  return sink_bulk;
+}
+
+/* ======================================================================
+Function: sinkDoneBulk
+Purpose : emoncms bulk upload result
+Input   : sink
+          upload result
+Output  : -
+Comments: batch is kept on failure and sent again after a while,
+          samples which don't fit meanwhile are dropped
+====================================================================== */
+void sinkDoneBulk(_sink * s, bool ok)
+{
+  sink_bulk[sink_bulk_len] = '\0';
+  if (ok)
+    sink_bulk_n = 0;
+  else
+    sink_bulk_retry = seconds + SINK_BULK_RETRY;
+}
+
+/* ======================================================================
+Function: sinkDoneHttp
+Purpose : Domoticz current update after HTTP request of configuration
+Input   : sink
+          upload result
+Output  : -
+Comments: -
+====================================================================== */
+void sinkDoneHttp(_sink * s, bool ok)
+{
+  if (s == &sinks[SINK_HTTPREQ])
+    UPD_I();
+}
+
+const _sinkType sink_types[] = {
+  { "emoncms", sinkEncodeEmoncms, sinkUrlEmoncms, NULL,           NULL, NULL },
+  { "jeedom",  sinkEncodeQuery,   sinkUrlJeedom,  sinkDoneJeedom, NULL, sinkBodyJeedom },
+  { "http",    NULL,              sinkUrlHttp,    sinkDoneHttp,   NULL, NULL },
+};
+#define SINK_TYPES (sizeof(sink_types)/sizeof(sink_types[0]))
+
+// Emoncms of configuration in bulk mode, only one as batch is global
+const _sinkType sink_bulk_type =
+  { "emonbulk", sinkEncodeBulk, sinkUrlBulk, sinkDoneBulk, sinkRecordBulk, sinkBodyBulk };
+
+/* ======================================================================
+Function: sinkAdd
+Purpose : add a sink
+Input   : type
+          host, port, url, key, ident
+          upload period (s)
+Output  : sink, NULL if table is full
+Comments: -
+====================================================================== */
+_sink * sinkAdd(const _sinkType * type, const char * host, uint16_t port, const char * url,
+                const char * key, const char * ident, uint32_t freq)
+{
+  if (sinks_count >= SINK_MAX)
+    return NULL;
+
+  _sink * s = &sinks[sinks_count++];
+  memset(s, 0, sizeof(_sink));
+  s->type  = type;
+  s->host  = host;
+  s->port  = port;
+  s->url   = url;
+  s->key   = key;
+  s->ident = ident;
+  s->freq  = freq;
+  s->next  = seconds + freq;
+
+  // Changed-only uploads while there is state left
+  if (type->body == sinkBodyJeedom && sink_deltas_count < SINK_DELTA_MAX) {
+    s->delta = &sink_deltas[sink_deltas_count++];
+    memset(s->delta, 0, sizeof(_sinkDelta));
+  }
+  return s;
+}
+
+/* ======================================================================
+Function: sinksPoolAdd
+Purpose : keep a string (or bytes) of sinks file
+Input   : data
+          size, 0 for a string
+Output  : pointer on kept data, NULL if pool is full
+Comments: -
+====================================================================== */
+const char * sinksPoolAdd(const char * str, size_t len = 0)
+{
+  if (!len)
+    len = strlen(str) + 1;
+
+  if (sinks_pool_idx + len > SINK_POOL_SIZE)
+    return NULL;
+
+  memcpy(sinks_pool + sinks_pool_idx, str, len);
+  sinks_pool_idx += len;
+  return sinks_pool + sinks_pool_idx - len;
+}
+
+/* ======================================================================
+Function: sinksParse
+Purpose : add a sink from a line of sinks file
+Input   : line (modified)
+Output  : NULL if ok (or empty line), else error message
+Comments: <type> <freq> [https://]<host>[:<port>] <url> [<key>] [<ident>]
+          [fp=<fingerprint>] [insecure]
+====================================================================== */
+PGM_P sinksParse(char * line)
+{
+  const char * arg[6];
+  char * save;
+  char * tok;
+  uint8_t n = 0;
+  uint8_t t;
+  uint8_t fp[CFG_TLS_FP_SIZE];
+  bool insecure = false;
+
+  if ((tok = strchr(line, '#')))
+    *tok = '\0';
+
+  memset(fp, 0, sizeof(fp));
+  for (tok = strtok_r(line, " \t\r", &save); tok; tok = strtok_r(NULL, " \t\r", &save)) {
+    if (!strncmp_P(tok, PSTR("fp="), 3)) {
+      if (!tlsFingerprintParse(tok + 3, fp) || !tlsPinned(fp))
+        return PSTR("bad fingerprint");
+    } else if (!strcmp_P(tok, PSTR("insecure")))
+      insecure = true;
+    else if (n < 6)
+      arg[n++] = tok;
+  }
+  if (!n)
+    return NULL;
+  if (n < 4)
+    return PSTR("missing field");
+
+  for (t = 0; t < SINK_TYPES; t++) {
+    if (!strcmp(arg[0], sink_types[t].name))
+      break;
+  }
+  if (t >= SINK_TYPES)
+    return PSTR("bad type");
+
+  uint32_t freq = atol(arg[1]);
+  if (freq < 1 || freq > 86400)
+    return PSTR("bad period");
+
+  // [scheme://]host[:port]
+  uint8_t tls = TLS_OFF;
+  uint16_t port = 80;
+  if (!strncmp_P(arg[2], PSTR("https://"), 8)) {
+    tls = insecure ? TLS_INSECURE : TLS_VERIFY;
+    port = HTTPS_PORT;
+    arg[2] += 8;
+  } else if (!strncmp_P(arg[2], PSTR("http://"), 7)) {
+    arg[2] += 7;
+  }
+  if (!tls && (insecure || tlsPinned(fp)))
+    return PSTR("fp/insecure need https://");
+
+  char * colon = strchr((char *) arg[2], ':');
+  if (colon) {
+    *colon = '\0';
+    port = atoi(colon + 1);
+  }
+
+  const char * host  = sinksPoolAdd(arg[2]);
+  const char * url   = sinksPoolAdd(arg[3]);
+  const char * key   = sinksPoolAdd(n > 4 ? arg[4] : "");
+  const char * ident = sinksPoolAdd(n > 5 ? arg[5] : "");
+  const char * pin   = tlsPinned(fp) ? sinksPoolAdd((const char *) fp, sizeof(fp)) : "";
+  if (!host || !url || !key || !ident || !pin)
+    return PSTR("no more memory");
+
+  _sink * s = sinkAdd(&sink_types[t], host, port, url, key, ident, freq);
+  if (!s)
+    return PSTR("too many sinks");
+  s->tls = tls;
+  s->fp = *pin ? (const uint8_t *) pin : NULL;
+  return NULL;
+}
+
+/* ======================================================================
+Function: sinksInit
+Purpose : (re)build sinks from configuration and sinks file
+Input   : -
+Output  : -
+Comments: sinks of configuration are always there, disabled without
+          host or period
+====================================================================== */
+void sinksInit(void)
+{
+  char line[160];
+  uint8_t lineno = 0;
+
+  sinks_count = 0;
+  sinks_pool_idx = 0;
+  sink_snap_enc = NULL;
+  sink_deltas_count = 0;
+
+  sink_bulk_n = 0;
+  sink_bulk_retry = 0;
+  sink_bulk_max = config.emoncms.bulk;
+  sink_bulk_latency = config.emoncms.bulk_latency ? config.emoncms.bulk_latency : CFG_EMON_DEFAULT_BULKLAT;
+
+  // Fingerprint of configuration is only for these ones
+  sprintf_P(sinks_node, PSTR("%u"), config.emoncms.node);
+  _sink * s = sinkAdd(config.emoncms.bulk ? &sink_bulk_type : &sink_types[0], config.emoncms.host, config.emoncms.port, config.emoncms.url,
+          config.emoncms.apikey, sinks_node, config.emoncms.freq);
+  s->tls = config.emoncms.tls;
+  s->fp  = config.tls_fp;
+  s = sinkAdd(&sink_types[1], config.jeedom.host, config.jeedom.port, config.jeedom.url,
+          config.jeedom.apikey, config.jeedom.adco, config.jeedom.freq);
+  s->tls = config.jeedom.tls;
+  s->fp  = config.tls_fp;
+  s = sinkAdd(&sink_types[2], config.httpReq.host, config.httpReq.port, config.httpReq.path,
+          "", "", config.httpReq.freq);
+  s->tls = config.httpReq.tls;
+  s->fp  = config.tls_fp;
+
+  File f = SPIFFS.open(SINKS_FILE, "r");
+  if (f) {
+    while (f.available()) {
+      size_t len = f.readBytesUntil('\n', line, sizeof(line) - 1);
+      line[len] = '\0';
+      lineno++;
+
+      PGM_P err = sinksParse(line);
+      if (err) {
+        Debugf("Sink line %d: ", lineno);
+        Debugln(FPSTR(err));
+      }
+    }
+    f.close();
+  }
+
+  Debugf("Sinks %d, %d bytes pool\r\n", sinks_count, sinks_pool_idx);
+}
+
+/* ======================================================================
+Function: sinksFrame
+Purpose : account a new frame, shared encoded data is no more valid
+Input   : -
+Output  : -
+Comments: called at end of each teleinfo frame
+====================================================================== */
+void sinksFrame(void)
+{
+  sink_frame++;
+}
+
+/* ======================================================================
+Function: sinksTick
+Purpose : schedule sinks uploads
+Input   : -
+Output  : -
+Comments: called every second from main loop, replaces one Ticker per
+          sink, a due sink stays due until sent
+====================================================================== */
+void sinksTick(void)
+{
+  for (uint8_t i = 0; i < sinks_count; i++) {
+    _sink * s = &sinks[i];
+
+    if (!s->freq || !*s->host || (long) (seconds - s->next) < 0)
+      continue;
+
+    s->due = true;
+    s->next += s->freq;
+    if ((long) (seconds - s->next) >= 0)
+      s->next = seconds + s->freq;
+  }
+}
+
+/* ======================================================================
+Function: sinksTrigger
+Purpose : set all active sinks due now
+Input   : -
+Output  : -
+Comments: used by heap soak mode
+====================================================================== */
+void sinksTrigger(void)
+{
+  for (uint8_t i = 0; i < sinks_count; i++) {
+    if (*sinks[i].host)
+      sinks[i].due = true;
+  }
+}
+
+/* ======================================================================
+Function: sinksDue
+Purpose : check if an upload is waiting
+Input   : -
+Output  : true if one sink is due
+Comments: -
+====================================================================== */
+bool sinksDue(void)
+{
+  for (uint8_t i = 0; i < sinks_count; i++) {
+    if (sinks[i].due)
+      return true;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: sinksHandle
+Purpose : do one due upload
+Input   : -
+Output  : -
+Comments: called from main loop, one upload per loop. A sink which can
+          use frame already encoded is taken first, so encoding is done
+          once per frame for all sinks of same encoder
+====================================================================== */
+void sinksHandle(void)
+{
+  _sink * s = NULL;
+
+  for (uint8_t i = 0; i < sinks_count; i++) {
+    if (!sinks[i].due)
+      continue;
+    if (!s)
+      s = &sinks[i];
+    if (sinks[i].type->encode && sinks[i].type->encode == sink_snap_enc && sink_snap_frame == sink_frame) {
+      s = &sinks[i];
+      break;
+    }
+  }
+  if (!s)
+    return;
+  s->due = false;
+
+  // Got at least two values ?
+  if (value_count < 2)
+    return;
+
+  heapBegin(s->type->name);
+  unsigned long start = millis();
+  const char * payload = "";
+  bool ok = true;
+
+  if (s->type->encode) {
+    if (s->type->encode != sink_snap_enc || sink_snap_frame != sink_frame) {
+      uint16_t idx = 0;
+
+      sink_snap_enc = NULL;
+      TRACE_BEGIN(TRACE_SINK, "encode");
+      ok = s->type->encode(sink_snap, SINK_SNAP_SIZE, idx);
+      TRACE_END(TRACE_SINK, "encode");
+      if (ok) {
+        sink_snap_enc = s->type->encode;
+        sink_snap_frame = sink_frame;
+        sink_snap_len = idx;
+      }
+      sink_snap_miss++;
+    } else {
+      sink_snap_hits++;
+    }
+    payload = sink_snap;
+  }
+
+  // Batching sink, upload only when batch is complete
+  if (ok && s->type->record && !s->type->record(s, payload)) {
+    heapEnd();
+    return;
+  }
+
+  arenaReset();
+  char * url = (char *) arenaAlloc(HTTP_URL_SIZE);
+  uint16_t idx = 0;
+
+  if (ok && url && s->type->url(s, url, HTTP_URL_SIZE, idx, payload)) {
+    size_t len = 0;
+    const char * body = s->type->body ? s->type->body(s, len) : NULL;
+
+    // Nothing changed, nothing to send
+    if (body && !len)
+      Debugf("%s: no change\r\n", s->type->name);
+    else {
+      TRACE_BEGIN(TRACE_SINK, "http");
+      ok = httpSend((char *) s->host, s->port ? s->port : (s->tls ? HTTPS_PORT : 80), url, body, len, s->tls, s->fp);
+      TRACE_END(TRACE_SINK, "http");
+    }
+  } else {
+    Debugf("%s: URL too long\r\n", s->type->name);
+    ok = false;
+  }
+  arenaReset();
+
+  if (ok)
+    s->sent++;
+  else
+    s->failed++;
+  s->last_ms = millis() - start;
+
+  if (s->type->done)
+    s->type->done(s, ok);
+  heapEnd();
+}
+
+/* ======================================================================
+Function: sinksSave
+Purpose : save new sinks file and rebuild sinks
+Input   : sinks file content
+Output  : false if too big or not written
+Comments: empty content removes file
+====================================================================== */
+bool sinksSave(const String & text)
+{
+  bool ret = textFileSave(SINKS_FILE, text, SINK_TEXT_SIZE);
+
+  sinksInit();
+  return ret;
+}
+
+/* ======================================================================
+Function: sinksJSONTable
+Purpose : dump sinks state in JSON
+Input   : -
+Output  : -
+Comments: hits are uploads which used frame already encoded
+====================================================================== */
+void sinksJSONTable(void)
+{
+  respBegin(200, "text/json");
+  respPrintf(PSTR("{\r\n\"frame\":%u,\"encoded\":%u,\"bytes\":%u,\"hits\":%u,\"miss\":%u,\r\n"),
+             sink_frame, sink_snap_frame, sink_snap_len, sink_snap_hits, sink_snap_miss);
+  respPrintf(PSTR("\"bulk\":{\"samples\":%u,\"max\":%u,\"bytes\":%u,\"size\":%u,\"age\":%lu,\"latency\":%u,\"dropped\":%u},\r\n\"sinks\":[\r\n"),
+             sink_bulk_n, sink_bulk_max, sink_bulk_n ? sink_bulk_len : 0, SINK_BULK_SIZE,
+             sink_bulk_n ? seconds - sink_bulk_first : 0, sink_bulk_latency, sink_bulk_dropped);
+
+  for (uint8_t i = 0; i < sinks_count; i++) {
+    _sink * s = &sinks[i];
+    respPrintf(PSTR("%s{\"type\":\"%s\",\"host\":\"%s\",\"port\":%u,\"tls\":%u,\"pinned\":%d,\"freq\":%u,\"next\":%ld,"
+                    "\"due\":%d,\"sent\":%u,\"failed\":%u,\"last_ms\":%u"),
+               i ? ",\r\n" : "", s->type->name, s->host, s->port, s->tls, tlsPinned(s->fp), s->freq,
+               s->freq && *s->host ? (long) (s->next - seconds) : -1L,
+               s->due, s->sent, s->failed, s->last_ms);
+    if (s->delta)
+      respPrintf(PSTR(",\"delta\":{\"tracked\":%u,\"sent\":%u,\"skipped\":%u,\"sync\":%ld}"),
+                 s->delta->nacked, s->delta->sent, s->delta->skipped,
+                 s->delta->synced ? (long) (seconds - s->delta->synced) : -1L);
+    respPrint_P(PSTR("}"));
+  }
+  respPrint_P(PSTR("\r\n]\r\n}\r\n"));
+  respEnd();
+}
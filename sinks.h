@@ -0,0 +1,127 @@
+// **********************************************************************************
+// ESP8266 Teleinfo upload sinks Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef SINKS_H
+#define SINKS_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Emoncms, Jeedom and HTTP request of configuration are the first
+// sinks, more can be declared in SINKS_FILE, one per line
+//   emoncms <freq> [https://]<host>[:<port>] <url> <apikey> [<node>]
+//   jeedom  <freq> [https://]<host>[:<port>] <url> <apikey> [<adco>]
+//   http    <freq> [https://]<host>[:<port>] <url with %LABEL%>
+// https sinks take options anywhere after host
+//   fp=AA:BB:..  pin server certificate (SHA1)
+//   insecure     don't check server, only when there is no other way
+// Emoncms of configuration batches samples to bulk.json when
+// bulk mode is set
+#define SINKS_FILE      "/sinks.txt"
+#define SINK_MAX        6     // configuration ones included
+#define SINK_POOL_SIZE  512   // strings of sinks from file
+#define SINK_TEXT_SIZE  768   // max size of sinks file
+// Encoded frame shared by sinks using same encoder
+#define SINK_SNAP_SIZE  EMONCMS_JSON_SIZE
+// Samples of emoncms bulk mode waiting for upload
+#define SINK_BULK_SIZE  2048
+#define SINK_BULK_RETRY 30    // wait after failed bulk upload (s)
+// Sinks sending changed labels only, with a full upload from time to time
+#define SINK_DELTA_MAX    2     // sinks with changed-only payloads
+#define SINK_DELTA_LABELS 32    // labels tracked per sink
+#define SINK_DELTA_SYNC   3600  // full upload period (s)
+
+// Sinks of configuration
+#define SINK_EMONCMS    0
+#define SINK_JEEDOM     1
+#define SINK_HTTPREQ    2
+
+typedef struct _sink _sink;
+
+// Labels acknowledged by server, as hashes of name=value
+typedef struct
+{
+  uint32_t acked[SINK_DELTA_LABELS];
+  uint32_t pending[SINK_DELTA_LABELS];  // frame of upload in progress
+  uint8_t  nacked;
+  uint8_t  npending;
+  bool     full;                        // upload in progress is full
+  unsigned long synced;                 // uptime of last full upload
+  uint8_t  sent;                        // labels in last upload
+  uint8_t  skipped;                     // unchanged labels left out
+} _sinkDelta;
+
+// Sink type, what makes a backend
+typedef struct
+{
+  const char * name;
+  // Payload encoder, frame is encoded once and shared by all sinks
+  // of this encoder, NULL if URL is built by url() only
+  bool (*encode)(char * buf, size_t size, uint16_t & idx);
+  // Transport URL from sink settings and shared payload
+  bool (*url)(_sink * s, char * url, size_t size, uint16_t & idx, const char * payload);
+  // Optional, called once sent
+  void (*done)(_sink * s, bool ok);
+  // Optional, keep payload in a batch, true when batch has to be sent
+  bool (*record)(_sink * s, const char * payload);
+  // Optional, request body, sent with POST instead of GET
+  const char * (*body)(_sink * s, size_t & len);
+} _sinkType;
+
+// One sink instance
+struct _sink
+{
+  const _sinkType * type;
+  const char *  host;         // FQDN
+  const char *  url;          // path (or template)
+  const char *  key;          // API key
+  const char *  ident;        // emoncms node, jeedom ADCO
+  uint16_t      port;
+  uint8_t       tls;          // TLS_OFF, TLS_VERIFY or TLS_INSECURE
+  const uint8_t * fp;         // pinned server fingerprint, NULL if none
+  uint32_t      freq;         // upload period (s)
+  unsigned long next;         // uptime (s) when next upload is due
+  bool          due;
+  uint16_t      sent;
+  uint16_t      failed;
+  uint16_t      last_ms;      // duration of last upload
+  _sinkDelta *  delta;        // changed-only state, NULL if full uploads
+};
+
+// Exported variables
+// ===================================================
+extern _sink   sinks[];
+extern uint8_t sinks_count;
+extern uint32_t sink_frame;     // frames received
+
+// declared exported function from sinks.cpp
+// ===================================================
+void sinksInit(void);
+void sinksFrame(void);
+void sinksTick(void);
+void sinksTrigger(void);
+bool sinksDue(void);
+void sinksHandle(void);
+bool sinksSave(const String & text);
+void sinksJSONTable(void);
+
+#endif
@@ -0,0 +1,309 @@
+// **********************************************************************************
+// ESP8266 Teleinfo rolling window statistics
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "stats.h"
+
+_statSeries stats[CFG_STATS_LABELS][CFG_STATS_WINDOWS];
+char        stats_names[CFG_STATS_LABELS][16];  // labels followed
+uint8_t     stats_labels = 0;
+uint8_t     stats_windows = 0;
+
+/* ======================================================================
+Function: statsInit
+Purpose : (re)start statistics from configuration
+Input   : -
+Output  : -
+Comments: labels and windows are comma separated lists
+====================================================================== */
+void statsInit(void)
+{
+  const char * p;
+
+  memset(stats, 0, sizeof(stats));
+  stats_labels = stats_windows = 0;
+
+  // Labels
+  p = config.stats.labels;
+  while (*p && stats_labels < CFG_STATS_LABELS) {
+    const char * end = strchr(p, ',');
+    size_t len = end ? end - p : strlen(p);
+
+    if (len && len < sizeof(stats_names[0])) {
+      memcpy(stats_names[stats_labels], p, len);
+      stats_names[stats_labels][len] = '\0';
+      stats_labels++;
+    }
+    p = end ? end + 1 : p + len;
+  }
+
+  // Windows, bucket length can't be less than 1s
+  for (uint8_t w = 0; w < CFG_STATS_WINDOWS; w++) {
+    uint16_t win = config.stats.window[w];
+    if (win < STATS_BUCKETS)
+      continue;
+    for (uint8_t l = 0; l < CFG_STATS_LABELS; l++)
+      stats[l][stats_windows].len = win / STATS_BUCKETS;
+    config.stats.window[stats_windows++] = win;
+  }
+  for (uint8_t w = stats_windows; w < CFG_STATS_WINDOWS; w++)
+    config.stats.window[w] = 0;
+
+  Debugf("Stats %d labels, %d windows, %u bytes\r\n", stats_labels, stats_windows, (unsigned int) sizeof(stats));
+}
+
+/* ======================================================================
+Function: statDequePush
+Purpose : add a closed bucket to a monotonic deque
+Input   : deque
+          series
+          ring position of the bucket
+          true for max deque, false for min deque
+Output  : -
+Comments: buckets which can't be min (or max) anymore are removed,
+          amortized O(1)
+====================================================================== */
+void statDequePush(_statDeque * d, _statSeries * s, uint8_t pos, bool max)
+{
+  int32_t v = max ? s->ring[pos].max : s->ring[pos].min;
+
+  while (d->len) {
+    uint8_t last = d->pos[(d->head + d->len - 1) % STATS_BUCKETS];
+    int32_t lv = max ? s->ring[last].max : s->ring[last].min;
+    if (max ? lv > v : lv < v)
+      break;
+    d->len--;
+  }
+  d->pos[(d->head + d->len) % STATS_BUCKETS] = pos;
+  d->len++;
+}
+
+/* ======================================================================
+Function: statExpire
+Purpose : remove closed buckets which left the window
+Input   : series
+          current bucket id
+Output  : -
+Comments: -
+====================================================================== */
+void statExpire(_statSeries * s, uint32_t id)
+{
+  // Window is the current bucket and STATS_BUCKETS-1 closed ones
+  while (s->count && id - s->ring[s->head].id >= STATS_BUCKETS) {
+    _statBucket * b = &s->ring[s->head];
+
+    s->sum -= b->sum;
+    s->n   -= b->count;
+    if (s->dmin.len && s->dmin.pos[s->dmin.head] == s->head) {
+      s->dmin.head = (s->dmin.head + 1) % STATS_BUCKETS;
+      s->dmin.len--;
+    }
+    if (s->dmax.len && s->dmax.pos[s->dmax.head] == s->head) {
+      s->dmax.head = (s->dmax.head + 1) % STATS_BUCKETS;
+      s->dmax.len--;
+    }
+    s->head = (s->head + 1) % STATS_BUCKETS;
+    s->count--;
+  }
+}
+
+/* ======================================================================
+Function: statAdd
+Purpose : add a value to a series
+Input   : series
+          value
+Output  : -
+Comments: O(1), closed bucket goes into ring and deques
+====================================================================== */
+void statAdd(_statSeries * s, int32_t v)
+{
+  uint32_t id = seconds / s->len;
+
+  if (s->cur.count && s->cur.id != id) {
+    // Make room, at most STATS_BUCKETS-1 closed buckets stay
+    statExpire(s, s->cur.id + 1);
+
+    uint8_t pos = (s->head + s->count) % STATS_BUCKETS;
+    s->ring[pos] = s->cur;
+    s->count++;
+    s->sum += s->cur.sum;
+    s->n   += s->cur.count;
+    statDequePush(&s->dmin, s, pos, false);
+    statDequePush(&s->dmax, s, pos, true);
+    s->cur.count = 0;
+  }
+  statExpire(s, id);
+
+  if (!s->cur.count) {
+    s->cur.id = id;
+    s->cur.min = s->cur.max = v;
+    s->cur.sum = 0;
+  }
+  if (v < s->cur.min) s->cur.min = v;
+  if (v > s->cur.max) s->cur.max = v;
+  s->cur.sum += v;
+  s->cur.count++;
+}
+
+/* ======================================================================
+Function: statsFrame
+Purpose : add values of followed labels from the frame just received
+Input   : -
+Output  : -
+Comments: called at end of each teleinfo frame, non numeric values
+          are ignored
+====================================================================== */
+void statsFrame(void)
+{
+  char buf[16];
+
+  for (uint8_t l = 0; l < stats_labels; l++) {
+    int32_t v;
+
+    if (*stats_names[l] == '_') {
+      char * end;
+
+      if (!virtualValue(stats_names[l], strlen(stats_names[l]), buf) || !*buf)
+        continue;
+      v = strtol(buf, &end, 10);
+      if (*end)
+        continue;
+    } else {
+      int8_t id = tinfoLabelId(stats_names[l]);
+      uint32_t num;
+
+      // Decoded when received
+      if (id < 0 || !valueNumber(id, num, false))
+        continue;
+      v = num;
+    }
+
+    for (uint8_t w = 0; w < stats_windows; w++)
+      statAdd(&stats[l][w], v);
+  }
+}
+
+/* ======================================================================
+Function: statsGet
+Purpose : get statistics of a label over a window
+Input   : label number
+          window number
+          where to put min, max, mean and number of values
+Output  : false if no value in window
+Comments: O(1), deques fronts give min and max of closed buckets
+====================================================================== */
+bool statsGet(uint8_t l, uint8_t w, int32_t * min, int32_t * max, int32_t * mean, uint32_t * n)
+{
+  _statSeries * s = &stats[l][w];
+
+  if (l >= stats_labels || w >= stats_windows)
+    return false;
+
+  statExpire(s, seconds / s->len);
+
+  // Current bucket may be too old too
+  bool cur = s->cur.count && seconds / s->len == s->cur.id;
+
+  *n = s->n + (cur ? s->cur.count : 0);
+  if (!*n)
+    return false;
+
+  *min = cur ? s->cur.min : INT32_MAX;
+  *max = cur ? s->cur.max : INT32_MIN;
+  if (s->dmin.len && s->ring[s->dmin.pos[s->dmin.head]].min < *min)
+    *min = s->ring[s->dmin.pos[s->dmin.head]].min;
+  if (s->dmax.len && s->ring[s->dmax.pos[s->dmax.head]].max > *max)
+    *max = s->ring[s->dmax.pos[s->dmax.head]].max;
+  *mean = (s->sum + (cur ? s->cur.sum : 0)) / (int64_t) *n;
+  return true;
+}
+
+/* ======================================================================
+Function: statsLabel
+Purpose : get statistics as virtual teleinfo labels
+Input   : label number (0..)
+          name buffer (at least 16 chars)
+          value buffer (at least 16 chars)
+Output  : false when no more label
+Comments: only if enabled in configuration, names are like _PAPP_MAX900
+          (label, MIN/MAX/AVG, window in s), too long names are skipped
+====================================================================== */
+bool statsLabel(uint8_t n, char * name, char * value)
+{
+  int32_t v[3];
+  uint32_t cnt;
+  uint8_t idx = 0;
+
+  if (!config.stats.payload)
+    return false;
+
+  for (uint8_t l = 0; l < stats_labels; l++) {
+    for (uint8_t w = 0; w < stats_windows; w++) {
+      if (!statsGet(l, w, &v[0], &v[1], &v[2], &cnt))
+        continue;
+      // Name must fit in 15 chars (same as teleinfo)
+      if (snprintf_P(name, 16, PSTR("%s%s_MIN%u"), *stats_names[l] == '_' ? "" : "_",
+                     stats_names[l], config.stats.window[w]) >= 16)
+        continue;
+      if (n >= idx + 3) {
+        idx += 3;
+        continue;
+      }
+      // this is the one
+      uint8_t k = n - idx;
+      sprintf_P(name, PSTR("%s%s_%s%u"), *stats_names[l] == '_' ? "" : "_", stats_names[l],
+                k == 0 ? "MIN" : k == 1 ? "MAX" : "AVG", config.stats.window[w]);
+      sprintf_P(value, PSTR("%d"), v[k]);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: statsJSONTable
+Purpose : dump statistics of all followed labels in JSON
+Input   : -
+Output  : -
+Comments: {"PAPP":{"60":{"min":..,"max":..,"mean":..,"n":..},...},...}
+====================================================================== */
+void statsJSONTable(void)
+{
+  int32_t min, max, mean;
+  uint32_t n;
+
+  respBegin(200, "text/json");
+  respPrint_P(FP_JSON_START);
+  for (uint8_t l = 0; l < stats_labels; l++) {
+    bool first = true;
+    respPrintf(PSTR("%s\"%s\":{"), l ? ",\r\n" : "", stats_names[l]);
+    for (uint8_t w = 0; w < stats_windows; w++) {
+      if (!statsGet(l, w, &min, &max, &mean, &n))
+        continue;
+      respPrintf(PSTR("%s\"%u\":{\"min\":%d,\"max\":%d,\"mean\":%d,\"n\":%u}"),
+                 first ? "" : ",", config.stats.window[w], min, max, mean, n);
+      first = false;
+    }
+    respPrint_P(PSTR("}"));
+  }
+  respPrint_P(FP_JSON_END);
+  respEnd();
+}
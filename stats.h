@@ -0,0 +1,73 @@
+// **********************************************************************************
+// ESP8266 Teleinfo rolling window statistics Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef STATS_H
+#define STATS_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Each window is split in buckets, memory is fixed whatever the window
+// length: labels x windows x buckets x sizeof(_statBucket)
+#define STATS_BUCKETS 15
+
+// Aggregate of values received during one bucket
+typedef struct
+{
+  int64_t  sum;                 // 64 bits, indexes are 9 digits
+  uint32_t id;                  // bucket number (uptime / bucket length)
+  int32_t  min;
+  int32_t  max;
+  uint16_t count;
+} _statBucket;
+
+// Monotonic deque of bucket positions, front is min (or max) of window
+typedef struct
+{
+  uint8_t pos[STATS_BUCKETS];
+  uint8_t head;
+  uint8_t len;
+} _statDeque;
+
+// One label over one window
+typedef struct
+{
+  uint16_t    len;              // bucket length (s)
+  _statBucket cur;              // bucket being filled
+  _statBucket ring[STATS_BUCKETS]; // closed buckets
+  uint8_t     head;             // oldest closed bucket
+  uint8_t     count;            // closed buckets in window
+  int64_t     sum;              // sum of closed buckets in window
+  uint32_t    n;                // values in closed buckets in window
+  _statDeque  dmin;
+  _statDeque  dmax;
+} _statSeries;
+
+// declared exported function from stats.cpp
+// ===================================================
+void statsInit(void);
+void statsFrame(void);
+bool statsGet(uint8_t l, uint8_t w, int32_t * min, int32_t * max, int32_t * mean, uint32_t * n);
+bool statsLabel(uint8_t n, char * name, char * value);
+void statsJSONTable(void);
+
+#endif
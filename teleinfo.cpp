@@ -0,0 +1,252 @@
+// **********************************************************************************
+// ESP8266 Teleinfo frame decoder
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "teleinfo.h"
+
+/* ======================================================================
+Function: TInfo
+Purpose : constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfo::TInfo()
+{
+  _fn_ADPS = NULL;
+  _fn_data = NULL;
+  _fn_new_frame = NULL;
+  _fn_updated_frame = NULL;
+  init();
+}
+
+/* ======================================================================
+Function: init
+Purpose : restart decoding
+Input   : -
+Output  : -
+Comments: waits for next STX, the value store is cleared by caller
+====================================================================== */
+void TInfo::init(void)
+{
+  _state = TINFO_WAIT_STX;
+  _frame_updated = false;
+  _len = 0;
+}
+
+/* ======================================================================
+Function: attachADPS / attachData / attachNewFrame / attachUpdatedFrame
+Purpose : set callbacks
+Input   : callback, NULL for none
+Output  : -
+Comments: data is called with label ID of each added or changed value,
+          new frame at end of a frame with same values as previous one,
+          updated frame at end of a frame where something changed
+====================================================================== */
+void TInfo::attachADPS(void (*fn_ADPS)(uint8_t phase))
+{
+  _fn_ADPS = fn_ADPS;
+}
+
+void TInfo::attachData(void (*fn_data)(int8_t id, uint8_t flags))
+{
+  _fn_data = fn_data;
+}
+
+void TInfo::attachNewFrame(void (*fn_new_frame)(void))
+{
+  _fn_new_frame = fn_new_frame;
+}
+
+void TInfo::attachUpdatedFrame(void (*fn_updated_frame)(void))
+{
+  _fn_updated_frame = fn_updated_frame;
+}
+
+/* ======================================================================
+Function: process
+Purpose : feed one received char
+Input   : char from teleinfo serial
+Output  : -
+Comments: a group is checked when its CR is received
+====================================================================== */
+void TInfo::process(char c)
+{
+  switch (c) {
+    case TINFO_STX:
+      _state = TINFO_WAIT_GROUP;
+      _frame_updated = false;
+      break;
+
+    case TINFO_ETX:
+      if (_state == TINFO_WAIT_STX)
+        break;
+      _state = TINFO_WAIT_STX;
+      if (_frame_updated) {
+        if (_fn_updated_frame)
+          _fn_updated_frame();
+      } else if (_fn_new_frame) {
+        _fn_new_frame();
+      }
+      break;
+
+    case TINFO_EOT:
+      _state = TINFO_WAIT_STX;
+      break;
+
+    case TINFO_LF:
+      if (_state != TINFO_WAIT_STX) {
+        _state = TINFO_IN_GROUP;
+        _len = 0;
+      }
+      break;
+
+    case TINFO_CR:
+      if (_state == TINFO_IN_GROUP) {
+        _buff[_len] = '\0';
+        if (!checkLine())
+          keepLine();
+        _state = TINFO_WAIT_GROUP;
+      }
+      break;
+
+    default:
+      if (_state != TINFO_IN_GROUP)
+        break;
+      if (_len < TINFO_BUFSIZE - 1)
+        _buff[_len++] = c;
+      else {
+        _state = TINFO_WAIT_GROUP;      // too long, dropped
+        _buff[_len] = '\0';
+        keepLine();
+      }
+      break;
+  }
+}
+
+/* ======================================================================
+Function: checkLine
+Purpose : check and store a received group
+Input   : -
+Output  : false if group is garbled
+Comments: group is "LABEL SP VALUE SP CHECKSUM", checksum is taken on
+          "LABEL SP VALUE" and may itself be a space. Groups with a
+          bad checksum are ignored
+====================================================================== */
+bool TInfo::checkLine(void)
+{
+  if (_len < 5 || _buff[_len - 2] != TINFO_SP)
+    return false;
+
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < _len - 2; i++)
+    sum += (uint8_t) _buff[i];
+  uint8_t checksum = (sum & 0x3F) + 0x20;
+  if ((uint8_t) _buff[_len - 1] != checksum)
+    return false;
+
+  _buff[_len - 2] = '\0';
+  char * value = strchr(_buff, TINFO_SP);
+  if (!value || value == _buff)
+    return false;
+  *value++ = '\0';
+
+  uint8_t flags = TINFO_FLAGS_NONE;
+  int8_t id = storeValue(_buff, value, checksum, &flags);
+  if (id < 0)
+    return true;
+
+  // Overload, ADPS is phase 0, ADIRx phase x
+  if ((flags & TINFO_FLAGS_ALERT) && _fn_ADPS)
+    _fn_ADPS(id - LABEL_ADPS);
+
+  if (flags & (TINFO_FLAGS_ADDED | TINFO_FLAGS_UPDATED)) {
+    _frame_updated = true;
+    if (_fn_data)
+      _fn_data(id, flags);
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: keepLine
+Purpose : keep previous value of a garbled group
+Input   : -
+Output  : -
+Comments: only if its label can still be read, a group garbled in its
+          label is dropped and so is its label at end of frame
+====================================================================== */
+void TInfo::keepLine(void)
+{
+  char * sp = strchr(_buff, TINFO_SP);
+
+  if (!sp || sp == _buff)
+    return;
+  *sp = '\0';
+
+  int8_t id = tinfoLabelId(_buff);
+  if (id >= 0)
+    valueKeep(id);
+}
+
+/* ======================================================================
+Function: storeValue
+Purpose : put a value in the value store
+Input   : label, value and checksum
+          flags, gets TINFO_FLAGS_xxx of value
+Output  : label ID, -1 if not stored
+Comments: an unknown label or a value too long makes teleinfo reinit
+====================================================================== */
+int8_t TInfo::storeValue(const char * name, const char * value, uint8_t checksum, uint8_t * flags)
+{
+  int8_t id = tinfoLabelId(name);
+
+  if (id < 0) {
+    need_reinit = true;
+    return -1;
+  }
+  if (id >= LABEL_ADPS && id <= LABEL_ADIR3)
+    *flags |= TINFO_FLAGS_ALERT;
+
+  *flags = valueData(id, value, checksum, *flags);
+  return *flags ? id : -1;
+}
+
+/* ======================================================================
+Function: addCustomValue
+Purpose : add or update a value as if it was received
+Input   : label and value
+          flags, gets TINFO_FLAGS_xxx of value
+Output  : label ID, -1 if not stored
+Comments: for tests and simulation, no callback is called
+====================================================================== */
+int8_t TInfo::addCustomValue(const char * name, const char * value, uint8_t * flags)
+{
+  uint8_t sum = TINFO_SP;
+
+  for (const char * p = name; *p; p++)
+    sum += (uint8_t) *p;
+  for (const char * p = value; *p; p++)
+    sum += (uint8_t) *p;
+
+  *flags = TINFO_FLAGS_NONE;
+  return storeValue(name, value, (sum & 0x3F) + 0x20, flags);
+}
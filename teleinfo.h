@@ -0,0 +1,87 @@
+// **********************************************************************************
+// ESP8266 Teleinfo frame decoder Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef TELEINFO_H
+#define TELEINFO_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Frame and group delimiters
+#define TINFO_STX   0x02    // frame start
+#define TINFO_ETX   0x03    // frame end
+#define TINFO_EOT   0x04    // frame interrupted
+#define TINFO_LF    0x0A    // group start
+#define TINFO_CR    0x0D    // group end
+#define TINFO_SP    0x20    // separator
+
+// Value state, same flags as LibTeleinfo
+#define TINFO_FLAGS_NONE     0x00
+#define TINFO_FLAGS_NOTHING  0x01
+#define TINFO_FLAGS_ADDED    0x02
+#define TINFO_FLAGS_EXIST    0x04
+#define TINFO_FLAGS_UPDATED  0x08
+#define TINFO_FLAGS_ALERT    0x80   // ADPS or ADIRx
+
+// Longest group is "BBRHCJB 012345678 C", longer ones are dropped
+#define TINFO_BUFSIZE        24
+
+// Decoder state
+#define TINFO_WAIT_STX       0      // out of frame
+#define TINFO_WAIT_GROUP     1      // in frame, between groups
+#define TINFO_IN_GROUP       2      // in frame, receiving a group
+
+// Decoder of LibTeleinfo API, but it keeps no value list: values go
+// straight into the value store (values.cpp) so they are stored once
+class TInfo
+{
+  public:
+    TInfo();
+    void   init(void);
+    void   process(char c);
+    void   attachADPS(void (*fn_ADPS)(uint8_t phase));
+    void   attachData(void (*fn_data)(int8_t id, uint8_t flags));
+    void   attachNewFrame(void (*fn_new_frame)(void));
+    void   attachUpdatedFrame(void (*fn_updated_frame)(void));
+    int8_t addCustomValue(const char * name, const char * value, uint8_t * flags);
+
+  private:
+    bool   checkLine(void);
+    void   keepLine(void);
+    int8_t storeValue(const char * name, const char * value, uint8_t checksum, uint8_t * flags);
+
+    void (*_fn_ADPS)(uint8_t phase);
+    void (*_fn_data)(int8_t id, uint8_t flags);
+    void (*_fn_new_frame)(void);
+    void (*_fn_updated_frame)(void);
+
+    uint8_t _state;
+    bool    _frame_updated;       // a value was added or changed in frame
+    uint8_t _len;
+    char    _buff[TINFO_BUFSIZE];
+};
+
+// Exported variables
+// ===================================================
+extern TInfo tinfo;
+
+#endif
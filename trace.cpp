@@ -0,0 +1,119 @@
+// **********************************************************************************
+// ESP8266 Teleinfo timeline trace
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "trace.h"
+
+bool        trace_on = false;
+_traceEvent trace_events[TRACE_SIZE];
+uint16_t    trace_head = 0;       // next event written
+uint16_t    trace_count = 0;      // events in ring
+uint32_t    trace_lost = 0;       // events overwritten
+_wifi_state trace_wifi = WIFI_ST_IDLE;
+
+const char * const trace_cats[] = {
+  "loop", "http", "task", "sink", "serial", "frame", "wifi"
+};
+
+const char * const trace_wifi_names[] = {
+  "wifi idle", "wifi connecting", "wifi connected", "wifi lost", "wifi ap"
+};
+
+/* ======================================================================
+Function: traceEvent
+Purpose : record an event
+Input   : category
+          name
+          phase
+Output  : -
+Comments: use TRACE_xxx macros, so nothing is called when off
+====================================================================== */
+void traceEvent(uint8_t cat, const char * name, char ph)
+{
+  _traceEvent * e = &trace_events[trace_head];
+
+  e->ts   = micros();
+  e->name = name;
+  e->ph   = ph;
+  e->cat  = cat;
+
+  if (++trace_head >= TRACE_SIZE)
+    trace_head = 0;
+  if (trace_count < TRACE_SIZE)
+    trace_count++;
+  else
+    trace_lost++;
+}
+
+/* ======================================================================
+Function: traceWifi
+Purpose : record Wifi state changes
+Input   : -
+Output  : -
+Comments: called from main loop
+====================================================================== */
+void traceWifi(void)
+{
+  if (wifi_state != trace_wifi) {
+    trace_wifi = wifi_state;
+    TRACE_MARK(TRACE_WIFI, trace_wifi_names[wifi_state]);
+  }
+}
+
+/* ======================================================================
+Function: traceJSONTable
+Purpose : dump events in Chrome Trace Event format
+Input   : -
+Output  : -
+Comments: ?on=1/0 starts/stops recording, ?clear=1 empties ring.
+          Recording is paused while dumping, timestamps are relative
+          to oldest event so micros() wrap is not seen
+====================================================================== */
+void traceJSONTable(void)
+{
+  bool on = trace_on;
+
+  if (server.hasArg("on"))
+    on = server.arg("on").toInt() != 0;
+  if (server.hasArg("clear"))
+    trace_head = trace_count = trace_lost = 0;
+  trace_on = false;
+
+  uint16_t first = (trace_head + TRACE_SIZE - trace_count) % TRACE_SIZE;
+  uint32_t t0 = trace_count ? trace_events[first].ts : 0;
+
+  respBegin(200, "text/json");
+  respPrint_P(PSTR("{\"traceEvents\":[\r\n"));
+
+  for (uint16_t i = 0; i < trace_count; i++) {
+    _traceEvent * e = &trace_events[(first + i) % TRACE_SIZE];
+
+    respPrintf(PSTR("%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":1,\"tid\":1%s}"),
+               i ? ",\r\n" : "", e->name, trace_cats[e->cat], e->ph, e->ts - t0,
+               e->ph == 'i' ? ",\"s\":\"g\"" : "");
+  }
+
+  respPrintf(PSTR("\r\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"on\":%d,\"events\":%u,\"size\":%u,\"lost\":%u}}\r\n"),
+             on, trace_count, TRACE_SIZE, trace_lost);
+  respEnd();
+
+  trace_on = on;
+}
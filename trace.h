@@ -0,0 +1,66 @@
+// **********************************************************************************
+// ESP8266 Teleinfo timeline trace Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Ring of begin/end events dumped in Chrome Trace Event format by
+// /trace.json, to be opened with chrome://tracing or Perfetto.
+// Recording is off by default, /trace.json?on=1 starts it
+#define TRACE_SIZE      200
+
+// Event categories
+#define TRACE_LOOP      0     // loop() phases
+#define TRACE_HTTP      1     // web routes
+#define TRACE_TASK      2     // sinks, rules, switches
+#define TRACE_SINK      3     // sink steps
+#define TRACE_SERIAL    4     // teleinfo serial bursts
+#define TRACE_FRAME     5     // end of frame processing
+#define TRACE_WIFI      6     // Wifi state changes
+
+typedef struct
+{
+  uint32_t     ts;            // micros()
+  const char * name;          // must stay valid, only pointer is kept
+  char         ph;            // B(egin), E(nd) or i(nstant)
+  uint8_t      cat;
+} _traceEvent;
+
+// Only a test of trace_on when recording is off
+#define TRACE_BEGIN(cat, name) do { if (trace_on) traceEvent(cat, name, 'B'); } while (0)
+#define TRACE_END(cat, name)   do { if (trace_on) traceEvent(cat, name, 'E'); } while (0)
+#define TRACE_MARK(cat, name)  do { if (trace_on) traceEvent(cat, name, 'i'); } while (0)
+
+// Exported variables
+// ===================================================
+extern bool trace_on;
+
+// declared exported function from trace.cpp
+// ===================================================
+void traceEvent(uint8_t cat, const char * name, char ph);
+void traceWifi(void);
+void traceJSONTable(void);
+
+#endif
@@ -0,0 +1,366 @@
+// **********************************************************************************
+// ESP8266 Teleinfo typed values
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "values.h"
+
+const uint8_t value_sizes[] PROGMEM = { VALUE_SIZES };
+static_assert(sizeof(value_sizes) == TINFO_LABELS, "VALUE_SIZES gives size of each label");
+
+_valueSlot value_slots[TINFO_LABELS];
+char       value_pool[VALUE_POOL_SIZE];
+uint8_t    value_off[TINFO_LABELS + 1];   // text of label ID in pool
+uint8_t    value_count = 0;
+uint8_t    value_seen[(TINFO_LABELS + 7) / 8];  // labels of frame being received
+
+// EMONCMS ne sait traiter que des valeurs numériques, donc ici il faut faire une 
+// table de mappage, tout à fait arbitraire, mais c"est celle-ci dont je me sers 
+// depuis mes débuts avec la téléinfo. Les codes sont rangés sur 4 octets et le
+// code est le rang dans la table + 1, 0 si inconnu
+#define VALUE_CODE4(a,b,c,d) ((uint32_t) (a) | (uint32_t) (b) << 8 | (uint32_t) (c) << 16 | (uint32_t) (d) << 24)
+
+// L'option tarifaire choisie (Groupe "OPTARIF") est codée sur 4 caractères alphanumériques 
+// je mets le 4eme char à 0, trop de possibilités
+const uint32_t value_optarif[] = {
+  VALUE_CODE4('B','A','S',0),       // BASE => Option Base
+  VALUE_CODE4('H','C','.',0),       // HC.. => Option Heures Creuses
+  VALUE_CODE4('E','J','P',0),       // EJP. => Option EJP
+  VALUE_CODE4('B','B','R',0),       // BBRx => Option Tempo
+};
+
+// La période tarifaire en cours (Groupe "PTEC"), est codée sur 4 caractères 
+const uint32_t value_ptec[] = {
+  VALUE_CODE4('T','H','.','.'),     // Toutes les Heures
+  VALUE_CODE4('H','C','.','.'),     // Heures Creuses
+  VALUE_CODE4('H','P','.','.'),     // Heures Pleines
+  VALUE_CODE4('H','N','.','.'),     // Heures Normales
+  VALUE_CODE4('P','M','.','.'),     // Heures de Pointe Mobile
+  VALUE_CODE4('H','C','J','B'),     // Heures Creuses Jours Bleus
+  VALUE_CODE4('H','C','J','W'),     // Heures Creuses Jours Blancs (White)
+  VALUE_CODE4('H','C','J','R'),     // Heures Creuses Jours Rouges
+  VALUE_CODE4('H','P','J','B'),     // Heures Pleines Jours Bleus
+  VALUE_CODE4('H','P','J','W'),     // Heures Pleines Jours Blancs (White)
+  VALUE_CODE4('H','P','J','R'),     // Heures Pleines Jours Rouges
+};
+
+// La couleur du lendemain (Groupe "DEMAIN", Tempo), "----" si inconnue
+const uint32_t value_demain[] = {
+  VALUE_CODE4('B','L','E','U'),     // Bleu
+  VALUE_CODE4('B','L','A','N'),     // Blanc
+  VALUE_CODE4('R','O','U','G'),     // Rouge
+};
+
+/* ======================================================================
+Function: valuesInit
+Purpose : lay out value pool
+Input   : -
+Output  : -
+Comments: call once at setup, before teleinfo is started
+====================================================================== */
+void valuesInit(void)
+{
+  uint16_t off = 0;
+
+  for (uint8_t i = 0; i < TINFO_LABELS; i++) {
+    value_off[i] = off;
+    off += pgm_read_byte(&value_sizes[i]) + 1;
+  }
+  value_off[TINFO_LABELS] = off;
+
+  if (off != VALUE_POOL_SIZE)
+    Debugf("Value pool is %u bytes, %u used\r\n", VALUE_POOL_SIZE, off);
+  valuesClear();
+}
+
+/* ======================================================================
+Function: valuesClear
+Purpose : forget all values
+Input   : -
+Output  : -
+Comments: with teleinfo list, at reinit
+====================================================================== */
+void valuesClear(void)
+{
+  memset(value_slots, 0, sizeof(value_slots));
+  memset(value_seen, 0, sizeof(value_seen));
+  value_count = 0;
+}
+
+/* ======================================================================
+Function: valueCode
+Purpose : look for a teleinfo code in a mapping table
+Input   : value
+          table and table size
+          mask of chars to compare
+Output  : rank in table + 1, 0 if not found
+Comments: code is compared as one 32 bits word, no string compare
+====================================================================== */
+uint8_t valueCode(const char * value, const uint32_t * table, uint8_t n, uint32_t mask)
+{
+  uint32_t key = 0;
+
+  for (uint8_t i = 0; i < 4 && value[i]; i++)
+    key |= (uint32_t) (uint8_t) value[i] << (8 * i);
+  key &= mask;
+
+  for (uint8_t i = 0; i < n; i++) {
+    if (table[i] == key)
+      return i + 1;
+  }
+  return 0;
+}
+
+/* ======================================================================
+Function: valueData
+Purpose : store a received value and decode it into the typed slot
+Input   : label ID
+          value and its checksum
+          flags of value (TINFO_FLAGS_ALERT)
+Output  : flags with TINFO_FLAGS_ADDED, UPDATED or EXIST,
+          TINFO_FLAGS_NONE if value is too long
+Comments: called by teleinfo decoder for each group, an unchanged value
+          is not parsed again. A polluted entry makes teleinfo reinit
+====================================================================== */
+uint8_t valueData(int8_t id, const char * value, uint8_t checksum, uint8_t flags)
+{
+  _valueSlot * s = &value_slots[id];
+  char * text = value_pool + value_off[id];
+  const char * v = value;
+
+  if (strlen(v) >= (size_t) (value_off[id + 1] - value_off[id])) {
+    need_reinit = true;
+    return TINFO_FLAGS_NONE;
+  }
+  value_seen[id >> 3] |= 1 << (id & 7);
+
+  if (s->type && !strcmp(text, v)) {
+    s->flags = flags | TINFO_FLAGS_EXIST;
+    return s->flags;
+  }
+
+  s->flags = flags | (s->type ? TINFO_FLAGS_UPDATED : TINFO_FLAGS_ADDED);
+  if (!s->type)
+    value_count++;
+  strcpy(text, v);
+  s->checksum = checksum;
+  s->type = VALUE_CODE;
+  s->skip = 0;
+
+  switch (id) {
+    case LABEL_OPTARIF:
+      s->num = valueCode(v, value_optarif, sizeof(value_optarif)/sizeof(uint32_t), 0x00FFFFFF);
+      return s->flags;
+    case LABEL_PTEC:
+      s->num = valueCode(v, value_ptec, sizeof(value_ptec)/sizeof(uint32_t), 0xFFFFFFFF);
+      return s->flags;
+    case LABEL_HHPHC:
+      // L'horaire heures pleines/heures creuses (Groupe "HHPHC") est codé par un caractère A à Y 
+      // J'ai choisi de prendre son code ASCII
+      s->num = (uint8_t) *v;
+      return s->flags;
+    case LABEL_DEMAIN:
+      s->num = valueCode(v, value_demain, sizeof(value_demain)/sizeof(uint32_t), 0xFFFFFFFF);
+      return s->flags;
+  }
+
+  // Number, leading zeros are skipped
+  const char * p = v;
+  uint32_t n = 0;
+
+  while (*p == '0' && p[1])
+    p++;
+  s->skip = p - v;
+  v = p;
+  while (*p >= '0' && *p <= '9')
+    n = n * 10 + (*p++ - '0');
+
+  s->num = n;
+  if (*p || p == v)
+    s->type = VALUE_TEXT;
+  else if (p - v > 9)
+    s->type = VALUE_DIGITS;
+  else
+    s->type = VALUE_INT;
+  return s->flags;
+}
+
+/* ======================================================================
+Function: valuesFrame
+Purpose : sync store with frame just received
+Input   : -
+Output  : -
+Comments: called at end of each frame, labels not received in this
+          frame are dropped
+====================================================================== */
+void valuesFrame(void)
+{
+  for (uint8_t id = 0; id < TINFO_LABELS; id++) {
+    if (value_slots[id].type && !(value_seen[id >> 3] & (1 << (id & 7)))) {
+      value_slots[id].type = VALUE_NONE;
+      value_count--;
+    }
+  }
+  memset(value_seen, 0, sizeof(value_seen));
+}
+
+/* ======================================================================
+Function: valueKeep
+Purpose : keep a label at end of current frame
+Input   : label ID
+Output  : -
+Comments: its group was garbled in this frame, previous value stays
+          instead of being dropped
+====================================================================== */
+void valueKeep(int8_t id)
+{
+  value_seen[id >> 3] |= 1 << (id & 7);
+}
+
+/* ======================================================================
+Function: valueNext
+Purpose : walk labels of current frame
+Input   : previous label ID, -1 to start
+Output  : next label ID, -1 at end
+Comments: for (id = valueNext(-1); id >= 0; id = valueNext(id))
+====================================================================== */
+int8_t valueNext(int8_t id)
+{
+  while (++id < TINFO_LABELS) {
+    if (value_slots[id].type)
+      return id;
+  }
+  return -1;
+}
+
+/* ======================================================================
+Function: valueText
+Purpose : get text of a value
+Input   : label ID
+Output  : value, NULL if not in current frame
+Comments: -
+====================================================================== */
+const char * valueText(int8_t id)
+{
+  return value_slots[id].type ? value_pool + value_off[id] : NULL;
+}
+
+/* ======================================================================
+Function: valueInt
+Purpose : get number of a value just decoded
+Input   : label ID
+Output  : number, 0 if not a number
+Comments: for derived data fed from data callback
+====================================================================== */
+uint32_t valueInt(int8_t id)
+{
+  uint32_t num;
+
+  return valueNumber(id, num, false) ? num : 0;
+}
+
+/* ======================================================================
+Function: valueNumber
+Purpose : get numeric value of a label
+Input   : label ID
+          where to put number
+          true to take codes as numbers (emoncms, modbus)
+Output  : false if not a number
+Comments: -
+====================================================================== */
+bool valueNumber(int8_t id, uint32_t & num, bool codes)
+{
+  _valueSlot * s = &value_slots[id];
+
+  if (s->type != VALUE_INT && !(codes && s->type == VALUE_CODE))
+    return false;
+  num = s->num;
+  return true;
+}
+
+/* ======================================================================
+Function: valueJSON
+Purpose : stream a value in JSON format
+Input   : label ID
+Output  : -
+Comments: numbers without leading zeros, others as strings
+====================================================================== */
+void valueJSON(int8_t id)
+{
+  _valueSlot * s = &value_slots[id];
+  const char * value = value_pool + value_off[id];
+
+  switch (s->type) {
+    case VALUE_INT:    respPrintf(PSTR("%u"), s->num); break;
+    case VALUE_DIGITS: respPrint(value + s->skip); break;
+    case VALUE_NONE:   respPrint_P(PSTR("null")); break;
+    default:           respPrintf(PSTR("\"%s\""), value); break;
+  }
+}
+
+/* ======================================================================
+Function: valueCBOR
+Purpose : stream a value in CBOR format
+Input   : label ID
+Output  : -
+Comments: same types as JSON
+====================================================================== */
+void valueCBOR(int8_t id)
+{
+  _valueSlot * s = &value_slots[id];
+  const char * value = value_pool + value_off[id];
+
+  switch (s->type) {
+    case VALUE_INT:    cborHead(CBOR_UINT, s->num); break;
+    case VALUE_DIGITS: cborValue(value + s->skip); break;
+    case VALUE_NONE:   cborHead(CBOR_SIMPLE, CBOR_NULL); break;
+    default:           cborText(value); break;
+  }
+}
+
+/* ======================================================================
+Function: valueEmoncms
+Purpose : value sent to emoncms for a teleinfo label
+Input   : label ID
+          buffer for number (12 chars)
+Output  : pointer on value to send
+Comments: codes are sent as numbers, emoncms only takes numbers
+====================================================================== */
+const char * valueEmoncms(int8_t id, char * buf)
+{
+  uint32_t num;
+
+  if (!valueNumber(id, num, true))
+    return value_pool + value_off[id];
+  sprintf_P(buf, PSTR("%u"), num);
+  return buf;
+}
+
+/* ======================================================================
+Function: valuesRAM
+Purpose : RAM taken by value store
+Input   : -
+Output  : bytes
+Comments: teleinfo decoder included, it keeps no value
+====================================================================== */
+uint16_t valuesRAM(void)
+{
+  return sizeof(value_slots) + sizeof(value_pool) + sizeof(value_off) + sizeof(value_seen) + sizeof(tinfo);
+}
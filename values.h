@@ -0,0 +1,93 @@
+// **********************************************************************************
+// ESP8266 Teleinfo typed values Include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// Attribution-NonCommercial-ShareAlike 4.0 International License
+// http://creativecommons.org/licenses/by-nc-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// This program works with the Wifinfo board
+// see schematic here https://github.com/hallard/teleinfo/tree/master/Wifinfo
+//
+// Written by Charles-Henri Hallard (http://hallard.me)
+//
+// History : V1.00 2015-06-14 - First release
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef VALUES_H
+#define VALUES_H
+
+// Include main project include file
+#include "Wifinfo.h"
+
+// Label IDs used by code, index in tabnames
+#define LABEL_OPTARIF   1
+#define LABEL_ISOUSC    2
+#define LABEL_BASE      3
+#define LABEL_HCHC      4
+#define LABEL_HCHP      5
+#define LABEL_IINST     7
+#define LABEL_PTEC      8
+#define LABEL_HHPHC     11
+#define LABEL_IINST1    14    // IINST2, IINST3 follow
+#define LABEL_EJPHN     20
+#define LABEL_EJPHPM    21
+#define LABEL_BBRHCJB   22    // BBRHPJB, BBRHCJW, BBRHPJW, BBRHCJR, BBRHPJR follow
+#define LABEL_DEMAIN    29
+#define LABEL_ADPS      30    // ADIR1, ADIR2, ADIR3 follow
+#define LABEL_ADIR3     33
+
+// Value size of each label from teleinfo specification, in tabnames
+// order, values are kept there with no name string and no malloc
+#define VALUE_SIZES     12, 4, 2, 9, 9, 9,              \
+                        3, 3, 4, 5, 5, 1, 6, 2,         \
+                        3, 3, 3, 3, 3, 3,               \
+                        9, 9, 9, 9, 9, 9, 9,            \
+                        9, 2, 4, 3, 3, 3, 3
+#define VALUE_POOL_SIZE 216   // VALUE_SIZES plus NUL of each
+
+// Type of a value, decoded once when its line is accepted
+#define VALUE_NONE      0     // not in current frame
+#define VALUE_INT       1     // unsigned number fitting 32 bits
+#define VALUE_DIGITS    2     // number too long (ADCO), kept as text
+#define VALUE_CODE      3     // enumerated (OPTARIF, PTEC, HHPHC, DEMAIN)
+#define VALUE_TEXT      4
+
+// Typed slot of a label ID, text is in value pool
+typedef struct
+{
+  uint32_t num;               // number or code, 0 if unknown code
+  uint8_t  type;
+  uint8_t  skip;              // leading zeros of VALUE_DIGITS
+  uint8_t  checksum;
+  uint8_t  flags;             // TINFO_FLAGS_xxx of last frame
+} _valueSlot;
+
+// Exported variables
+// ===================================================
+extern _valueSlot value_slots[];
+extern uint8_t    value_count;      // labels in current frame
+
+// declared exported function from values.cpp
+// ===================================================
+void valuesInit(void);
+void valuesClear(void);
+uint8_t valueData(int8_t id, const char * value, uint8_t checksum, uint8_t flags);
+void valuesFrame(void);
+void valueKeep(int8_t id);
+int8_t valueNext(int8_t id);
+const char * valueText(int8_t id);
+uint32_t valueInt(int8_t id);
+bool valueNumber(int8_t id, uint32_t & num, bool codes);
+void valueJSON(int8_t id);
+void valueCBOR(int8_t id);
+const char * valueEmoncms(int8_t id, char * buf);
+uint16_t valuesRAM(void);
+
+#endif
@@ -21,371 +21,524 @@
 // **********************************************************************************
 
 #include "webclient.h"
-char * Intensite;
+
+// HTTP client pool, objects are created once and reused by every sink
+// instead of being built on stack for each request
+typedef struct
+{
+  WiFiClient client;
+  BearSSL::WiFiClientSecure tls;
+  HTTPClient http;
+} _httpSlot;
+
+_httpSlot httpPool[HTTP_POOL_SIZE];
+uint8_t   httpPoolBusy = 0;  // bit set when slot in use
+
+// TLS session of a server, kept for resumption
+typedef struct
+{
+  uint32_t host;             // hash of host name, 0 if free
+  uint16_t port;
+  int8_t   mfln;             // MFLN support, -1 not probed yet
+  bool     resumable;        // session got from a previous handshake
+  unsigned long used;        // millis() of last use
+  BearSSL::Session session;
+} _tlsCache;
+
+_tlsCache tlsCache[TLS_SESSIONS];
+BearSSL::X509List * tlsCA = NULL;
+bool      tlsCALoaded = false;
+
+// Handshake timings (ms)
+uint16_t tlsFullLast = 0, tlsResumeLast = 0;
+uint16_t tlsFullMax = 0,  tlsResumeMax = 0;
+uint32_t tlsFullSum = 0,  tlsResumeSum = 0;
+uint16_t tlsFullN = 0,    tlsResumeN = 0;
+uint16_t tlsFailN = 0;
+int      tlsLastError = 0;
+
 /* ======================================================================
-Function: httpPost
-Purpose : Do a http post
+Function: httpAcquire
+Purpose : get a free HTTP client from pool
+Input   : -
+Output  : pointer on slot, NULL if all are in use
+Comments: -
+====================================================================== */
+_httpSlot * httpAcquire(void)
+{
+  for (uint8_t i = 0; i < HTTP_POOL_SIZE; i++) {
+    if (!(httpPoolBusy & (1 << i))) {
+      httpPoolBusy |= (1 << i);
+      return &httpPool[i];
+    }
+  }
+  return NULL;
+}
+
+/* ======================================================================
+Function: httpRelease
+Purpose : give back HTTP client to pool
+Input   : slot pointer
+Output  : -
+Comments: -
+====================================================================== */
+void httpRelease(_httpSlot * slot)
+{
+  slot->http.end();
+  slot->tls.stop();
+  httpPoolBusy &= ~(1 << (slot - httpPool));
+}
+
+/* ======================================================================
+Function: tlsCacheGet
+Purpose : get TLS session cache entry of a server
+Input   : host name
+          port
+Output  : cache entry, least recently used one is taken for new server
+Comments: -
+====================================================================== */
+_tlsCache * tlsCacheGet(const char * host, uint16_t port)
+{
+  _tlsCache * c = &tlsCache[0];
+  uint32_t h = 2166136261UL;
+
+  // FNV-1a, 0 means free entry
+  while (*host)
+    h = (h ^ (uint8_t) *host++) * 16777619UL;
+  h |= 1;
+
+  for (uint8_t i = 0; i < TLS_SESSIONS; i++) {
+    if (tlsCache[i].host == h && tlsCache[i].port == port)
+      return &tlsCache[i];
+    if (!tlsCache[i].host || (c->host && tlsCache[i].used < c->used))
+      c = &tlsCache[i];
+  }
+
+  c->host = h;
+  c->port = port;
+  c->mfln = -1;
+  c->resumable = false;
+  c->session = BearSSL::Session();
+  return c;
+}
+
+/* ======================================================================
+Function: tlsSessionParams
+Purpose : BearSSL parameters of a saved session
+Input   : session
+Output  : parameters, session ID tells if server resumed it
+Comments: Session only wraps them and keeps them private, it is a
+          standard layout class so its first member is at its address
+====================================================================== */
+static_assert(sizeof(BearSSL::Session) == sizeof(br_ssl_session_parameters), "Session only wraps br_ssl_session_parameters");
+
+const br_ssl_session_parameters * tlsSessionParams(const BearSSL::Session * session)
+{
+  return reinterpret_cast<const br_ssl_session_parameters *>(session);
+}
+
+/* ======================================================================
+Function: tlsConnect
+Purpose : open TLS connection of a slot
+Input   : slot
+          hostname
+          port
+          TLS_VERIFY or TLS_INSECURE
+          fingerprint of server, NULL if not pinned
+Output  : true if connected, HTTP client then uses the connection
+Comments: handshake is timed, resumed ones apart from full ones, it
+          is resumed only if server gave back the session ID. MFLN
+          is probed once per server, small buffers are used if server
+          accepts it. A server that can't be checked is refused unless
+          user chose TLS_INSECURE
+====================================================================== */
+bool tlsConnect(_httpSlot * slot, const char * host, uint16_t port, uint8_t mode, const uint8_t * fp)
+{
+  BearSSL::WiFiClientSecure & tls = slot->tls;
+  _tlsCache * c;
+
+  // CA is loaded once, kept for all connections
+  if (!tlsCALoaded) {
+    File f = SPIFFS.open(TLS_CA_FILE, "r");
+    tlsCALoaded = true;
+    if (f) {
+      String pem = f.readString();
+      f.close();
+      tlsCA = new BearSSL::X509List(pem.c_str());
+    }
+  }
+
+  if (tlsPinned(fp))
+    tls.setFingerprint(fp);
+  else if (mode == TLS_INSECURE) {
+    Logf(LOG_WARN, "\r\nTLS: %s not checked (insecure) ", host);
+    tls.setInsecure();
+  } else if (tlsCA)
+    tls.setTrustAnchors(tlsCA);
+  else {
+    tlsFailN++;
+    Logf(LOG_ERR, "\r\nTLS: %s refused, no fingerprint nor %s ", host, TLS_CA_FILE);
+    return false;
+  }
+
+  c = tlsCacheGet(host, port);
+  c->used = millis();
+
+  if (c->mfln < 0)
+    c->mfln = BearSSL::WiFiClientSecure::probeMaxFragmentLength(host, port, TLS_MFLN);
+  tls.setBufferSizes(c->mfln ? TLS_MFLN : TLS_RX_DEFAULT, TLS_MFLN);
+  tls.setSession(&c->session);
+
+  // Session ID offered, a full handshake gives a new one
+  const br_ssl_session_parameters * sp = tlsSessionParams(&c->session);
+  uint8_t sid[sizeof(sp->session_id)];
+  uint8_t sid_len = c->resumable ? sp->session_id_len : 0;
+  memcpy(sid, sp->session_id, sid_len);
+
+  unsigned long start = millis();
+  TRACE_BEGIN(TRACE_SINK, "tls");
+  bool ok = tls.connect(host, port);
+  TRACE_END(TRACE_SINK, "tls");
+  uint16_t ms = millis() - start;
+  heapSample();
+
+  if (!ok) {
+    tlsLastError = tls.getLastSSLError();
+    tlsFailN++;
+    c->resumable = false;
+    Debugf("TLS error %d in %d ms ", tlsLastError, ms);
+    return false;
+  }
+
+  if (sid_len && sp->session_id_len == sid_len && !memcmp(sid, sp->session_id, sid_len)) {
+    tlsResumeLast = ms;
+    tlsResumeSum += ms;
+    tlsResumeN++;
+    if (ms > tlsResumeMax)
+      tlsResumeMax = ms;
+  } else {
+    tlsFullLast = ms;
+    tlsFullSum += ms;
+    tlsFullN++;
+    if (ms > tlsFullMax)
+      tlsFullMax = ms;
+  }
+  c->resumable = true;
+  Debugf("TLS %s in %d ms ", c->mfln ? "MFLN" : "", ms);
+  return true;
+}
+
+/* ======================================================================
+Function: tlsFingerprintParse
+Purpose : read SHA1 fingerprint from hex string
+Input   : string, AA:BB:.. or AABB.. or AA BB ..
+          fingerprint to fill
+Output  : false if not a full fingerprint, fp is then cleared
+Comments: empty string clears fingerprint and is ok
+====================================================================== */
+bool tlsFingerprintParse(const char * str, uint8_t * fp)
+{
+  uint8_t n = 0;
+
+  memset(fp, 0, CFG_TLS_FP_SIZE);
+  while (*str && n < 2 * CFG_TLS_FP_SIZE) {
+    char c = *str++;
+    uint8_t v;
+
+    if (c == ':' || c == ' ')
+      continue;
+    if (c >= '0' && c <= '9')
+      v = c - '0';
+    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+      v = (c | 0x20) - 'a' + 10;
+    else
+      break;
+    fp[n / 2] |= (n & 1) ? v : v << 4;
+    n++;
+  }
+
+  if (n && n != 2 * CFG_TLS_FP_SIZE) {
+    memset(fp, 0, CFG_TLS_FP_SIZE);
+    return false;
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: tlsPinned
+Purpose : check if a fingerprint is set
+Input   : fingerprint, may be NULL
+Output  : true if not all zero
+Comments: -
+====================================================================== */
+bool tlsPinned(const uint8_t * fp)
+{
+  bool pinned = false;
+
+  for (uint8_t i = 0; fp && i < CFG_TLS_FP_SIZE; i++)
+    pinned |= fp[i] != 0;
+  return pinned;
+}
+
+/* ======================================================================
+Function: tlsFingerprintStr
+Purpose : write fingerprint as AA:BB:..
+Input   : fingerprint
+          string (3 * CFG_TLS_FP_SIZE chars)
+Output  : -
+Comments: empty string if not set
+====================================================================== */
+void tlsFingerprintStr(const uint8_t * fp, char * str)
+{
+  *str = '\0';
+  if (!tlsPinned(fp))
+    return;
+
+  for (uint8_t i = 0; i < CFG_TLS_FP_SIZE; i++)
+    sprintf_P(str + 3 * i, PSTR("%s%02X"), i ? ":" : "", fp[i]);
+}
+
+/* ======================================================================
+Function: tlsJSONTable
+Purpose : dump TLS sessions and handshake timings in JSON
+Input   : -
+Output  : -
+Comments: resumed are handshakes done with a session of a previous
+          one, if server refused it their time is a full one
+====================================================================== */
+void tlsJSONTable(void)
+{
+  char fp[3 * CFG_TLS_FP_SIZE];
+
+  tlsFingerprintStr(config.tls_fp, fp);
+  respBegin(200, "text/json");
+  respPrintf(PSTR("{\r\n\"fingerprint\":\"%s\",\"ca\":%d,\"mfln\":%u,\"failed\":%u,\"error\":%d,\r\n"),
+             fp, tlsCA != NULL, TLS_MFLN, tlsFailN, tlsLastError);
+  respPrintf(PSTR("\"full\":{\"n\":%u,\"last\":%u,\"max\":%u,\"avg\":%u},\r\n"),
+             tlsFullN, tlsFullLast, tlsFullMax, tlsFullN ? tlsFullSum / tlsFullN : 0);
+  respPrintf(PSTR("\"resumed\":{\"n\":%u,\"last\":%u,\"max\":%u,\"avg\":%u},\r\n\"sessions\":[\r\n"),
+             tlsResumeN, tlsResumeLast, tlsResumeMax, tlsResumeN ? tlsResumeSum / tlsResumeN : 0);
+
+  bool first = true;
+  for (uint8_t i = 0; i < TLS_SESSIONS; i++) {
+    _tlsCache * c = &tlsCache[i];
+    if (!c->host)
+      continue;
+    respPrintf(PSTR("%s{\"host\":\"%08X\",\"port\":%u,\"mfln\":%d,\"resumable\":%d,\"idle\":%lu}"),
+               first ? "" : ",\r\n", c->host, c->port, c->mfln, c->resumable, (millis() - c->used) / 1000);
+    first = false;
+  }
+  respPrint_P(PSTR("\r\n]\r\n}\r\n"));
+  respEnd();
+}
+
+/* ======================================================================
+Function: tinfoValue
+Purpose : find value of a teleinfo label
+Input   : label name
+          name length (0 for null terminated name)
+Output  : pointer on value, NULL if not found
+Comments: -
+====================================================================== */
+const char * tinfoValue(const char * name, size_t len)
+{
+  char label[16];
+
+  if (!len)
+    len = strlen(name);
+  if (len >= sizeof(label))
+    return NULL;
+
+  memcpy(label, name, len);
+  label[len] = '\0';
+
+  int8_t id = tinfoLabelId(label);
+  return id >= 0 ? valueText(id) : NULL;
+}
+
+/* ======================================================================
+Function: httpSend
+Purpose : Do a http GET, or POST when there is a body
 Input   : hostname
           port
           url
+          body (NULL for GET)
+          body length
+          TLS_OFF, TLS_VERIFY or TLS_INSECURE
+          fingerprint of server, NULL if not pinned
 Output  : true if received 200 OK
-Comments: -
+Comments: body is sent as form data
 ====================================================================== */
-boolean httpPost(char * host, uint16_t port, char * url)
+boolean httpSend(char * host, uint16_t port, char * url, const char * body, size_t len,
+                 uint8_t tls_mode, const uint8_t * fp)
 {
-  HTTPClient http;
+  _httpSlot * slot = httpAcquire();
   bool ret = false;
 
+  if (!slot) {
+    DebuglnF("httpPost: no free client");
+    return false;
+  }
+
   unsigned long start = millis();
+  bool tls = (tls_mode != TLS_OFF);
+
+  Debugf("http%s://%s:%d%s => ", tls?"s":"", host, port, url);
+
+  // TLS connection is opened first, HTTP client then reuses it
+  if (tls && !tlsConnect(slot, host, port, tls_mode, fp)) {
+    httpRelease(slot);
+    Debugf(" in %d ms\r\n",millis()-start);
+    return false;
+  }
 
   // configure traged server and url
-  http.begin(host, port, url); 
+  slot->http.begin(tls ? slot->tls : slot->client, host, port, url, tls); 
   //http.begin("http://emoncms.org/input/post.json?node=20&apikey=2f13e4608d411d20354485f72747de7b&json={PAPP:100}");
   //http.begin("emoncms.org", 80, "/input/post.json?node=20&apikey=2f13e4608d411d20354485f72747de7b&json={}"); //HTTP
 
-  Debugf("http%s://%s:%d%s => ", port==443?"s":"", host, port, url);
-
   // start connection and send HTTP header
-  int httpCode = http.GET();
+  int httpCode;
+  if (body) {
+    Debugf("(%u bytes) ", (unsigned int) len);
+    slot->http.addHeader(F("Content-Type"), F("application/x-www-form-urlencoded"));
+    httpCode = slot->http.POST((uint8_t *) body, len);
+  } else {
+    httpCode = slot->http.GET();
+  }
+  heapSample();
   if(httpCode) {
       // HTTP header has been send and Server response header has been handled
       Debug(httpCode);
       Debug(" ");
       // file found at server
       if(httpCode == 200) {
-        String payload = http.getString();
+        // Only show start of payload, no need to buffer it all
+        char payload[48];
+        WiFiClient * stream = slot->http.getStreamPtr();
+        int len = 0;
+        if (stream && stream->available())
+          len = stream->read((uint8_t *) payload, sizeof(payload) - 1);
+        payload[len > 0 ? len : 0] = '\0';
         Debug(payload);
         ret = true;
       }
   } else {
       DebugF("failed!");
   }
+  httpRelease(slot);
   Debugf(" in %d ms\r\n",millis()-start);
   return ret;
 }
+
 /* ======================================================================
-Function: build_emoncms_json string (usable by webserver.cpp)
-Purpose : construct the json part of emoncms url
-Input   : -
-Output  : String if some Teleinfo data available
+Function: httpPost
+Purpose : Do a http post
+Input   : hostname
+          port
+          url
+          TLS_OFF, TLS_VERIFY or TLS_INSECURE
+          fingerprint of server, NULL if not pinned
+Output  : true if received 200 OK
 Comments: -
 ====================================================================== */
-String build_emoncms_json(void)
+boolean httpPost(char * host, uint16_t port, char * url, uint8_t tls, const uint8_t * fp)
 {
-  boolean first_item = true;
-  
-  String url = "{" ;
-
-  ValueList * me = tinfo.getList();
-
-  if (me) {
-      // Loop thru the node
-      while (me->next) {
-
-         if(! first_item) 
-          // go to next node
-          me = me->next;
-        
-         if( ! me->free ) {
-                
-             
-            // On first item, do not add , separator
-            if (first_item)
-              first_item = false;
-            else
-              url += ",";
-              
-            
-            if(validate_value_name(me->name)) {
-              url +=  me->name ;
-              url += ":" ;
-      
-              // EMONCMS ne sait traiter que des valeurs numériques, donc ici il faut faire une 
-              // table de mappage, tout à fait arbitraire, mais c"est celle-ci dont je me sers 
-              // depuis mes débuts avec la téléinfo
-              if (!strcmp(me->name, "OPTARIF")) {
-                // L'option tarifaire choisie (Groupe "OPTARIF") est codée sur 4 caractères alphanumériques 
-                /* J'ai pris un nombre arbitraire codé dans l'ordre ci-dessous
-                je mets le 4eme char à 0, trop de possibilités
-                BASE => Option Base. 
-                HC.. => Option Heures Creuses. 
-                EJP. => Option EJP. 
-                BBRx => Option Tempo
-                */
-                char * p = me->value;
-                  
-                     if (*p=='B'&&*(p+1)=='A'&&*(p+2)=='S') url += "1";
-                else if (*p=='H'&&*(p+1)=='C'&&*(p+2)=='.') url += "2";
-                else if (*p=='E'&&*(p+1)=='J'&&*(p+2)=='P') url += "3";
-                else if (*p=='B'&&*(p+1)=='B'&&*(p+2)=='R') url += "4";
-                else url +="0";
-              } else if (!strcmp(me->name, "HHPHC")) {
-                // L'horaire heures pleines/heures creuses (Groupe "HHPHC") est codé par un caractère A à Y 
-                // J'ai choisi de prendre son code ASCII
-                int code = *me->value;
-                url += String(code);
-              } else if (!strcmp(me->name, "PTEC")) {
-                // La période tarifaire en cours (Groupe "PTEC"), est codée sur 4 caractères 
-                /* J'ai pris un nombre arbitraire codé dans l'ordre ci-dessous
-                TH.. => Toutes les Heures. 
-                HC.. => Heures Creuses. 
-                HP.. => Heures Pleines. 
-                HN.. => Heures Normales. 
-                PM.. => Heures de Pointe Mobile. 
-                HCJB => Heures Creuses Jours Bleus. 
-                HCJW => Heures Creuses Jours Blancs (White). 
-                HCJR => Heures Creuses Jours Rouges. 
-                HPJB => Heures Pleines Jours Bleus. 
-                HPJW => Heures Pleines Jours Blancs (White). 
-                HPJR => Heures Pleines Jours Rouges. 
-                */
-                     if (!strcmp(me->value, "TH..")) url += "1";
-                else if (!strcmp(me->value, "HC..")) url += "2";
-                else if (!strcmp(me->value, "HP..")) url += "3";
-                else if (!strcmp(me->value, "HN..")) url += "4";
-                else if (!strcmp(me->value, "PM..")) url += "5";
-                else if (!strcmp(me->value, "HCJB")) url += "6";
-                else if (!strcmp(me->value, "HCJW")) url += "7";
-                else if (!strcmp(me->value, "HCJR")) url += "8";
-                else if (!strcmp(me->value, "HPJB")) url += "9";
-                else if (!strcmp(me->value, "HPJW")) url += "10";
-                else if (!strcmp(me->value, "HPJR")) url += "11";
-                else url +="0";
-              } else {
-                url += me->value;
-              }
-            } else {
-              //Value name not valid : ignore this value, and
-              //  force Teleinfo to reinit on next loop !
-              need_reinit=true;
-            }
-         } //not free entry
-      } // While next
-
-  } //if me
-  // Json end
-  url += "}";
-      
-  return url;
+  return httpSend(host, port, url, NULL, 0, tls, fp);
 }
 
 /* ======================================================================
-Function: emoncmsPost (called by main sketch on timer, if activated)
-Purpose : Do a http post to emoncms
-Input   : 
-Output  : true if post returned 200 OK
+Function: build_emoncms_json string (usable by webserver.cpp)
+Purpose : construct the json part of emoncms url
+Input   : buffer where to write json
+          buffer size
+Output  : false if buffer was too small
 Comments: -
 ====================================================================== */
-boolean emoncmsPost(void)
+bool build_emoncms_json(char * buf, size_t size)
 {
-  boolean ret = false;
-
-  // Some basic checking
-  if (*config.emoncms.host) {
-    ValueList * me = tinfo.getList();
-    // Got at least one ?
-    if (me && me->next) {
-      String url ; 
-      
-
-      url = *config.emoncms.url ? config.emoncms.url : "/";
-      url += "?";
-      if (config.emoncms.node>0) {
-        url+= F("node=");
-        url+= String(config.emoncms.node);
-        url+= "&";
-      } 
-
-      url += F("apikey=") ;
-      url += config.emoncms.apikey;
-
-      //append json list of values
-      url += F("&json=") ;
-      
-      url += build_emoncms_json();  //Get Teleinfo list of values
+  boolean first_item = true;
+  uint16_t idx = 0;
+  bool ok;
+  
+  ok = bufPrintf(buf, size, idx, PSTR("{"));
 
-      // And submit all to emoncms
-      ret = httpPost( config.emoncms.host, config.emoncms.port, (char *) url.c_str()) ;
+  // Loop thru the labels of frame
+  for (int8_t id = valueNext(-1); ok && id >= 0; id = valueNext(id)) {
+    char code[12];
+    const char * value = valueEmoncms(id, code);
 
-    } // if me
-  } // if host
-  return ret;
-}
+    // On first item, do not add , separator
+    ok = bufPrintf(buf, size, idx, PSTR("%s%s:%s"), first_item ? "" : ",", tabnames[id], value);
+    first_item = false;
+  }
 
-/* ======================================================================
-Function: jeedomPost
-Purpose : Do a http post to jeedom server
-Input   : 
-Output  : true if post returned 200 OK
-Comments: -
-====================================================================== */
-boolean jeedomPost(void)
-{
-  boolean ret = false;
+  // Virtual labels (pulse counters, power)
+  char name[16], value[16];
+  for (uint8_t n = 0; ok && virtualLabel(n, name, value); n++) {
+    ok = bufPrintf(buf, size, idx, PSTR("%s%s:%s"), first_item ? "" : ",", name, value);
+    first_item = false;
+  }
 
-  // Some basic checking
-  if (*config.jeedom.host) {
-    ValueList * me = tinfo.getList();
-    // Got at least one ?
-    if (me && me->next) {
-      String url ; 
-      boolean skip_item;
-
-      url = *config.jeedom.url ? config.jeedom.url : "/";
-      url += "?";
-
-      // Config identifiant forcée ?
-      if (*config.jeedom.adco) {
-        url+= F("ADCO=");
-        url+= config.jeedom.adco;
-        url+= "&";
-      } 
-
-      url += F("api=") ;
-      url += config.jeedom.apikey;
-      url += F("&") ;
-
-      // Loop thru the node
-      while (me->next) {
-        // go to next node
-        me = me->next;
-        skip_item = false;
-
-        // Si ADCO déjà renseigné, on le remet pas
-        if (!strcmp(me->name, "ADCO")) {
-          if (*config.jeedom.adco)
-            skip_item = true;
-        }
-
-        // Si Item virtuel, on le met pas
-        if (*me->name =='_')
-          skip_item = true;
-
-        // On doit ajouter l'item ?
-        if (!skip_item) {
-          url +=  me->name ;
-          url += "=" ;
-          url +=  me->value;
-          url += "&" ;
-        }
-      } // While me
-
-      ret = httpPost( config.jeedom.host, config.jeedom.port, (char *) url.c_str()) ;
-    } // if me
-  } // if host
-  return ret;
+  // Json end
+  return ok && bufPrintf(buf, size, idx, PSTR("}"));
 }
 
 /* ======================================================================
-Function: HTTP Request
-Purpose : Do a http request
-Input   : 
-Output  : true if post returned 200 OK
-Comments: -
+Function: urlExpand
+Purpose : build URL from a template with teleinfo values
+Input   : template, any %LABEL% is replaced by current value of LABEL
+          where to put URL
+          URL buffer size
+Output  : false if URL too long
+Comments: unknown labels are left as is, %_X% are virtual labels
 ====================================================================== */
-boolean httpRequest(void)
+bool urlExpand(const char * p, char * url, size_t size)
 {
-  boolean ret = false;
-
-  // Some basic checking
-  if (*config.httpReq.host)
-  {
-    ValueList * me = tinfo.getList();
-    // Got at least one ?
-    if (me && me->next)
-    {
-      String url ; 
-      boolean skip_item;
-
-      url = *config.httpReq.path ? config.httpReq.path : "/";
-      url += "?";
-
-      // Loop thru the node
-      while (me->next) {
-        // go to next node
-        me = me->next;
-        skip_item = false;
-
-        // Si Item virtuel, on le met pas
-        if (*me->name =='_')
-          skip_item = true;
-
-        // On doit ajouter l'item ?
-        if (!skip_item)
-        {
-          String valName = String(me->name);
-          if (valName == "HCHP")
-          {
-            url.replace("%HCHP%", me->value);
-          }
-          if (valName == "HCHC")
-          {
-            url.replace("%HCHC%", me->value);
-          }
-          if (valName == "PAPP")
-          {
-            url.replace("%PAPP%", me->value);
-          }
-		   if (valName == "ADCO")
-          {
-            url.replace("%ADCO%", me->value);
-          }
-		  if (valName == "OPTARIF")
-          {
-            url.replace("%OPTARIF%", me->value);
-          }
-		  if (valName == "ISOUC")
-          {
-            url.replace("%ISOUC%", me->value);
-          }
-		  if (valName == "PTEC")
-          {
-            url.replace("%PTEC%", me->value);
-          }
-		  if (valName == "IINST")
-          { 
-           
-            Intensite = me->value;
-            url.replace("%IINST%", me->value);
-          }
-		  if (valName == "IMAX")
-          {
-            url.replace("%IMAX%", me->value);
-          }
-		  if (valName == "HHPHC")
-          {
-            url.replace("%HHPHC%", me->value);
-          }
-		  if (valName == "MOTDETAT")
-          {
-            url.replace("%MOTDETAT%", me->value);
-          }
-		  if (valName == "BASE")
-          {
-            url.replace("%BASE%", me->value);
-          }
-	 }
-      } // While me
-
-      ret = httpPost( config.httpReq.host, config.httpReq.port, (char *) url.c_str()) ;
-    } // if me
-  } // if host
-  return ret;
+  uint16_t idx = 0;
+  const char * value;
+  char virt[16];
+  bool ok = true;
+
+  *url = '\0';
+  while (*p && ok) {
+    const char * end = (*p == '%') ? strchr(p + 1, '%') : NULL;
+
+    // %LABEL% known ? put its value
+    value = NULL;
+    if (end && end > p + 1) {
+      if (p[1] != '_')
+        value = tinfoValue(p + 1, end - p - 1);
+      else if (virtualValue(p + 1, end - p - 1, virt))
+        value = virt;
+    }
+
+    if (value) {
+      ok = bufPrintf(url, size, idx, PSTR("%s"), value);
+      p = end + 1;
+    } else {
+      ok = bufPrintf(url, size, idx, PSTR("%c"), *p++);
+    }
+  }
+  return ok;
 }
 
 /* ======================================================================
 Function: UPD_switch
 Purpose : Do a http request to update Switch state into Domoticz
-Input   : 
+Input   : input number
 Output  : true if post returned 200 OK
 Comments: -
 ====================================================================== */
-boolean UPD_switch(void)
+boolean UPD_switch(int input)
 {
   boolean ret = false;
 
+  if (input < 0 || input >= inputs_count)
+    return false;
+
   // Some basic checking
-  if (*config.httpReq.host && (config.httpReq.swidx != 0) )
+  if (*config.httpReq.host && (inputs[input].idx != 0) )
   {
       char url[128]; 
       char State[5];
@@ -394,36 +547,14 @@ boolean UPD_switch(void)
       if(port == 0)
         port = 80;
 
-      if(SwitchState)
+      if(inputs[input].level)
         sprintf(State,"Off");  //switch ouvert
       else
         sprintf(State,"On");   //switch fermé : portail fermé 
 
-      sprintf(url,"/json.htm?type=command&param=switchlight&idx=%d&switchcmd=%s",(int)config.httpReq.swidx, State);
+      sprintf(url,"/json.htm?type=command&param=switchlight&idx=%d&switchcmd=%s",(int)inputs[input].idx, State);
       //Debugf("Updating switch: <%s>\n",  url );
-      ret = httpPost( config.httpReq.host, port, url) ;
-   
-  } // if host & idx
-  return ret;
-}
-
-boolean UPD_ADPS(void)
-{
-  boolean ret = false;
-
-  // Some basic checking
-  if (*config.httpReq.host && (config.httpReq.adpsidx != 0) )
-  {   
-      char Status[5];
-      char url[128]; 
-      uint16_t port = config.httpReq.port;
-
-      if(port == 0)
-        port = 80;
-
-      sprintf(url,"/json.htm?type=command&param=udevice&idx=%d&nvalue=4&svalue=%s",(int)config.httpReq.adpsidx, Status);
-      //Debugf("Envoie ADPS: <%s>\n",  url );
-      ret = httpPost( config.httpReq.host, port, url) ;
+      ret = httpPost( config.httpReq.host, port, url, config.httpReq.tls, config.tls_fp) ;
    
   } // if host & idx
   return ret;
@@ -433,8 +564,10 @@ boolean UPD_I(void)
 {
   boolean ret = false;
 
-  // Some basic checking
-  if (*config.httpReq.host && (config.httpReq.iidx != 0) )
+  // Intensité instantanée
+  const char * Intensite = tinfoValue("IINST", 0);
+
+  if (*config.httpReq.host && (config.httpReq.iidx != 0) && Intensite)
   {   
       
       char url[128]; 
@@ -445,7 +578,7 @@ boolean UPD_I(void)
 
       sprintf(url,"/json.htm?type=command&param=udevicet&idx=%d&nvalue=0&svalue=%s",(int)config.httpReq.iidx, Intensite);
       //Debugf("Envoie Intensite: <%s>\n",  url );
-      ret = httpPost( config.httpReq.host, port, url) ;
+      ret = httpPost( config.httpReq.host, port, url, config.httpReq.tls, config.tls_fp) ;
    
   } // if host & idx
   return ret;
@@ -26,23 +26,52 @@
 // Include main project include file
 #include "Wifinfo.h"
 
+// HTTP clients kept in pool, sinks are run one at a time from loop()
+#define HTTP_POOL_SIZE     1
+// Max size of URL built by sinks (taken from response arena)
+#define HTTP_URL_SIZE      2048
+// Max size of emoncms JSON values list
+#define EMONCMS_JSON_SIZE  1536
+
+// Sinks with TLS set (https:// in sinks file) check server against
+// their fingerprint, else against CA of TLS_CA_FILE, else connection is
+// refused unless sink is TLS_INSECURE. Fingerprint of configuration is
+// for sinks of configuration only. Sessions are cached per server so
+// only first upload does a full handshake. To test against a local
+// stand-in server:
+//   openssl req -x509 -newkey rsa:2048 -nodes -subj /CN=test -keyout k.pem -out c.pem
+//   openssl s_server -accept 443 -key k.pem -cert c.pem -www -no_ticket
+// then set sink host to the PC and fingerprint to the output of
+//   openssl x509 -in c.pem -noout -fingerprint -sha1
+#define HTTPS_PORT         443        // default port of https://
+#define TLS_SESSIONS       3          // servers with cached session
+#define TLS_MFLN           512        // fragment length asked to server
+#define TLS_RX_DEFAULT     16384      // receive buffer without MFLN
+#define TLS_CA_FILE        "/ca.pem"
+
 // Exported variables/object instancied in main sketch
 // ===================================================
 extern bool          need_reinit;
 
 // Exported function instancied in webserver.cpp
 // =============================================
-extern bool          validate_value_name(String name);
+extern bool          validate_value_name(const char * name);
+extern bool          virtualLabel(uint8_t n, char * name, char * value);
+extern bool          virtualValue(const char * name, size_t len, char * value);
 
 // declared exported function from webclient.cpp
 // ===================================================
-boolean httpPost(char * host, uint16_t port, char * url);
-boolean emoncmsPost(void);
-boolean jeedomPost(void);
-boolean httpRequest(void);
-boolean UPD_switch(void);
-boolean UPD_ADPS(void);
+boolean httpSend(char * host, uint16_t port, char * url, const char * body, size_t len,
+                 uint8_t tls, const uint8_t * fp);
+boolean httpPost(char * host, uint16_t port, char * url, uint8_t tls, const uint8_t * fp);
+boolean UPD_switch(int input);
 boolean UPD_I(void);
-String  build_emoncms_json(void);
+bool    build_emoncms_json(char * buf, size_t size);
+const char * tinfoValue(const char * name, size_t len);
+bool    urlExpand(const char * p, char * url, size_t size);
+bool    tlsFingerprintParse(const char * str, uint8_t * fp);
+void    tlsFingerprintStr(const uint8_t * fp, char * str);
+bool    tlsPinned(const uint8_t * fp);
+void    tlsJSONTable(void);
 
 #endif
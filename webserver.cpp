@@ -34,32 +34,368 @@ const char FP_RESTART[] PROGMEM = "OK, Redémarrage en cours\r\n";
 const char FP_NL[] PROGMEM = "\r\n";
 
 //List of authorized value names in Teleinfo, to detect polluted entries
-const String tabnames[35] = { 
+const char * const tabnames[] = { 
   "ADCO" , "OPTARIF" , "ISOUSC" , "BASE", "HCHC" , "HCHP",
    "IMAX" , "IINST" , "PTEC", "PMAX", "PAPP", "HHPHC" , "MOTDETAT" , "PPOT",
    "IINST1" , "IINST2" , "IINST3", "IMAX1" , "IMAX2" , "IMAX3" , 
   "EJPHN" , "EJPHPM" , "BBRHCJB" , "BBRHPJB", "BBRHCJW" , "BBRHPJW" , "BBRHCJR" ,
   "BBRHPJR" , "PEJP" , "DEMAIN" , "ADPS" , "ADIR1", "ADIR2" , "ADIR3"
   };
+static_assert(sizeof(tabnames)/sizeof(tabnames[0]) == TINFO_LABELS, "TINFO_LABELS is size of tabnames");
 
+// Label name to ID hash table (open addressing, -1 is empty)
+int8_t      tinfo_hash[TINFO_HASH_SIZE];
+
+
+// Web response arena, the streamed chunk buffer and per request scratch
+// buffers (URL, JSON) are carved from it, all released at end of request
+char      response[RESPONSE_BUFFER_SIZE] __attribute__((aligned(4)));
+uint16_t  response_idx = 0;   // arena top
+uint16_t  response_peak = 0;  // arena high water mark
+uint16_t  response_fail = 0;  // arena allocation failures, cut responses
+
+// Chunk being streamed, carved from arena by respBegin()
+char *    resp_chunk = NULL;
+uint16_t  resp_len = 0;
+
+// Headers are sent with first chunk, once size tells if response is
+// worth compressing
+int       resp_code;
+const char * resp_type;
+bool      resp_started = false;
+bool      resp_gzip = false;
+bool      resp_failed = false;  // content was lost, response is cut
+_gzip     resp_z;
+
+/* ======================================================================
+Function: arenaAlloc 
+Purpose : get a scratch buffer from the response arena
+Input   : size needed
+Output  : pointer on buffer, NULL if arena is full
+Comments: no free, everything is released by arenaReset()
+====================================================================== */
+void * arenaAlloc(size_t size)
+{
+  void * p;
+
+  // Keep 32 bits alignment
+  size = (size + 3) & ~3;
+
+  if (response_idx + size > RESPONSE_BUFFER_SIZE) {
+    response_fail++;
+    Logf(LOG_ERR, "arenaAlloc(%d) failed!\r\n", (int) size);
+    return NULL;
+  }
+
+  p = response + response_idx;
+  response_idx += size;
+  if (response_idx > response_peak)
+    response_peak = response_idx;
+
+  return p;
+}
+
+/* ======================================================================
+Function: arenaReset 
+Purpose : release all the response arena in one shot
+Input   : -
+Output  : - 
+Comments: called at end of each request / sink
+====================================================================== */
+void arenaReset(void)
+{
+  response_idx = 0;
+  resp_chunk = NULL;
+  resp_len = 0;
+}
+
+/* ======================================================================
+Function: respBegin 
+Purpose : start a chunked response, content will be streamed
+Input   : HTTP code
+          content type
+Output  : - 
+Comments: -
+====================================================================== */
+void respBegin(int code, const char * content_type)
+{
+  arenaReset();
+  resp_chunk = (char *) arenaAlloc(RESPONSE_CHUNK_SIZE);
+  resp_code = code;
+  resp_type = content_type;
+  resp_started = false;
+  resp_gzip = false;
+  resp_failed = false;
+}
+
+/* ======================================================================
+Function: respFail 
+Purpose : mark response as failed
+Input   : -
+Output  : - 
+Comments: rest of content is dropped, respEnd() won't terminate it
+          so client doesn't take a cut document as complete
+====================================================================== */
+void respFail(void)
+{
+  if (!resp_failed) {
+    resp_failed = true;
+    response_fail++;
+    Logf(LOG_ERR, "Response to %s cut\r\n", server.uri().c_str());
+  }
+}
+
+/* ======================================================================
+Function: respGzipOut 
+Purpose : send compressed data as a chunk
+Input   : data
+          size
+Output  : - 
+Comments: -
+====================================================================== */
+void respGzipOut(const uint8_t * data, size_t len)
+{
+  server.sendContent_P((const char *) data, len);
+}
+
+/* ======================================================================
+Function: respStart 
+Purpose : send response headers
+Input   : true if response is big enough to be compressed
+Output  : - 
+Comments: compressed only if client accepts gzip and arena has room
+          for encoder
+====================================================================== */
+void respStart(bool big)
+{
+  if (resp_started)
+    return;
+  resp_started = true;
+
+  if (big && server.header("Accept-Encoding").indexOf("gzip") >= 0 && gzipBegin(&resp_z, respGzipOut)) {
+    resp_gzip = true;
+    server.sendHeader(F("Content-Encoding"), F("gzip"));
+    server.sendHeader(F("Vary"), F("Accept-Encoding"));
+  }
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(resp_code, resp_type, "");
+}
+
+/* ======================================================================
+Function: respFlush 
+Purpose : send buffered response content as a chunk
+Input   : -
+Output  : - 
+Comments: size of first chunk decides compression
+====================================================================== */
+void respFlush(void)
+{
+  if (resp_len) {
+    heapSample();
+    respStart(resp_len >= GZIP_MIN_SIZE);
+    if (resp_gzip)
+      gzipWrite(&resp_z, resp_chunk, resp_len);
+    else
+      server.sendContent_P(resp_chunk, resp_len);
+    resp_len = 0;
+  }
+}
+
+/* ======================================================================
+Function: respWrite 
+Purpose : add raw data to response, flushing it when full
+Input   : data pointer (RAM or flash)
+          data size
+Output  : - 
+Comments: -
+====================================================================== */
+void respWrite(const char * data, size_t len)
+{
+  if (resp_failed)
+    return;
+
+  while (len) {
+    size_t n = RESPONSE_CHUNK_SIZE - resp_len;
+    if (n > len)
+      n = len;
+
+    memcpy_P(resp_chunk + resp_len, data, n);
+    resp_len += n;
+    data += n;
+    len -= n;
+
+    if (resp_len >= RESPONSE_CHUNK_SIZE)
+      respFlush();
+  }
+}
+
+/* ======================================================================
+Function: respPrint / respPrint_P
+Purpose : add a string (RAM or flash) to response
+Input   : string
+Output  : - 
+Comments: -
+====================================================================== */
+void respPrint(const char * str)
+{
+  respWrite(str, strlen(str));
+}
+
+void respPrint_P(PGM_P str)
+{
+  respWrite(str, strlen_P(str));
+}
+
+/* ======================================================================
+Function: respPrintf 
+Purpose : format data into response buffer, flushing it when full
+Input   : format string (in flash) and args
+Output  : - 
+Comments: an item bigger than chunk buffer is formatted in a scratch
+          from arena top, sent in pieces then given back. Response
+          fails if arena can't hold it
+====================================================================== */
+void respPrintf(const char * fmt, ...)
+{
+  va_list args;
+  int len;
+
+  if (resp_failed)
+    return;
+
+  va_start(args, fmt);
+  len = vsnprintf_P(resp_chunk + resp_len, RESPONSE_CHUNK_SIZE - resp_len, fmt, args);
+  va_end(args);
+
+  // Fit in buffer ?
+  if (len >= 0 && resp_len + len < RESPONSE_CHUNK_SIZE) {
+    resp_len += len;
+    return;
+  }
+  if (len < 0) {
+    respFail();
+    return;
+  }
+
+  // No, send what we have and try again with empty buffer
+  respFlush();
+  if (len < RESPONSE_CHUNK_SIZE) {
+    va_start(args, fmt);
+    resp_len = vsnprintf_P(resp_chunk, RESPONSE_CHUNK_SIZE, fmt, args);
+    va_end(args);
+    return;
+  }
+
+  // Bigger than a chunk, headers first so encoder has its arena
+  // before the scratch
+  respStart(true);
+  uint16_t top = response_idx;
+  char * tmp = (char *) arenaAlloc(len + 1);
+  if (!tmp) {
+    respFail();
+    return;
+  }
+  va_start(args, fmt);
+  vsnprintf_P(tmp, len + 1, fmt, args);
+  va_end(args);
+  respWrite(tmp, len);
+  response_idx = top;
+}
+
+/* ======================================================================
+Function: respEnd 
+Purpose : flush remaining data, terminate chunked response and 
+          release arena
+Input   : -
+Output  : - 
+Comments: a failed response gets a 500 if nothing was sent yet, else
+          connection is closed without last chunk
+====================================================================== */
+void respEnd(void)
+{
+  if (resp_failed) {
+    if (!resp_started)
+      server.send(500, "text/plain", "Response too big\r\n");
+    else
+      server.client().stop();
+    arenaReset();
+    return;
+  }
+
+  respFlush();
+  respStart(false);
+  if (resp_gzip)
+    gzipEnd(&resp_z);
+  server.sendContent("");
+  arenaReset();
+}
+
+/* ======================================================================
+Function: bufPrintf 
+Purpose : append formatted data to a fixed size buffer
+Input   : buffer, buffer size, current index (updated)
+          format string (in flash) and args
+Output  : false if buffer is too small (buffer stays terminated)
+Comments: used by sinks to build URL/payload without String
+====================================================================== */
+bool bufPrintf(char * buf, size_t size, uint16_t & idx, const char * fmt, ...)
+{
+  va_list args;
+  int len;
+
+  if (idx >= size)
+    return false;
+
+  va_start(args, fmt);
+  len = vsnprintf_P(buf + idx, size - idx, fmt, args);
+  va_end(args);
+
+  if (len < 0 || idx + len >= size) {
+    buf[idx] = '\0';
+    return false;
+  }
+
+  idx += len;
+  return true;
+}
 
 /* ======================================================================
 Function: formatSize 
 Purpose : format a asize to human readable format
-Input   : size 
-Output  : formated string
-Comments: -
+Input   : destination buffer (at least 16 chars)
+          size 
+Output  : buffer
+Comments: integer only, no float to String conversion
 ====================================================================== */
-String formatSize(size_t bytes)
+char * formatSize(char * buf, uint32_t bytes)
 {
   if (bytes < 1024){
-    return String(bytes) + F(" Byte");
+    sprintf_P(buf, PSTR("%u Byte"), bytes);
   } else if(bytes < (1024 * 1024)){
-    return String(bytes/1024.0) + F(" KB");
-  } else if(bytes < (1024 * 1024 * 1024)){
-    return String(bytes/1024.0/1024.0) + F(" MB");
+    sprintf_P(buf, PSTR("%u.%02u KB"), bytes/1024, ((bytes%1024)*100)/1024);
   } else {
-    return String(bytes/1024.0/1024.0/1024.0) + F(" GB");
+    bytes /= 1024;
+    sprintf_P(buf, PSTR("%u.%02u MB"), bytes/1024, ((bytes%1024)*100)/1024);
+  }
+  return buf;
+}
+
+/* ======================================================================
+Function: getSpiffsInfo 
+Purpose : refresh SPIFFS usage cache if needed
+Input   : -
+Output  : - 
+Comments: SPIFFS.info() is slow, keep it for SYSINFO_SPIFFS_TTL seconds
+====================================================================== */
+void getSpiffsInfo(void)
+{
+  if (!sysinfo.spiffs_valid || seconds - sysinfo.spiffs_time >= SYSINFO_SPIFFS_TTL) {
+    FSInfo info;
+    SPIFFS.info(info);
+    sysinfo.spiffs_total = info.totalBytes;
+    sysinfo.spiffs_used  = info.usedBytes;
+    sysinfo.spiffs_time  = seconds;
+    sysinfo.spiffs_valid = true;
   }
 }
 
@@ -126,7 +462,7 @@ bool handleFileRead(String path) {
 
   Debugln("");
 
-  server.send(404, "text/plain", "File Not Found");
+  // caller sends the 404
   return false;
 }
 
@@ -139,7 +475,7 @@ Comments: -
 ====================================================================== */
 void handleFormConfig(void) 
 {
-  String response="";
+  const char * msg;
   int ret ;
 
   LedBluON();
@@ -151,6 +487,10 @@ void handleFormConfig(void)
     DebuglnF("===== Posted configuration"); 
 
     // WifInfo
+    // New network, cached connection parameters are no more valid
+    if (strncmp(config.ssid, server.arg("ssid").c_str(), CFG_SSID_SIZE))
+      memset(&config.wifi_cache, 0, sizeof(_wifiCache));
+
     strncpy(config.ssid ,   server.arg("ssid").c_str(),     CFG_SSID_SIZE );
     strncpy(config.psk ,    server.arg("psk").c_str(),      CFG_PSK_SIZE );
     strncpy(config.host ,   server.arg("host").c_str(),     CFG_HOSTNAME_SIZE );
@@ -158,10 +498,52 @@ void handleFormConfig(void)
     strncpy(config.ota_auth,server.arg("ota_auth").c_str(), CFG_PSK_SIZE );
     itemp = server.arg("ota_port").toInt();
     config.ota_port = (itemp>=0 && itemp<=65535) ? itemp : DEFAULT_OTA_PORT ;
+    itemp = server.arg("scan_ttl").toInt();
+    config.scan_ttl = (itemp>0 && itemp<=3600) ? itemp : CFG_SCAN_DEFAULT_TTL ;
+    itemp = server.arg("power_tau").toInt();
+    config.power_tau = (itemp>=0 && itemp<=3600) ? itemp : CFG_POWER_DEFAULT_TAU ;
+
+    // Statistics, labels and windows (s) as comma separated lists
+    strncpy(config.stats.labels, server.arg("stats_labels").c_str(), CFG_STATS_LABELS_SIZE );
+    String windows = server.arg("stats_windows");
+    const char * win = windows.c_str();
+    for (uint8_t i = 0; i < CFG_STATS_WINDOWS; i++) {
+      itemp = *win ? atoi(win) : 0;
+      config.stats.window[i] = (itemp > 0 && itemp <= 86400/2) ? itemp : 0;
+      win = strchr(win, ',');  win = win ? win + 1 : "";
+    }
+    config.stats.payload = server.arg("stats_payload").toInt() == 1;
+    statsInit();
     if(server.arg("dbg_file").toInt() == 1)
       config.dbgfile=true;
     else
       config.dbgfile=false;
+
+    // Log level (0 for default) and UDP syslog server (empty for none)
+    itemp = server.arg("log_level").toInt();
+    config.log_level = (itemp >= LOG_ERR && itemp <= LOG_DEBUG) ? itemp : 0;
+    IPAddress syslog;
+    config.syslog_ip = syslog.fromString(server.arg("syslog")) ? (uint32_t) syslog : 0;
+    logInit();
+
+    // Modbus TCP server, off unless asked, applied right now
+    if (server.arg("modbus").toInt() == 1)
+      config.config |= CFG_MODBUS;
+    else
+      config.config &= ~CFG_MODBUS;
+    modbusInit();
+
+    // Static IP, need at least address and netmask, else DHCP
+    IPAddress ip, gw, msk;
+    if ( ip.fromString(server.arg("wifi_ip")) && msk.fromString(server.arg("wifi_msk")) ) {
+      if (!gw.fromString(server.arg("wifi_gw")))
+        gw = ip;
+      config.wifi_ip  = ip;
+      config.wifi_gw  = gw;
+      config.wifi_msk = msk;
+    } else {
+      config.wifi_ip = config.wifi_gw = config.wifi_msk = 0;
+    }
       
     // Emoncms
     strncpy(config.emoncms.host,   server.arg("emon_host").c_str(),  CFG_EMON_HOST_SIZE );
@@ -172,14 +554,15 @@ void handleFormConfig(void)
     itemp = server.arg("emon_port").toInt();
     config.emoncms.port = (itemp>=0 && itemp<=65535) ? itemp : CFG_EMON_DEFAULT_PORT ; 
     itemp = server.arg("emon_freq").toInt();
-    if (itemp>0 && itemp<=86400){
-      // Emoncms Update if needed
-      Tick_emoncms.detach();
-      Tick_emoncms.attach(itemp, Task_emoncms);
-    } else {
+    if (itemp<=0 || itemp>86400)
       itemp = 0 ; 
-    }
     config.emoncms.freq = itemp;
+    itemp = server.arg("emon_bulk").toInt();
+    config.emoncms.bulk = (itemp>=0 && itemp<=CFG_EMON_BULK_MAX) ? itemp : 0 ;
+    itemp = server.arg("emon_bulklat").toInt();
+    config.emoncms.bulk_latency = (itemp>0 && itemp<=3600) ? itemp : CFG_EMON_DEFAULT_BULKLAT ;
+    itemp = server.arg("emon_tls").toInt();
+    config.emoncms.tls = (itemp>=TLS_OFF && itemp<=TLS_INSECURE) ? itemp : TLS_OFF ;
 
     // jeedom
     strncpy(config.jeedom.host,   server.arg("jdom_host").c_str(),  CFG_JDOM_HOST_SIZE );
@@ -189,14 +572,11 @@ void handleFormConfig(void)
     itemp = server.arg("jdom_port").toInt();
     config.jeedom.port = (itemp>=0 && itemp<=65535) ? itemp : CFG_JDOM_DEFAULT_PORT ; 
     itemp = server.arg("jdom_freq").toInt();
-    if (itemp>0 && itemp<=86400){
-      // Emoncms Update if needed
-      Tick_jeedom.detach();
-      Tick_jeedom.attach(itemp, Task_jeedom);
-    } else {
+    if (itemp<=0 || itemp>86400)
       itemp = 0 ; 
-    }
     config.jeedom.freq = itemp;
+    itemp = server.arg("jdom_tls").toInt();
+    config.jeedom.tls = (itemp>=TLS_OFF && itemp<=TLS_INSECURE) ? itemp : TLS_OFF ;
 
     // HTTP Request
     strncpy(config.httpReq.host, server.arg("httpreq_host").c_str(), CFG_HTTPREQ_HOST_SIZE );
@@ -204,20 +584,58 @@ void handleFormConfig(void)
     itemp = server.arg("httpreq_port").toInt();
     config.httpReq.port = (itemp>=0 && itemp<=65535) ? itemp : CFG_HTTPREQ_DEFAULT_PORT ; 
     itemp = server.arg("httpreq_freq").toInt();
-    if (itemp>0 && itemp<=86400)
-    {
-      Tick_httpRequest.detach();
-      Tick_httpRequest.attach(itemp, Task_httpRequest);
-    } else {
+    if (itemp<=0 || itemp>86400)
       itemp = 0 ; 
-    }
     config.httpReq.freq = itemp;
+    itemp = server.arg("httpreq_tls").toInt();
+    config.httpReq.tls = (itemp>=TLS_OFF && itemp<=TLS_INSECURE) ? itemp : TLS_OFF ;
+
+    // Dry contact inputs, comma separated GPIO and IDX lists
+    String in_pins = server.arg("in_pins");
+    String in_idx  = server.arg("in_idx");
+    const char * pins = in_pins.c_str();
+    const char * idx  = in_idx.c_str();
+    for (uint8_t i = 0; i < CFG_INPUT_MAX; i++) {
+      itemp = *pins ? atoi(pins) : 0;
+      config.inputs.pin[i] = INPUT_PIN_OK(itemp) ? itemp : 0;
+      itemp = *idx ? atoi(idx) : 0;
+      config.inputs.idx[i] = (itemp > 0 && itemp <= 65535) ? itemp : 0;
+      pins = strchr(pins, ',');  pins = pins ? pins + 1 : "";
+      idx  = strchr(idx, ',');   idx  = idx  ? idx + 1  : "";
+    }
+    // first input is the former single switch
+    config.httpReq.swidx = config.inputs.idx[0];
+    itemp = server.arg("in_deb").toInt();
+    config.inputs.debounce = (itemp > 0 && itemp <= 5000) ? itemp : CFG_INPUT_DEFAULT_DEB;
+
+    // S0 pulse counters, comma separated GPIO list
+    in_pins = server.arg("pulse_pins");
+    pins = in_pins.c_str();
+    for (uint8_t i = 0; i < CFG_PULSE_MAX; i++) {
+      itemp = *pins ? atoi(pins) : 0;
+      config.pulses.pin[i] = INPUT_PIN_OK(itemp) ? itemp : 0;
+      pins = strchr(pins, ',');  pins = pins ? pins + 1 : "";
+    }
 
-    itemp = server.arg("httpreq_swidx").toInt();
-    if (itemp > 0 && itemp <= 65535)
-      config.httpReq.swidx = itemp;
-    else
-      config.httpReq.swidx = 0;
+    // Load shedding relays, comma separated GPIO list in priority order
+    in_pins = server.arg("shed_pins");
+    pins = in_pins.c_str();
+    for (uint8_t i = 0; i < CFG_SHED_MAX; i++) {
+      itemp = *pins ? atoi(pins) : 0;
+      config.shed.pin[i] = INPUT_PIN_OK(itemp) ? itemp : 0;
+      pins = strchr(pins, ',');  pins = pins ? pins + 1 : "";
+    }
+    itemp = server.arg("shed_trip").toInt();
+    config.shed.trip = (itemp > 0 && itemp <= 120) ? itemp : CFG_SHED_DEFAULT_TRIP;
+    itemp = server.arg("shed_restore").toInt();
+    config.shed.restore = (itemp > 0 && itemp < config.shed.trip) ? itemp : CFG_SHED_DEFAULT_RESTORE;
+    itemp = server.arg("shed_minoff").toInt();
+    config.shed.min_off = (itemp > 0 && itemp <= 65535) ? itemp : CFG_SHED_DEFAULT_MINOFF;
+#ifdef SENSOR
+    inputsInit();
+#endif
+    pulsesInit();
+    shedInit();
 
     
     itemp = server.arg("httpreq_iidx").toInt();
@@ -232,12 +650,28 @@ void handleFormConfig(void)
     else
       config.httpReq.adpsidx = 0;
 
+    // Rules source is kept in SPIFFS, ADPS IDX is used without it
+    if (server.hasArg("rules")) 
+      rulesSave(server.arg("rules"));
+    else
+      rulesInit();
+
+    // TLS server fingerprint, bad one is cleared
+    if (!tlsFingerprintParse(server.arg("tls_fp").c_str(), config.tls_fp))
+      DebuglnF("Bad TLS fingerprint");
+
+    // Uploads, configuration ones and others from SPIFFS
+    if (server.hasArg("sinks")) 
+      sinksSave(server.arg("sinks"));
+    else
+      sinksInit();
+
     if ( saveConfig() ) {
       ret = 200;
-      response = "OK";
+      msg = "OK";
     } else {
       ret = 412;
-      response = "Unable to save configuration";
+      msg = "Unable to save configuration";
     }
 
     showConfig();
@@ -245,14 +679,14 @@ void handleFormConfig(void)
   else
   {
     ret = 400;
-    response = "Missing Form Field";
+    msg = "Missing Form Field";
   }
 
   DebugF("Sending response "); 
   Debug(ret); 
   Debug(":"); 
-  Debugln(response); 
-  server.send ( ret, "text/plain", response);
+  Debugln(msg); 
+  server.send ( ret, "text/plain", msg);
   LedBluOFF();
 }
 
@@ -266,57 +700,28 @@ Comments: -
 void handleRoot(void) 
 {
   LedBluON();
-  handleFileRead("/");
+  if (!handleFileRead("/"))
+    server.send(404, "text/plain", "File Not Found");
   LedBluOFF();
 }
 
 /* ======================================================================
-Function: formatNumberJSON 
-Purpose : check if data value is full number and send correct JSON format
-Input   : String where to add response
-          char * value to check 
+Function: sendNoData 
+Purpose : tell client teleinfo values are not there yet
+Input   : - 
 Output  : - 
-Comments: 00150 => 150
-          ADCO  => "ADCO"
-          1     => 1
+Comments: list is empty until first frame, and again after each
+          reinit. Nothing is waited for there, serial is only read
+          from loop() so the list can't fill while a handler runs
 ====================================================================== */
-void formatNumberJSON( String &response, char * value)
+void sendNoData(void)
 {
-  // we have at least something ?
-  if (value && strlen(value))
-  {
-    boolean isNumber = true;
-    uint8_t c;
-    char * p = value;
-
-    // just to be sure
-    if (strlen(p)<=16) {
-      // check if value is number
-      while (*p && isNumber) {
-        if ( *p < '0' || *p > '9' )
-          isNumber = false;
-        p++;
-      }
-
-      // this will add "" on not number values
-      if (!isNumber) {
-        response += '\"' ;
-        response += value ;
-        response += F("\"") ;
-      } else {
-        // this will remove leading zero on numbers
-        p = value;
-        while (*p=='0' && *(p+1) )
-          p++;
-        response += p ;
-      }
-    } else {
-      Debugln(F("formatNumberJSON error!"));
-    }
-  }
+  Debugln(F("sending 503..."));
+  server.sendHeader(F("Retry-After"), String(TINFO_RETRY_AFTER));
+  server.sendHeader(F("Cache-Control"), F("no-store"));
+  server.send(503, "text/plain", "No data yet");
 }
 
-
 /* ======================================================================
 Function: tinfoJSONTable 
 Purpose : dump all teleinfo values in JSON table format for browser
@@ -330,202 +735,181 @@ void tinfoJSONTable(void)
    // we're there
   ESP.wdtFeed();  //Force software wadchog to restart from 0
 
-  ValueList * me = tinfo.getList();
-  String response = "";
-
   // Just to debug where we are
   //Debug(F("Serving /tinfo page...\r\n"));
 
-  if (! me ) //&& first_info_call) 
-  {
-    //Let tinfo such time to build a list....
-    first_info_call=false;
-    unsigned long topdebut = millis();
-    bool expired = false;
-    while (! expired ) {
-      if( (millis() - topdebut ) >= 3000 ) {
-        expired = true;   // 3 seconds delay expired
-      } else {
-        yield();  //Let CPU to other threads
-      }
-    }
-    // continue, hoping list values is now ready
-    me = tinfo.getList();
-  }
   //tinfo.valuesDump(); 
   // Got at least one ?
-  if (me) {
-    uint8_t index=0;
-    
+  if (value_count && cborAsked()) {
+    first_info_call=false;
+    cborTinfo();
+  } else if (value_count) {
     first_info_call=false;
     boolean first_item = true;
-    // Json start
-    response += F("[\r\n");
-
-    // Loop thru the node
-    while (me->next) {
-      index++;
-
-      if(! first_item) 
-        // go to next node
-        me = me->next;
 
- 
+    respBegin(200, "text/json");
+    // Json start
+    respPrint_P(PSTR("[\r\n"));
 
-      if( ! me->free ) {
-        // First item do not add , separator
-        if (first_item)
-          first_item = false;
-        else 
-          response += F(",\r\n");
-          
-        if(validate_value_name(me->name)) {
-          //It's a known name : process the entry      
-          response += F("{\"na\":\"");
-          response +=  me->name ;
-          response += F("\", \"va\":\"") ;
-          response += me->value;
-          response += F("\", \"ck\":\"") ;
-          if (me->checksum == '"' || me->checksum == '\\' || me->checksum == '/')
-            response += '\\';
-          response += (char) me->checksum;
-          response += F("\", \"fl\":");
-          response += me->flags ;
-          response += '}' ;
-        } else {
-          //Don't put this line in table : name is corrupted !
-          need_reinit=true;
-        }
-      }
+    // Loop thru the labels of frame
+    for (int8_t id = valueNext(-1); id >= 0; id = valueNext(id)) {
+      _valueSlot * v = &value_slots[id];
 
+      respPrintf(PSTR("%s{\"na\":\"%s\", \"va\":\"%s\", \"ck\":\"%s%c\", \"fl\":%d}"),
+                 first_item ? "" : ",\r\n", tabnames[id], valueText(id),
+                 (v->checksum == '"' || v->checksum == '\\' || v->checksum == '/') ? "\\" : "",
+                 (char) v->checksum, v->flags);
+      first_item = false;
     }
    // Json end
-   response += F("\r\n]");
+   respPrint_P(PSTR("\r\n]"));
+   respEnd();
 
   } else {
-    Debugln(F("sending 404..."));
-    server.send ( 404, "text/plain", "No data" );
+    sendNoData();
   }
-  //Debug(F("sending..."));
-  server.send ( 200, "text/json", response );
-  //Debugln(response);
-  //Debugln(F("OK!"));
   yield();  //Let a chance to other threads to work
 }
 
 /* ======================================================================
-Function: getSysJSONData 
-Purpose : Return JSON string containing system data
-Input   : Response String
+Function: sysJSONRow 
+Purpose : stream one system data row
+Input   : name of data
+          display value
+          raw numeric value
 Output  : - 
 Comments: -
 ====================================================================== */
-void getSysJSONData(String & response)
+void sysJSONRow(const char * name, const char * value, int32_t raw)
+{
+  respPrintf(PSTR("{\"na\":\"%s\",\"va\":\"%s\",\"raw\":%d},\r\n"), name, value, raw);
+}
+
+/* ======================================================================
+Function: sysJSONBoot 
+Purpose : stream one boot timing row
+Input   : name of data
+          millis() when phase ended, 0 if not yet
+          text to display if not yet
+Output  : - 
+Comments: -
+====================================================================== */
+void sysJSONBoot(const char * name, unsigned long when, const char * pending)
+{
+  char buffer[32];
+
+  if (when) {
+    when -= sysinfo.boot_start;
+    sprintf_P(buffer, PSTR("%lu ms"), when);
+    sysJSONRow(name, buffer, when);
+  } else {
+    sysJSONRow(name, pending, -1);
+  }
+}
+
+/* ======================================================================
+Function: getSysJSONData 
+Purpose : Stream JSON containing system data
+Input   : -
+Output  : - 
+Comments: static facts come from sysinfo (computed at boot), each row
+          has raw numeric value along with display string
+====================================================================== */
+void getSysJSONData(void)
 {
-  response = "";
   char buffer[32];
   int32_t adc = ( 1000 * analogRead(A0) / 1024 );
+  uint32_t heap = system_get_free_heap_size();
+  unsigned long sec = seconds;
 
   // Json start
-  response += F("[\r\n");
+  respPrintf(PSTR("[\r\n"));
 
-  response += "{\"na\":\"Uptime\",\"va\":\"";
-  response += sysinfo.sys_uptime;
-  response += "\"},\r\n";
+  sprintf_P(buffer, PSTR("%lu days %02lu h %02lu m %02lu sec"), sec / 86400, (sec / 3600) % 24, (sec / 60) % 60, sec % 60);
+  sysJSONRow("Uptime", buffer, sec);
   
 #ifdef SENSOR
-  response += "{\"na\":\"Switch\",\"va\":\"";
-  if (SwitchState) 
-    response += F("Open");  //switch ouvert
-  else
-    response += F("Closed");  //switch fermé
-    
-  response += "\"},\r\n";  
+  //switch ouvert / fermé
+  for (uint8_t i = 0; i < inputs_count; i++) {
+    char name[24];
+    sprintf_P(name, PSTR("Switch %d (GPIO%d)"), i + 1, inputs[i].pin);
+    sprintf_P(buffer, PSTR("%s (%u chgt)"), inputs[i].level ? "Open" : "Closed", inputs[i].changes);
+    sysJSONRow(name, buffer, inputs[i].level);
+  }
+  sprintf_P(buffer, PSTR("%u us max (%u perdus)"), inputs_latency, inputs_lost);
+  sysJSONRow("Latence switch", buffer, inputs_latency);
 #endif
   
   if (WiFi.status() == WL_CONNECTED)
   {
-      response += "{\"na\":\"Wifi RSSI\",\"va\":\"";
-      response += WiFi.RSSI();
-      response += " dB\"},\r\n";
-      response += "{\"na\":\"Wifi network\",\"va\":\"";
-      response += config.ssid;
-      response += "\"},\r\n";
+      int32_t rssi = WiFi.RSSI();
+      sprintf_P(buffer, PSTR("%d dB"), rssi);
+      sysJSONRow("Wifi RSSI", buffer, rssi);
+      sysJSONRow("Wifi network", config.ssid, WiFi.channel());
       uint8_t mac[] = {0, 0, 0, 0, 0, 0};
       uint8_t* macread = WiFi.macAddress(mac);
-      char macaddress[20];
-      sprintf_P(macaddress, PSTR("%02x:%02x:%02x:%02x:%02x:%02x"), macread[0], macread[1], macread[2], macread[3], macread[4], macread[5]);
-      response += "{\"na\":\"Adresse MAC station\",\"va\":\"";
-      response += macaddress;
-      response += "\"},\r\n";
-  }
-  response += "{\"na\":\"Nb reconnexions Wifi\",\"va\":\"";
-  response += nb_reconnect;
-  response += "\"},\r\n"; 
-  
-  response += "{\"na\":\"Altérations Data détectées\",\"va\":\"";
-  response += nb_reinit;
-  response += "\"},\r\n"; 
+      sprintf_P(buffer, PSTR("%02x:%02x:%02x:%02x:%02x:%02x"), macread[0], macread[1], macread[2], macread[3], macread[4], macread[5]);
+      sysJSONRow("Adresse MAC station", buffer, 0);
+  }
+  sprintf_P(buffer, PSTR("%d"), nb_reconnect);
+  sysJSONRow("Nb reconnexions Wifi", buffer, nb_reconnect);
+
+  sprintf_P(buffer, PSTR("%lu ms (rapide %u ok / %u echec)"), sysinfo.wifi_conn_ms, sysinfo.wifi_fast_ok, sysinfo.wifi_fast_fail);
+  sysJSONRow("Connexion Wifi", buffer, sysinfo.wifi_conn_ms);
+
+  // Boot phases timing, relative to setup() start
+  sysJSONBoot("Boot setup", sysinfo.boot_setup, "");
+  sysJSONBoot("Boot Wifi", sysinfo.boot_wifi, "en cours");
+  sysJSONBoot("Boot fin OTA", sysinfo.boot_ota, "en cours");
+  sysJSONBoot("Boot 1ere trame", sysinfo.boot_frame, "en attente");
+  if (wifi_state == WIFI_ST_AP)
+    sysJSONRow("Mode Wifi", "Point d'accès", wifi_state);
+
+  sprintf_P(buffer, PSTR("%u"), nb_reinit);
+  sysJSONRow("Altérations Data détectées", buffer, nb_reinit);
   
-  response += "{\"na\":\"WifInfo Version\",\"va\":\"" WIFINFO_VERSION "\"},\r\n";
+  sysJSONRow("WifInfo Version", WIFINFO_VERSION, 0);
+  sysJSONRow("Compile le", __DATE__ " " __TIME__, 0);
+  sysJSONRow("SDK Version", sysinfo.sdk_version, 0);
 
-  response += "{\"na\":\"Compile le\",\"va\":\"" __DATE__ " " __TIME__ "\"},\r\n";
+  sprintf_P(buffer, PSTR("0x%0X"), sysinfo.chip_id);
+  sysJSONRow("Chip ID", buffer, sysinfo.chip_id);
 
-  response += "{\"na\":\"SDK Version\",\"va\":\"";
-  response += system_get_sdk_version() ;
-  response += "\"},\r\n";
+  sprintf_P(buffer, PSTR("0x%0X"), sysinfo.boot_version);
+  sysJSONRow("Boot Version", buffer, sysinfo.boot_version);
 
-  response += "{\"na\":\"Chip ID\",\"va\":\"";
-  sprintf_P(buffer, "0x%0X",system_get_chip_id() );
-  response += buffer ;
-  response += "\"},\r\n";
+  sysJSONRow("Flash Real Size", formatSize(buffer, sysinfo.flash_size), sysinfo.flash_size);
+  sysJSONRow("Firmware Size", formatSize(buffer, sysinfo.sketch_size), sysinfo.sketch_size);
+  sysJSONRow("Free Size", formatSize(buffer, sysinfo.sketch_free), sysinfo.sketch_free);
 
-  response += "{\"na\":\"Boot Version\",\"va\":\"";
-  sprintf_P(buffer, "0x%0X",system_get_boot_version() );
-  response += buffer ;
-  response += "\"},\r\n";
-
-  response += "{\"na\":\"Flash Real Size\",\"va\":\"";
-  response += formatSize(ESP.getFlashChipRealSize()) ;
-  response += "\"},\r\n";
-
-  response += "{\"na\":\"Firmware Size\",\"va\":\"";
-  response += formatSize(ESP.getSketchSize()) ;
-  response += "\"},\r\n";
-
-  response += "{\"na\":\"Free Size\",\"va\":\"";
-  response += formatSize(ESP.getFreeSketchSpace()) ;
-  response += "\"},\r\n";
-
-  response += "{\"na\":\"Analog\",\"va\":\"";
-  adc = ( (1000 * analogRead(A0)) / 1024);
   sprintf_P( buffer, PSTR("%d mV"), adc);
-  response += buffer ;
-  response += "\"},\r\n";
+  sysJSONRow("Analog", buffer, adc);
+
+  getSpiffsInfo();
+  sysJSONRow("SPIFFS Total", formatSize(buffer, sysinfo.spiffs_total), sysinfo.spiffs_total);
+  sysJSONRow("SPIFFS Used", formatSize(buffer, sysinfo.spiffs_used), sysinfo.spiffs_used);
 
-  FSInfo info;
-  SPIFFS.info(info);
+  adc = sysinfo.spiffs_total ? 100 * sysinfo.spiffs_used / sysinfo.spiffs_total : 0;
+  sprintf_P(buffer, PSTR("%d%%"), adc);
+  sysJSONRow("SPIFFS Occupation", buffer, adc);
 
-  response += "{\"na\":\"SPIFFS Total\",\"va\":\"";
-  response += formatSize(info.totalBytes) ;
-  response += "\"},\r\n";
+  sprintf_P(buffer, PSTR("%u/%u (%u echecs)"), response_peak, RESPONSE_BUFFER_SIZE, response_fail);
+  sysJSONRow("Buffer réponse max", buffer, response_peak);
 
-  response += "{\"na\":\"SPIFFS Used\",\"va\":\"";
-  response += formatSize(info.usedBytes) ;
-  response += "\"},\r\n";
+  sprintf_P(buffer, PSTR("%u octets (%u/%u labels)"), valuesRAM(), value_count, TINFO_LABELS);
+  sysJSONRow("Stockage valeurs", buffer, valuesRAM());
 
-  response += "{\"na\":\"SPIFFS Occupation\",\"va\":\"";
-  sprintf_P(buffer, "%d%%",100*info.usedBytes/info.totalBytes);
-  response += buffer ;
-  response += "\"},\r\n"; 
+  uint32_t block = ESP.getMaxFreeBlockSize();
+  sysJSONRow("Plus grand bloc libre", formatSize(buffer, block), block);
+  adc = ESP.getHeapFragmentation();
+  sprintf_P(buffer, PSTR("%d%%%s"), adc, heap_decline ? " (baisse continue !)" : "");
+  sysJSONRow("Fragmentation", buffer, adc);
 
-  // Free mem should be last one 
-  response += "{\"na\":\"Free Ram\",\"va\":\"";
-  response += formatSize(system_get_free_heap_size()) ;
-  response += "\"}\r\n"; // Last don't have comma at end
+  // Free mem should be last one, last don't have comma at end
+  respPrintf(PSTR("{\"na\":\"Free Ram\",\"va\":\"%s\",\"raw\":%u}\r\n"), formatSize(buffer, heap), heap);
 
   // Json end
-  response += F("]\r\n");
+  respPrintf(PSTR("]\r\n"));
 }
 
 /* ======================================================================
@@ -537,14 +921,13 @@ Comments: -
 ====================================================================== */
 void sysJSONTable()
 {
-  String response = "";
-
   ESP.wdtFeed();  //Force software watchdog to restart from 0
-  getSysJSONData(response);
 
   // Just to debug where we are
   //Debug(F("Serving /system page..."));
-  server.send ( 200, "text/json", response );
+  respBegin(200, "text/json");
+  getSysJSONData();
+  respEnd();
   //Debugln(F("Ok!"));
   yield();  //Let a chance to other threads to work
 }
@@ -556,66 +939,229 @@ Purpose : prepare the JSON table needed to fill emoncms server with values
             accept numeric values
 Input   : -
 Output  : Teleinfo values translated and filtered
-Comments: -
+Comments: same content as build_emoncms_json(), streamed
 ====================================================================== */
 void emoncmsJSONTable()
 {
+  const char * sep = "";
+  char code[12], name[16], value[16];
+
   Debug(F("Serving /emoncms.json page..."));
-  String response = build_emoncms_json(); 
 
-  server.send ( 200, "text/json", response );
-  //Debugln(response);
+  respBegin(200, "text/json");
+  respPrint_P(PSTR("{"));
+
+  for (int8_t id = valueNext(-1); id >= 0; id = valueNext(id)) {
+    respPrintf(PSTR("%s%s:%s"), sep, tabnames[id], valueEmoncms(id, code));
+    sep = ",";
+  }
+
+  // Virtual labels (pulse counters, power)
+  for (uint8_t n = 0; virtualLabel(n, name, value); n++) {
+    respPrintf(PSTR("%s%s:%s"), sep, name, value);
+    sep = ",";
+  }
+
+  respPrint_P(PSTR("}"));
+  respEnd();
   Debugln(F("Ok!"));
   yield();  //Let a chance to other threads to work
 }
 
 
 
+/* ======================================================================
+Function: confJSONItem 
+Purpose : stream one configuration name":"value" item
+Input   : form field name
+          value
+          true for the last item (no separator)
+Output  : - 
+Comments: opening quote comes from JSON start or previous separator
+====================================================================== */
+void confJSONItem(const __FlashStringHelper * name, const char * value, bool last=false)
+{
+  respPrint_P((PGM_P) name);
+  respPrint_P(FP_QCQ);
+  respPrint(value);
+  respPrint_P(last ? PSTR("\"") : FP_QCNL);
+}
+
+void confJSONItem(const __FlashStringHelper * name, uint32_t value, bool last=false)
+{
+  char buffer[12];
+  sprintf_P(buffer, PSTR("%u"), value);
+  confJSONItem(name, buffer, last);
+}
+
+/* ======================================================================
+Function: confJSONFile
+Purpose : stream a SPIFFS text file as configuration item
+Input   : form field name
+          file name
+          true for the last item (no separator)
+Output  : - 
+Comments: same layout as confJSONItem, value is escaped, empty if no
+          file
+====================================================================== */
+void confJSONFile(const __FlashStringHelper * name, const char * path, bool last=false)
+{
+  char buf[64];
+  char esc[2 * sizeof(buf)];
+
+  respPrint_P((PGM_P) name);
+  respPrint_P(FP_QCQ);
+
+  File f = SPIFFS.open(path, "r");
+  if (f) {
+    int len;
+    while ((len = f.read((uint8_t *) buf, sizeof(buf))) > 0) {
+      size_t n = 0;
+      for (int i = 0; i < len; i++) {
+        char c = buf[i];
+        if (c == '"' || c == '\\') {
+          esc[n++] = '\\';
+          esc[n++] = c;
+        } else if (c == '\n') {
+          esc[n++] = '\\';
+          esc[n++] = 'n';
+        } else if ((uint8_t) c >= ' ') {
+          esc[n++] = c;
+        }
+      }
+      respWrite(esc, n);
+    }
+    f.close();
+  }
+  respPrint_P(last ? PSTR("\"") : FP_QCNL);
+}
+
+/* ======================================================================
+Function: textFileSave
+Purpose : save text posted from configuration form into SPIFFS
+Input   : file name
+          text
+          max size
+Output  : false if too big or not written
+Comments: empty text removes file
+====================================================================== */
+bool textFileSave(const char * path, const String & text, size_t max)
+{
+  bool ret = true;
+
+  if (text.length() > max)
+    return false;
+
+  if (!text.length()) {
+    SPIFFS.remove(path);
+  } else {
+    File f = SPIFFS.open(path, "w");
+    if (f) {
+      ret = f.write((const uint8_t *) text.c_str(), text.length()) == text.length();
+      f.close();
+    } else {
+      ret = false;
+    }
+  }
+  return ret;
+}
+
 /* ======================================================================
 Function: getConfigJSONData 
-Purpose : Return JSON string containing configuration data
-Input   : Response String
+Purpose : Stream JSON containing configuration data
+Input   : -
 Output  : - 
 Comments: -
 ====================================================================== */
-void getConfJSONData(String & r)
+void getConfJSONData(void)
 {
+  char ip[16], gw[16], msk[16];
+  char pins[CFG_INPUT_MAX*4], idx[CFG_INPUT_MAX*6];
+
+  *ip = *gw = *msk = *pins = *idx = '\0';
+  if (config.wifi_ip) {
+    strcpy(ip,  IPAddress(config.wifi_ip).toString().c_str());
+    strcpy(gw,  IPAddress(config.wifi_gw).toString().c_str());
+    strcpy(msk, IPAddress(config.wifi_msk).toString().c_str());
+  }
+
   // Json start
-  r = FPSTR(FP_JSON_START); 
-
-  r+="\"";
-  r+=CFG_FORM_SSID;      r+=FPSTR(FP_QCQ); r+=config.ssid;           r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_PSK;       r+=FPSTR(FP_QCQ); r+=config.psk;            r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_HOST;      r+=FPSTR(FP_QCQ); r+=config.host;           r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_AP_PSK;    r+=FPSTR(FP_QCQ); r+=config.ap_psk;         r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_EMON_HOST; r+=FPSTR(FP_QCQ); r+=config.emoncms.host;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_EMON_PORT; r+=FPSTR(FP_QCQ); r+=config.emoncms.port;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_EMON_URL;  r+=FPSTR(FP_QCQ); r+=config.emoncms.url;    r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_EMON_KEY;  r+=FPSTR(FP_QCQ); r+=config.emoncms.apikey; r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_EMON_NODE; r+=FPSTR(FP_QCQ); r+=config.emoncms.node;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_EMON_FREQ; r+=FPSTR(FP_QCQ); r+=config.emoncms.freq;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_OTA_AUTH;  r+=FPSTR(FP_QCQ); r+=config.ota_auth;       r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_OTA_PORT;  r+=FPSTR(FP_QCQ); r+=config.ota_port;       r+= FPSTR(FP_QCNL);
-  r+=CFG_FORM_DBGFILE;   r+=FPSTR(FP_QCQ); r+=config.dbgfile;        r+= FPSTR(FP_QCNL);
-
-  r+=CFG_FORM_JDOM_HOST; r+=FPSTR(FP_QCQ); r+=config.jeedom.host;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_JDOM_PORT; r+=FPSTR(FP_QCQ); r+=config.jeedom.port;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_JDOM_URL;  r+=FPSTR(FP_QCQ); r+=config.jeedom.url;    r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_JDOM_KEY;  r+=FPSTR(FP_QCQ); r+=config.jeedom.apikey; r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_JDOM_ADCO; r+=FPSTR(FP_QCQ); r+=config.jeedom.adco;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_JDOM_FREQ; r+=FPSTR(FP_QCQ); r+=config.jeedom.freq;   r+= FPSTR(FP_QCNL); 
-
-  r+=CFG_FORM_HTTPREQ_HOST; r+=FPSTR(FP_QCQ); r+=config.httpReq.host;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_HTTPREQ_PORT; r+=FPSTR(FP_QCQ); r+=config.httpReq.port;   r+= FPSTR(FP_QCNL); 
-  r+=CFG_FORM_HTTPREQ_PATH; r+=FPSTR(FP_QCQ); r+=config.httpReq.path;   r+= FPSTR(FP_QCNL);  
-  r+=CFG_FORM_HTTPREQ_FREQ; r+=FPSTR(FP_QCQ); r+=config.httpReq.freq;   r+= FPSTR(FP_QCNL);   
-  r+=CFG_FORM_HTTPREQ_SWIDX; r+=FPSTR(FP_QCQ); r+=config.httpReq.swidx;  
-  
+  respPrint_P(FP_JSON_START); 
+  respPrint_P(PSTR("\""));
+
+  confJSONItem(CFG_FORM_SSID,      config.ssid);
+  confJSONItem(CFG_FORM_PSK,       config.psk);
+  confJSONItem(CFG_FORM_HOST,      config.host);
+  confJSONItem(CFG_FORM_AP_PSK,    config.ap_psk);
+  confJSONItem(CFG_FORM_IP,        ip);
+  confJSONItem(CFG_FORM_GW,        gw);
+  confJSONItem(CFG_FORM_MSK,       msk);
+  confJSONItem(CFG_FORM_EMON_HOST, config.emoncms.host);
+  confJSONItem(CFG_FORM_EMON_PORT, config.emoncms.port);
+  confJSONItem(CFG_FORM_EMON_URL,  config.emoncms.url);
+  confJSONItem(CFG_FORM_EMON_KEY,  config.emoncms.apikey);
+  confJSONItem(CFG_FORM_EMON_NODE, config.emoncms.node);
+  confJSONItem(CFG_FORM_EMON_FREQ, config.emoncms.freq);
+  confJSONItem(CFG_FORM_EMON_BULK, config.emoncms.bulk);
+  confJSONItem(CFG_FORM_EMON_BULKLAT, config.emoncms.bulk_latency);
+  confJSONItem(CFG_FORM_EMON_TLS,  config.emoncms.tls);
+  confJSONItem(CFG_FORM_OTA_AUTH,  config.ota_auth);
+  confJSONItem(CFG_FORM_OTA_PORT,  config.ota_port);
+  confJSONItem(CFG_FORM_DBGFILE,   config.dbgfile);
+  confJSONItem(CFG_FORM_LOG_LEVEL, config.log_level);
+  confJSONItem(CFG_FORM_SYSLOG,    config.syslog_ip ? IPAddress(config.syslog_ip).toString().c_str() : "");
+  confJSONItem(CFG_FORM_MODBUS,    (config.config & CFG_MODBUS) ? 1 : 0);
+  confJSONItem(CFG_FORM_SCAN_TTL,  config.scan_ttl);
+  confJSONItem(CFG_FORM_POWER_TAU, config.power_tau);
+  confJSONItem(CFG_FORM_STATS_LABELS, config.stats.labels);
+  sprintf_P(pins, PSTR("%u,%u,%u"), config.stats.window[0], config.stats.window[1], config.stats.window[2]);
+  confJSONItem(CFG_FORM_STATS_WINDOWS, pins);
+  confJSONItem(CFG_FORM_STATS_PAYLOAD, config.stats.payload);
+
+  confJSONItem(CFG_FORM_JDOM_HOST, config.jeedom.host);
+  confJSONItem(CFG_FORM_JDOM_PORT, config.jeedom.port);
+  confJSONItem(CFG_FORM_JDOM_URL,  config.jeedom.url);
+  confJSONItem(CFG_FORM_JDOM_KEY,  config.jeedom.apikey);
+  confJSONItem(CFG_FORM_JDOM_ADCO, config.jeedom.adco);
+  confJSONItem(CFG_FORM_JDOM_FREQ, config.jeedom.freq);
+  confJSONItem(CFG_FORM_JDOM_TLS,  config.jeedom.tls);
+
+  confJSONItem(CFG_FORM_HTTPREQ_HOST,  config.httpReq.host);
+  confJSONItem(CFG_FORM_HTTPREQ_PORT,  config.httpReq.port);
+  confJSONItem(CFG_FORM_HTTPREQ_PATH,  config.httpReq.path);
+  confJSONItem(CFG_FORM_HTTPREQ_FREQ,  config.httpReq.freq);
+  confJSONItem(CFG_FORM_HTTPREQ_TLS,   config.httpReq.tls);
+  confJSONFile(CFG_FORM_RULES,       RULES_FILE);
+  confJSONFile(CFG_FORM_SINKS,       SINKS_FILE);
+  char fp[3 * CFG_TLS_FP_SIZE];
+  tlsFingerprintStr(config.tls_fp, fp);
+  confJSONItem(CFG_FORM_TLS_FP,      fp);
+
+  for (uint8_t i = 0; i < inputs_count; i++) {
+    sprintf_P(pins + strlen(pins), PSTR("%s%d"), i ? "," : "", inputs[i].pin);
+    sprintf_P(idx + strlen(idx),   PSTR("%s%d"), i ? "," : "", inputs[i].idx);
+  }
+  confJSONItem(CFG_FORM_IN_PINS,       pins);
+  confJSONItem(CFG_FORM_IN_IDX,        idx);
+  *pins = '\0';
+  for (uint8_t i = 0; i < CFG_PULSE_MAX; i++) {
+    if (config.pulses.pin[i])
+      sprintf_P(pins + strlen(pins), PSTR("%s%d"), *pins ? "," : "", config.pulses.pin[i]);
+  }
+  confJSONItem(CFG_FORM_PULSE_PINS,    pins);
+  *pins = '\0';
+  for (uint8_t i = 0; i < CFG_SHED_MAX; i++) {
+    if (config.shed.pin[i])
+      sprintf_P(pins + strlen(pins), PSTR("%s%d"), *pins ? "," : "", config.shed.pin[i]);
+  }
+  confJSONItem(CFG_FORM_SHED_PINS,     pins);
+  confJSONItem(CFG_FORM_SHED_TRIP,     config.shed.trip);
+  confJSONItem(CFG_FORM_SHED_RESTORE,  config.shed.restore);
+  confJSONItem(CFG_FORM_SHED_MINOFF,   config.shed.min_off);
+  confJSONItem(CFG_FORM_IN_DEB,        config.inputs.debounce ? config.inputs.debounce : CFG_INPUT_DEFAULT_DEB, true);
 
-  r+= F("\""); 
   // Json end
-  r += FPSTR(FP_JSON_END);
-
+  respPrint_P(FP_JSON_END);
 }
 
 /* ======================================================================
@@ -627,69 +1173,53 @@ Comments: -
 ====================================================================== */
 void confJSONTable()
 {
-  String response = "";
   //ESP.wdtFeed();  //Force software watchdog to restart from 0
-  getConfJSONData(response);
   // Just to debug where we are
   Debug(F("Serving /config page..."));
-  server.send ( 200, "text/json", response );
+  respBegin(200, "text/json");
+  getConfJSONData();
+  respEnd();
   Debugln(F("Ok!"));
   yield();  //Let a chance to other threads to work
 }
 
 /* ======================================================================
 Function: getSpiffsJSONData 
-Purpose : Return JSON string containing list of SPIFFS files
-Input   : Response String
+Purpose : Stream JSON containing list of SPIFFS files
+Input   : -
 Output  : - 
 Comments: -
 ====================================================================== */
-void getSpiffsJSONData(String & response)
+void getSpiffsJSONData(void)
 {
-  char buffer[32];
   bool first_item = true;
 
   // Json start
-  response = FPSTR(FP_JSON_START);
+  respPrint_P(FP_JSON_START);
 
   // Files Array  
-  response += F("\"files\":[\r\n");
+  respPrint_P(PSTR("\"files\":[\r\n"));
 
   // Loop trough all files
   Dir dir = SPIFFS.openDir("/");
   while (dir.next()) {    
-    String fileName = dir.fileName();
-    size_t fileSize = dir.fileSize();
     if (first_item)  
       first_item=false;
     else
-      response += ",";
+      respPrint_P(PSTR(","));
 
-    response += F("{\"na\":\"");
-    response += fileName.c_str();
-    response += F("\",\"va\":\"");
-    response += fileSize;
-    response += F("\"}\r\n");
+    respPrintf(PSTR("{\"na\":\"%s\",\"va\":\"%u\"}\r\n"), dir.fileName().c_str(), (unsigned int) dir.fileSize());
   }
-  response += F("],\r\n");
-
+  respPrint_P(PSTR("],\r\n"));
 
   // SPIFFS File system array
-  response += F("\"spiffs\":[\r\n{");
-  
   // Get SPIFFS File system informations
-  FSInfo info;
-  SPIFFS.info(info);
-  response += F("\"Total\":");
-  response += info.totalBytes ;
-  response += F(", \"Used\":");
-  response += info.usedBytes ;
-  response += F(", \"ram\":");
-  response += system_get_free_heap_size() ;
-  response += F("}\r\n]"); 
+  getSpiffsInfo();
+  respPrintf(PSTR("\"spiffs\":[\r\n{\"Total\":%u, \"Used\":%u, \"ram\":%u}\r\n]"),
+             sysinfo.spiffs_total, sysinfo.spiffs_used, system_get_free_heap_size());
 
   // Json end
-  response += FPSTR(FP_JSON_END);
+  respPrint_P(FP_JSON_END);
 }
 
 /* ======================================================================
@@ -701,119 +1231,263 @@ Comments: -
 ====================================================================== */
 void spiffsJSONTable()
 {
-  String response = "";
   //ESP.wdtFeed();  //Force software watchdog to restart from 0
-  getSpiffsJSONData(response);
-  server.send ( 200, "text/json", response );
+  respBegin(200, "text/json");
+  getSpiffsJSONData();
+  respEnd();
   yield();  //Let a chance to other threads to work
 }
 
+/* ======================================================================
+Function: virtualLabel 
+Purpose : get values computed by WifInfo as virtual teleinfo labels
+Input   : label number (0..)
+          name buffer (at least 16 chars)
+          value buffer (at least 16 chars)
+Output  : false when no more label
+Comments: names start with _ so they can't clash with teleinfo ones
+====================================================================== */
+bool virtualLabel(uint8_t n, char * name, char * value)
+{
+  uint8_t i;
+
+  // Pulse counters first, then active power, then statistics
+  for (i = 0; pulseLabel(i, name, value); i++) {
+    if (i == n)
+      return true;
+  }
+  n -= i;
+  if (powerLabel(n, name, value))
+    return true;
+  n -= power_valid ? 1 : 0;
+  return statsLabel(n, name, value);
+}
+
+/* ======================================================================
+Function: virtualValue 
+Purpose : get value of a virtual label
+Input   : label name
+          name length
+          value buffer (at least 16 chars)
+Output  : false if label is unknown
+Comments: -
+====================================================================== */
+bool virtualValue(const char * name, size_t len, char * value)
+{
+  char label[16];
+
+  for (uint8_t n = 0; virtualLabel(n, label, value); n++) {
+    if (!strncmp(label, name, len) && label[len] == '\0')
+      return true;
+  }
+  return false;
+}
+
 /* ======================================================================
 Function: sendJSON 
 Purpose : dump all values in JSON
 Input   : linked list pointer on the concerned data
           true to dump all values, false for only modified ones
 Output  : - 
-Comments: -
+Comments: /json?labels=PAPP,IINST,PTEC dumps only these ones, in this
+          order, null when not in current frame
 ====================================================================== */
 void sendJSON(void)
 {
-  boolean first_item = true;
-  ValueList * me = tinfo.getList();
-  String response = "";
+  String arg = server.arg("labels");
+  const char * labels = arg.length() ? arg.c_str() : NULL;
   
   ESP.wdtFeed();  //Force software watchdog to restart from 0
 
   Debug(F("Serving /json page..."));
   // Got at least one ?
-  if (me) {
+  if (value_count && cborAsked()) {
+    cborJSON(labels);
+  } else if (value_count) {
+    respBegin(200, "text/json");
     // Json start
-    response += FPSTR(FP_JSON_START);
-    response += F("\"_UPTIME\":");
-    response += seconds;
-
-    // Loop thru the node
-    while (me->next) {
-      if(! first_item) 
-          // go to next node
-          me = me->next;
-        
-      if( ! me->free ) {
-        if (first_item)
-            first_item = false;
-          
-        if(validate_value_name(me->name)) {
-          //It's a known name : process the entry
-          response += F(",\"") ;
-          response += me->name ;
-          response += F("\":") ;
-          formatNumberJSON(response, me->value);
-        } else {
-          need_reinit=true;
-        } // name validity
-      } //free entry
-    } //while
+    respPrint_P(FP_JSON_START);
+    respPrintf(PSTR("\"_UPTIME\":%lu"), seconds);
+
+    // Projection, only asked labels in asked order
+    if (labels) {
+      char name[16], value[16];
+      uint8_t kind;
+      int8_t id;
+
+      while ((kind = labelsNext(labels, name, value, id)) != LABEL_END) {
+        respPrintf(PSTR(",\"%s\":"), name);
+        if (kind == LABEL_VIRTUAL)
+          respPrint(value);
+        else
+          valueJSON(id);
+      }
+    }
+
+    // Loop thru the labels of frame
+    for (int8_t id = valueNext(-1); !labels && id >= 0; id = valueNext(id)) {
+      respPrintf(PSTR(",\"%s\":"), tabnames[id]);
+      valueJSON(id);
+    }
+
+    // Virtual labels (pulse counters, power)
+    char name[16], value[16];
+    for (uint8_t n = 0; !labels && virtualLabel(n, name, value); n++)
+      respPrintf(PSTR(",\"%s\":%s"), name, value);
+
    // Json end
-   response += FPSTR(FP_JSON_END) ;
+   respPrint_P(FP_JSON_END);
+   respEnd();
 
   } else {
-    server.send ( 404, "text/plain", "No data" );
+    sendNoData();
   }
-  server.send ( 200, "text/json", response );
-  //Debugln(response);
   Debugln(F("Ok!"));
   yield();  //Let a chance to other threads to work
 }
 
 
+/* ======================================================================
+Function: sendMetrics 
+Purpose : dump numeric values in Prometheus text format
+Input   : -
+Output  : - 
+Comments: non numeric teleinfo values (ADCO, PTEC, ...) are skipped
+====================================================================== */
+void sendMetrics(void)
+{
+  char name[16], value[16];
+
+  respBegin(200, "text/plain; version=0.0.4");
+  respPrintf(PSTR("# TYPE wifinfo_uptime_seconds counter\nwifinfo_uptime_seconds %lu\n"), seconds);
+  respPrintf(PSTR("# TYPE wifinfo_free_heap_bytes gauge\nwifinfo_free_heap_bytes %u\n"), system_get_free_heap_size());
+
+  respPrint_P(PSTR("# TYPE teleinfo_value gauge\n"));
+  for (int8_t id = valueNext(-1); id >= 0; id = valueNext(id)) {
+    uint32_t num;
+
+    if (valueNumber(id, num, false))
+      respPrintf(PSTR("teleinfo_value{label=\"%s\"} %u\n"), tabnames[id], num);
+    else if (value_slots[id].type == VALUE_DIGITS)
+      respPrintf(PSTR("teleinfo_value{label=\"%s\"} %s\n"), tabnames[id], valueText(id) + value_slots[id].skip);
+  }
+
+  for (uint8_t i = 0; i < pulses_count; i++) {
+    if (!pulses[i].pin)
+      continue;
+    respPrintf(PSTR("wifinfo_pulse_total{input=\"%d\"} %u\n"), i + 1, pulseTotal(i));
+    respPrintf(PSTR("wifinfo_pulse_rate_per_hour{input=\"%d\"} %u\n"), i + 1, pulseRate(i));
+  }
+  if (power_valid)
+    respPrintf(PSTR("# TYPE wifinfo_power_watts gauge\nwifinfo_power_watts %d\n"), (int) (power_watt + 0.5));
+  respEnd();
+}
+
+
+// Wifi scan results cache, filled in background by wifiScanHandle()
+typedef struct
+{
+  char    ssid[CFG_SSID_SIZE+1];
+  int8_t  rssi;
+} _scanEntry;
+
+_scanEntry    scan_list[CFG_SCAN_MAX];
+uint8_t       scan_count = 0;
+unsigned long scan_time = 0;        // uptime (s) of last completed scan
+bool          scan_valid = false;   // true once a scan completed
+bool          scan_running = false; // true while async scan in progress
+
+/* ======================================================================
+Function: wifiScanHandle 
+Purpose : collect result of background Wifi scan into cache
+Input   : -
+Output  : - 
+Comments: called from main loop, does nothing if no scan running
+====================================================================== */
+void wifiScanHandle(void)
+{
+  if (!scan_running)
+    return;
+
+  int n = WiFi.scanComplete();
+
+  // Still in progress
+  if (n == WIFI_SCAN_RUNNING)
+    return;
+
+  scan_running = false;
+
+  if (n < 0) {
+    DebuglnF("Wifi scan failed");
+    return;
+  }
+
+  if (n > CFG_SCAN_MAX)
+    n = CFG_SCAN_MAX;
+
+  for (uint8_t i = 0; i < n; ++i) {
+    strncpy(scan_list[i].ssid, WiFi.SSID(i).c_str(), CFG_SSID_SIZE);
+    scan_list[i].ssid[CFG_SSID_SIZE] = '\0';
+    scan_list[i].rssi = WiFi.RSSI(i);
+  }
+  scan_count = n;
+  scan_time = seconds;
+  scan_valid = true;
+
+  // Free SDK results memory
+  WiFi.scanDelete();
+  Debugf("Wifi scan done, %d networks\r\n", n);
+}
+
 /* ======================================================================
 Function: wifiScanJSON 
-Purpose : scan Wifi Access Point and return JSON code
+Purpose : return cached Wifi Access Point list in JSON
 Input   : -
 Output  : - 
-Comments: -
+Comments: never blocks, a background scan is started when cache is
+          older than config.scan_ttl, age of the list is sent in the
+          Age header (and X-Scan-Running while a scan is in progress)
 ====================================================================== */
 void wifiScanJSON(void)
 {
-  String response = "";
   bool first = true;
+  uint16_t ttl = config.scan_ttl ? config.scan_ttl : CFG_SCAN_DEFAULT_TTL;
+  unsigned long age = seconds - scan_time;
+  char buffer[12];
 
   // Just to debug where we are
   Debug(F("Serving /wifiscan page..."));
 
-  int n = WiFi.scanNetworks();
+  // Cache too old, start a new one (only one at a time)
+  if ( (!scan_valid || age >= ttl) && !scan_running ) {
+    if (WiFi.scanNetworks(true) == WIFI_SCAN_RUNNING) {
+      DebugF("scan started...");
+      scan_running = true;
+    }
+  }
+
+  Debug(F("sending..."));
+  if (scan_valid) {
+    sprintf_P(buffer, PSTR("%lu"), age);
+    server.sendHeader("Age", buffer);
+  }
+  if (scan_running)
+    server.sendHeader("X-Scan-Running", "1");
 
+  respBegin(200, "text/json");
   // Json start
-  response += F("[\r\n");
+  respPrint_P(PSTR("[\r\n"));
 
-  for (uint8_t i = 0; i < n; ++i)
+  for (uint8_t i = 0; i < scan_count; ++i)
   {
-    int8_t rssi = WiFi.RSSI(i);
-    
-    uint8_t percent;
-
-    // dBm to Quality
-    if(rssi<=-100)      percent = 0;
-    else if (rssi>=-50) percent = 100;
-    else                percent = 2 * (rssi + 100);
-
-    if (first) 
-      first = false;
-    else
-      response += F(",");
-
-    response += F("{\"ssid\":\"");
-    response += WiFi.SSID(i);
-    response += F("\",\"rssi\":") ;
-    response += rssi;
-    response += FPSTR(FP_JSON_END);
+    respPrintf(PSTR("%s{\"ssid\":\"%s\",\"rssi\":%d"), first ? "" : ",", scan_list[i].ssid, scan_list[i].rssi);
+    respPrint_P(FP_JSON_END);
+    first = false;
   }
 
   // Json end
-  response += FPSTR("]\r\n");
-
-  Debug(F("sending..."));
-  server.send ( 200, "text/json", response );
+  respPrint_P(PSTR("]\r\n"));
+  respEnd();
   Debugln(F("Ok!"));
   yield();  //Let a chance to other threads to work
 }
@@ -872,78 +1546,59 @@ Comments: -
 ====================================================================== */
 void handleNotFound(void) 
 {
-  String response = "";
   boolean found = false;  
+  const char * uri = server.uri().c_str();
+  char value[16];
 
   // Led on
   LedBluON();
 
-  // try to return SPIFFS file
-  found = handleFileRead(server.uri());
-
-  // Try Teleinfo ETIQUETTE
-  if (!found) {
-    // We check for an known label
-    ValueList * me = tinfo.getList();
-    const char * uri;
-    // convert uri to char * for compare
-    uri = server.uri().c_str();
-
-    Debugf("handleNotFound(%s)\r\n", uri);
-
-    // Got at least one and consistent URI ?
-    if (me && uri && *uri=='/' && *++uri ) {
-      
-      // Loop thru the linked list of values
-      while (me->next && !found) {
-
-        // go to next node
-        me = me->next;
-
-        //Debugf("compare to '%s' ", me->name);
-        // Do we have this one ?
-        if (strcmp (me->name, uri) == 0 )
-        {
-          // no need to continue
-          found = true;
-
-          // Add to respone
-          response += F("{\"") ;
-          response += me->name ;
-          response += F("\":") ;
-          formatNumberJSON(response, me->value);
-          response += F("}\r\n");
-        }
-      }
+  Debugf("handleNotFound(%s)\r\n", uri);
+
+  // Teleinfo ETIQUETTE first, most requested route by far, a label
+  // is resolved by its ID without trying SPIFFS
+  int8_t id = (*uri == '/') ? tinfoLabelId(uri + 1) : -1;
+
+  if (id >= 0) {
+    if (value_slots[id].type) {
+      found = true;
+      respBegin(200, "text/json");
+      respPrintf(PSTR("{\"%s\":"), tabnames[id]);
+      valueJSON(id);
+      respPrint_P(PSTR("}\r\n"));
+      respEnd();
+    } else if (!value_count) {
+      found = true;
+      sendNoData();
     }
-
-    // Got it, send json
-    if (found) 
-      server.send ( 200, "text/json", response );
+  } else if (uri[0] == '/' && uri[1] == '_' && virtualValue(uri + 1, strlen(uri + 1), value)) {
+    // Virtual label (pulse counters, power)
+    found = true;
+    respBegin(200, "text/json");
+    respPrintf(PSTR("{\"%s\":%s}\r\n"), uri + 1, value);
+    respEnd();
+  } else {
+    // try to return SPIFFS file
+    found = handleFileRead(server.uri());
   }
 
   // All trys failed
   if (!found) {
     // send error message in plain text
-    String message = F("File Not Found\n\n");
-    message += F("URI: ");
-    message += server.uri();
-    message += F("\nMethod: ");
-    message += ( server.method() == HTTP_GET ) ? "GET" : "POST";
-    message += F("\nArguments: ");
-    message += server.args();
-    message += FPSTR(FP_NL);
+    respBegin(404, "text/plain");
+    respPrintf(PSTR("File Not Found\n\nURI: %s\nMethod: %s\nArguments: %d\r\n"),
+               server.uri().c_str(), ( server.method() == HTTP_GET ) ? "GET" : "POST", server.args());
 
     for ( uint8_t i = 0; i < server.args(); i++ ) {
-      message += " " + server.argName ( i ) + ": " + server.arg ( i ) + FPSTR(FP_NL);
+      respPrintf(PSTR(" %s: %s\r\n"), server.argName(i).c_str(), server.arg(i).c_str());
     }
-
-    server.send ( 404, "text/plain", message );
+    respEnd();
   }
 
   // Led off
   LedBluOFF();
 }
+
 /* ======================================================================
 Function: validate_value_name
 Purpose : check if value name is in known range of values....
@@ -951,15 +1606,119 @@ Input   : name to check
 Output  : true if OK, false otherwise
 Comments: -
 ====================================================================== */
-bool validate_value_name(String name)
+bool validate_value_name(const char * name)
 {
-	
-  for (int i=0 ; i < 35; i++ ) {
-    if( (tabnames[i].length() == name.length()) && (tabnames[i] == name) ) {
-      return true;
-    }
+  return tinfoLabelId(name) >= 0;
+}
+
+/* ======================================================================
+Function: tinfoLabelHash
+Purpose : hash table slot of a label name
+Input   : label name
+Output  : first slot to probe
+Comments: FNV-1a
+====================================================================== */
+uint8_t tinfoLabelHash(const char * name)
+{
+  uint32_t h = 2166136261UL;
+
+  while (*name) {
+    h ^= (uint8_t) *name++;
+    h *= 16777619UL;
+  }
+  return h & (TINFO_HASH_SIZE - 1);
+}
+
+/* ======================================================================
+Function: tinfoLabelsInit
+Purpose : build label name to ID hash table
+Input   : -
+Output  : -
+Comments: call once at setup, before teleinfo is started
+====================================================================== */
+void tinfoLabelsInit(void)
+{
+  memset(tinfo_hash, -1, sizeof(tinfo_hash));
+
+  for (uint8_t i = 0; i < TINFO_LABELS; i++) {
+    uint8_t h = tinfoLabelHash(tabnames[i]);
+    while (tinfo_hash[h] >= 0)
+      h = (h + 1) & (TINFO_HASH_SIZE - 1);
+    tinfo_hash[h] = i;
+  }
+}
+
+/* ======================================================================
+Function: tinfoLabelId
+Purpose : numeric ID of a teleinfo label
+Input   : label name
+Output  : index in known names table, -1 if not an existing name
+Comments: IDs are given by /labels.json, new names are added at end
+          of table so IDs don't change. Table is half empty so a
+          lookup is mostly one string compare
+====================================================================== */
+int8_t tinfoLabelId(const char * name)
+{
+  uint8_t h = tinfoLabelHash(name);
+
+  while (tinfo_hash[h] >= 0) {
+    if (strcmp(tabnames[tinfo_hash[h]], name) == 0)
+      return tinfo_hash[h];
+    h = (h + 1) & (TINFO_HASH_SIZE - 1);
   }
-	return false; //Not an existing name !
-  //return true;
+	return -1; //Not an existing name !
 }
 
+/* ======================================================================
+Function: labelsNext
+Purpose : get next label of a ?labels=A,B,C projection list
+Input   : list pointer, moved after the label
+          name buffer (16 chars)
+          value buffer of virtual labels (16 chars)
+          where to put label ID of teleinfo labels
+Output  : LABEL_END, LABEL_TINFO, LABEL_VIRTUAL, LABEL_ABSENT (known
+          label, no value in current frame)
+Comments: unknown names are skipped, so they never reach the output
+====================================================================== */
+uint8_t labelsNext(const char * & list, char * name, char * value, int8_t & id)
+{
+  while (*list) {
+    const char * p = list;
+    size_t len;
+
+    while (*list && *list != ',')
+      list++;
+    len = list - p;
+    if (*list)
+      list++;
+
+    if (!len || len > 15)
+      continue;
+    memcpy(name, p, len);
+    name[len] = '\0';
+
+    id = tinfoLabelId(name);
+    if (id >= 0)
+      return value_slots[id].type ? LABEL_TINFO : LABEL_ABSENT;
+    if (virtualValue(name, len, value))
+      return LABEL_VIRTUAL;
+  }
+  return LABEL_END;
+}
+
+/* ======================================================================
+Function: labelsJSONTable
+Purpose : dump teleinfo label IDs used by binary (CBOR) responses
+Input   : -
+Output  : - 
+Comments: {"ADCO":0,"OPTARIF":1,...}
+====================================================================== */
+void labelsJSONTable(void)
+{
+  respBegin(200, "text/json");
+  respPrint_P(PSTR("{"));
+  for (uint8_t i=0 ; i < sizeof(tabnames)/sizeof(tabnames[0]); i++ )
+    respPrintf(PSTR("%s\"%s\":%u"), i ? "," : "", tabnames[i], i);
+  respPrint_P(PSTR("}\r\n"));
+  respEnd();
+}
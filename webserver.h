@@ -26,41 +26,82 @@
 // Include main project include file
 #include "Wifinfo.h"
 
-// Web response max size
+// Web response arena size, and size of streamed chunk taken from it
+// (one TCP segment), the rest is left for per request scratch buffers
 #define RESPONSE_BUFFER_SIZE 4096
+#define RESPONSE_CHUNK_SIZE  1460
+// Retry-After (s) sent while no frame is parsed yet, a frame
+// takes about 1.5 s at 1200 bauds
+#define TINFO_RETRY_AFTER    2
+// Known teleinfo labels (tabnames)
+#define TINFO_LABELS         34
+// Label name to ID hash table, power of 2 and about twice the labels
+#define TINFO_HASH_SIZE      64
+
+// Kinds of labels of a ?labels= projection
+#define LABEL_END            0
+#define LABEL_TINFO          1
+#define LABEL_VIRTUAL        2
+#define LABEL_ABSENT         3
 
 // Exported variables/object instancied in main sketch
 // ===================================================
 extern char         response[];
 extern uint16_t     response_idx;
+extern uint16_t     response_peak;
+extern uint16_t     response_fail;
 extern int          nb_reconnect;
 extern unsigned int nb_reinit;
 extern bool		      need_reinit;
 extern bool         first_info_call;
-extern int          SwitchState;
+extern const char   FP_JSON_START[];
+extern const char   FP_JSON_END[];
+extern const char * const tabnames[];
 
 // Exported function instancied in webclient.cpp
 // =============================================
-extern String build_emoncms_json(void);
+extern bool build_emoncms_json(char * buf, size_t size);
 
 // declared exported function from webserver.cpp
 // ===================================================
+void * arenaAlloc(size_t size);
+void arenaReset(void);
+void respBegin(int code, const char * content_type);
+void respFlush(void);
+void respWrite(const char * data, size_t len);
+void respPrint(const char * str);
+void respPrint_P(PGM_P str);
+void respPrintf(const char * fmt, ...) __attribute__ ((format (printf, 1, 2)));
+void sendNoData(void);
+void respEnd(void);
+bool bufPrintf(char * buf, size_t size, uint16_t & idx, const char * fmt, ...) __attribute__ ((format (printf, 4, 5)));
+char * formatSize(char * buf, uint32_t bytes);
+void getSpiffsInfo(void);
 void handleTest(void);
 void handleRoot(void); 
 void handleFormConfig(void) ;
 void handleNotFound(void);
 void tinfoJSONTable(void);
-void getSysJSONData(String & r);
+void getSysJSONData(void);
 void sysJSONTable(void);
 void emoncmsJSONTable(void);    //Added by Doume
-void getConfJSONData(String & r);
+void getConfJSONData(void);
 void confJSONTable(void);
-void getSpiffsJSONData(String & r);
+bool textFileSave(const char * path, const String & text, size_t max);
+void getSpiffsJSONData(void);
 void spiffsJSONTable(void);
+bool virtualLabel(uint8_t n, char * name, char * value);
+bool virtualValue(const char * name, size_t len, char * value);
 void sendJSON(void);
+void sendMetrics(void);
 void wifiScanJSON(void);
+void wifiScanHandle(void);
 void handleFactoryReset(void);
 void handleReset(void);
-bool validate_value_name(String name);
+bool validate_value_name(const char * name);
+void tinfoLabelsInit(void);
+int8_t tinfoLabelId(const char * name);
+uint8_t labelsNext(const char * & list, char * name, char * value, int8_t & id);
+void labelsJSONTable(void);
 
 #endif